@@ -1,15 +1,26 @@
 #include "BleManager.h"
 #include "BleOta.h"
 #include "Controller.h"
+#include "EventLoop.h"
+#include "Metrics.h"
+#include "Trace.h"
 
-#define DEBUG_ENABLE_BLEMANAGER 1
-#if ((DEBUG_ENABLE_BLEMANAGER == 1) && (ENABLE_DEBUG_OUTPUT == 1))
-#define DEBUG_INFO(f, ...) debugPrint("[INF][BleMgr]", f, ##__VA_ARGS__)
+#define LOG_LEVEL_BLEMANAGER LOG_LEVEL_INFO
+#if ((LOG_LEVEL_BLEMANAGER >= LOG_LEVEL_ERROR) && (ENABLE_DEBUG_OUTPUT == 1))
 #define DEBUG_ERROR(f, ...) debugPrint("[ERR][BleMgr]", f, ##__VA_ARGS__)
 #else
-#define DEBUG_INFO(...)
 #define DEBUG_ERROR(...)
 #endif
+#if ((LOG_LEVEL_BLEMANAGER >= LOG_LEVEL_INFO) && (ENABLE_DEBUG_OUTPUT == 1))
+#define DEBUG_INFO(f, ...) debugPrint("[INF][BleMgr]", f, ##__VA_ARGS__)
+#else
+#define DEBUG_INFO(...)
+#endif
+#if ((LOG_LEVEL_BLEMANAGER >= LOG_LEVEL_VERBOSE) && (ENABLE_DEBUG_OUTPUT == 1))
+#define DEBUG_VERBOSE(f, ...) debugPrint("[VRB][BleMgr]", f, ##__VA_ARGS__)
+#else
+#define DEBUG_VERBOSE(...)
+#endif
 
 class ServerCallbacks : public NimBLEServerCallbacks {
   void onConnect(NimBLEServer* pServer, NimBLEConnInfo& connInfo) override {
@@ -73,10 +84,31 @@ void BleManager::initialize() {
   advertising_->enableScanResponse(true);
   startAdvertising();
 
+  initialized_ = true;
+  Metrics::getInstance().recordBootStage(Metrics::BootStage::BLE_READY);
   DEBUG_INFO("BLE device: '%s', %s", DEVICE_NAME, NimBLEDevice::getAddress().toString().c_str());
   DEBUG_INFO("Initialize BLE Manager [OK]");
 }
 
+void BleManager::initializeAsync() {
+  // Bringing up NimBLE with all services takes a while, the loop keeps rendering in the meantime
+  BaseType_t created = xTaskCreatePinnedToCore(initTaskFunction, "ble_init", InitTaskStackSize, this,  //
+                                               InitTaskPriority, nullptr, InitTaskCore);
+  if (created != pdPASS) {
+    DEBUG_ERROR("Failed to create BLE init task, initialize synchronously!");
+    initialize();
+  }
+}
+
+bool BleManager::isInitialized() const {
+  return initialized_;
+}
+
+void BleManager::initTaskFunction(void* parameter) {
+  static_cast<BleManager*>(parameter)->initialize();
+  vTaskDelete(nullptr);
+}
+
 void BleManager::startAdvertising() {
   DEBUG_INFO("Start advertising BLE services");
   advertising_->start();
@@ -95,21 +127,29 @@ void BleManager::onClientConnect(bool connected) {
     subscribed_ = false;
     startAdvertising();
   }
+  EventLoop::getInstance().notify(EventLoop::EVENT_BLE_STATE);
 }
 
 void BleManager::onMtuChange(uint16_t mtu) {
   DEBUG_INFO("Net MTU changed: %d", mtu - AttPacketOverhead);
   net_mtu_ = mtu - AttPacketOverhead;
+  EventLoop::getInstance().notify(EventLoop::EVENT_BLE_STATE);
 }
 
 void BleManager::onSubscribe(bool subscribed) {
   DEBUG_INFO("Client subscribed: %s", subscribed ? "true" : "false");
   subscribed_ = subscribed;
+  EventLoop::getInstance().notify(EventLoop::EVENT_BLE_STATE);
 }
 
 void BleManager::onWriteConfirm(bool confirmed) {
-  DEBUG_INFO("Write confirmed: %s", confirmed ? "true" : "false");
+  DEBUG_VERBOSE("Write confirmed: %s", confirmed ? "true" : "false");
+  TRACE(BLE_TX_CONFIRM, 0);
+  if (confirmed == true) {
+    Metrics::getInstance().record(Metrics::Histogram::BLE_TX_CHUNK_RTT, micros() - tx_chunk_start_us_);
+  }
   tx_confirmed_ = confirmed;
+  EventLoop::getInstance().notify(EventLoop::EVENT_TX_CONFIRM);
 }
 
 void BleManager::onDataReceived(const uint8_t data[], size_t length) {
@@ -118,8 +158,11 @@ void BleManager::onDataReceived(const uint8_t data[], size_t length) {
     return;
   }
 
-  DEBUG_INFO("Data received (%zu): '%.*s'", length, static_cast<int>(length), data);
+  DEBUG_VERBOSE("Data received (%zu): '%.*s'", length, static_cast<int>(length), data);
+  TRACE(BLE_RX_CHUNK, length);
+  Metrics::getInstance().recordRx(length);
   Controller::getInstance().dataReceivedCallback(data, length);
+  EventLoop::getInstance().notify(EventLoop::EVENT_RX_DATA);
 }
 
 bool BleManager::writeData(const uint8_t data[], size_t length) {
@@ -137,6 +180,7 @@ bool BleManager::writeData(const uint8_t data[], size_t length) {
   tx_index_ = 0;                          // Reset the index for TX data
 
   DEBUG_INFO("Initiate TX of %zu bytes [...]", tx_length_);
+  Metrics::getInstance().count(Metrics::Counter::TX_BYTES, length);
   tx_start_time_ = millis();
   tx_confirmed_ = true;
   tx_ongoing_ = true;
@@ -156,9 +200,11 @@ bool BleManager::writeDataChunk() {
     // More data to send, continue with next write cycle
     size_t remaining = tx_length_ - tx_index_;
     size_t length = (remaining < net_mtu_) ? remaining : net_mtu_;
-    DEBUG_INFO("Send data (len: %zu) chunk ...", length);
+    DEBUG_VERBOSE("Send data (len: %zu) chunk ...", length);
 
     txCharacteristic_->setValue(tx_data_ + tx_index_, length);
+    tx_chunk_start_us_ = micros();
+    TRACE(BLE_TX_CHUNK, length);
     if (txCharacteristic_->indicate() == false) {
       DEBUG_ERROR("Failed to send indication!");
     }
@@ -173,7 +219,23 @@ bool BleManager::writeDataChunk() {
   return true;
 }
 
+int64_t BleManager::getWakeUpUs() const {
+  if (tx_ongoing_ == false) {
+    return EventLoop::WakeUpOnEvent;
+  }
+  if (tx_confirmed_ == true) {
+    return esp_timer_get_time();  // Next chunk can be sent right away
+  }
+  // Confirmation is signaled by an event, only the timeout needs a wake up
+  uint32_t elapsed_ms = millis() - tx_start_time_;
+  return esp_timer_get_time() + ((elapsed_ms < TxTimeout) ? (TxTimeout - elapsed_ms) * 1000LL : 0);
+}
+
 void BleManager::run() {
+  if (initialized_ == false) {
+    return;
+  }
+
   // Handle ongoing TX operations
   if (tx_ongoing_ == true) {
     // Check if next chunk can be sent
@@ -185,6 +247,7 @@ void BleManager::run() {
       }
     } else if (millis() - tx_start_time_ >= TxTimeout) {
       DEBUG_ERROR("TX timeout expired, aborting TX operation!");
+      Metrics::getInstance().count(Metrics::Counter::TX_TIMEOUTS);
       tx_ongoing_ = false;
       tx_confirmed_ = false;
     }
@@ -15,6 +15,10 @@ class BleManager {
   constexpr static size_t AttPacketOverhead = 3;  // ATT packet overhead for notifications/indications
   constexpr static size_t MaxTxDataLength = 23 - AttPacketOverhead;  // Minimum TX data length (default MTU 23)
 
+  constexpr static uint32_t InitTaskStackSize = 6144;  // Stack size of the one-shot init task in bytes
+  constexpr static UBaseType_t InitTaskPriority = 1;   // Below the Arduino loop task, rendering comes first
+  constexpr static BaseType_t InitTaskCore = 0;        // Same core as the NimBLE host task
+
  public:
   BleManager(const BleManager&) = delete;
   BleManager& operator=(const BleManager&) = delete;
@@ -25,6 +29,8 @@ class BleManager {
   }
 
   void initialize();
+  void initializeAsync();
+  bool isInitialized() const;
   void startAdvertising();
   void stopAdvertising();
   void onClientConnect(bool connected);
@@ -35,25 +41,29 @@ class BleManager {
   bool writeData(const uint8_t data[], size_t length);
   bool writeDataChunk();
   void run();
+  int64_t getWakeUpUs() const;  // Next time run() has work to do (see EventLoop::wait)
 
  private:
   BleManager() = default;
+  static void initTaskFunction(void* parameter);
 
   NimBLEServer* server_ = nullptr;
   NimBLEService* service_ = nullptr;
   NimBLECharacteristic* txCharacteristic_ = nullptr;
   NimBLECharacteristic* rxCharacteristic_ = nullptr;
   NimBLEAdvertising* advertising_ = nullptr;
+  volatile bool initialized_ = false;  // Set by the init task once the stack is up and advertising
   bool connected_ = false;
   bool subscribed_ = false;
   uint16_t net_mtu_ = MaxTxDataLength;
 
-  uint32_t tx_start_time_ = 0;  // Start time for TX operation
-  bool tx_ongoing_ = false;     // Flag to indicate if TX is ongoing
-  uint8_t* tx_data_ = nullptr;  // Pointer to hold TX data
-  size_t tx_length_ = 0;        // Length of TX data
-  size_t tx_index_ = 0;         // Current index in TX data
-  bool tx_confirmed_ = false;   // Flag to indicate if TX was confirmed
+  uint32_t tx_start_time_ = 0;      // Start time for TX operation
+  bool tx_ongoing_ = false;         // Flag to indicate if TX is ongoing
+  uint8_t* tx_data_ = nullptr;      // Pointer to hold TX data
+  size_t tx_length_ = 0;            // Length of TX data
+  size_t tx_index_ = 0;             // Current index in TX data
+  bool tx_confirmed_ = false;       // Flag to indicate if TX was confirmed
+  uint32_t tx_chunk_start_us_ = 0;  // Time the last chunk was indicated, for the round trip metric
 };
 
 #endif  // BLE_MANAGER_H
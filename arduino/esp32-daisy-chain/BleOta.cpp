@@ -2,14 +2,17 @@
 #include <NimBLEDis.h>
 #include <NimBLEOta.h>
 
-#define DEBUG_ENABLE_BLEOTA 1
-#if ((DEBUG_ENABLE_BLEOTA == 1) && (ENABLE_DEBUG_OUTPUT == 1))
-#define DEBUG_INFO(f, ...) debugPrint("[INF][BleOta]", f, ##__VA_ARGS__)
+#define LOG_LEVEL_BLEOTA LOG_LEVEL_INFO
+#if ((LOG_LEVEL_BLEOTA >= LOG_LEVEL_ERROR) && (ENABLE_DEBUG_OUTPUT == 1))
 #define DEBUG_ERROR(f, ...) debugPrint("[ERR][BleOta]", f, ##__VA_ARGS__)
 #else
-#define DEBUG_INFO(...)
 #define DEBUG_ERROR(...)
 #endif
+#if ((LOG_LEVEL_BLEOTA >= LOG_LEVEL_INFO) && (ENABLE_DEBUG_OUTPUT == 1))
+#define DEBUG_INFO(f, ...) debugPrint("[INF][BleOta]", f, ##__VA_ARGS__)
+#else
+#define DEBUG_INFO(...)
+#endif
 
 NimBLEOta bleOta;
 NimBLEDis bleDis;
@@ -1,31 +1,95 @@
 #include "Controller.h"
 #include "BleManager.h"
 #include "DaisyChain.h"
+#include "EventLoop.h"
+#include "Keyframes.h"
+#include "Metrics.h"
 #include "Player.h"
+#include "StorageWorker.h"
+#include "Trace.h"
+#include "esp_timer.h"
+#include "mbedtls/base64.h"
 
-#define DEBUG_ENABLE_CONTROLLER 1
-#if ((DEBUG_ENABLE_CONTROLLER == 1) && (ENABLE_DEBUG_OUTPUT == 1))
-#define DEBUG_INFO(f, ...) debugPrint("[INF][Ctrl]", f, ##__VA_ARGS__)
+#define LOG_LEVEL_CONTROLLER LOG_LEVEL_INFO
+#if ((LOG_LEVEL_CONTROLLER >= LOG_LEVEL_ERROR) && (ENABLE_DEBUG_OUTPUT == 1))
 #define DEBUG_ERROR(f, ...) debugPrint("[ERR][Ctrl]", f, ##__VA_ARGS__)
 #else
-#define DEBUG_INFO(...)
 #define DEBUG_ERROR(...)
 #endif
+#if ((LOG_LEVEL_CONTROLLER >= LOG_LEVEL_INFO) && (ENABLE_DEBUG_OUTPUT == 1))
+#define DEBUG_INFO(f, ...) debugPrint("[INF][Ctrl]", f, ##__VA_ARGS__)
+#else
+#define DEBUG_INFO(...)
+#endif
+#if ((LOG_LEVEL_CONTROLLER >= LOG_LEVEL_VERBOSE) && (ENABLE_DEBUG_OUTPUT == 1))
+#define DEBUG_VERBOSE(f, ...) debugPrint("[VRB][Ctrl]", f, ##__VA_ARGS__)
+#else
+#define DEBUG_VERBOSE(...)
+#endif
 
 void Controller::initialize() {
   DEBUG_INFO("Initialize Controller [...]");
 
   // Initialize RX and TX buffers
-  memset(rx_buffer_, 0, RxBufferSize);
+  allocateBuffers();
+  memset(rx_buffer_, 0, rx_buffer_size_);
   memset(tx_buffer_, 0, TxBufferSize);
 
   rx_index_ = 0;        // Reset RX index
   rx_start_time_ = 0;   // Reset RX start time
   rx_ongoing_ = false;  // Reset RX ongoing flag
 
+  for (size_t i = 0; i < MaxCachedResponses; i++) {
+    response_cache_[i].rid = -1;
+  }
+
   DEBUG_INFO("Initialize Controller [OK]");
 }
 
+void Controller::allocateBuffers() {
+  // With PSRAM a (packed) request may be as long as its header allows and a show may address every LED, internal
+  // RAM keeps the limits of a plain request
+  if (psramFound() == true) {
+    rx_buffer_ = static_cast<uint8_t*>(ps_malloc(RxBufferSizePsram));
+    rx_buffer_size_ = RxBufferSizePsram;
+    show_led_capacity_ = MaxShowLedObjectsPsram;
+    bool allocated = (rx_buffer_ != nullptr);
+    for (size_t i = 0; i < ShowBankCount; i++) {
+      shows_[i].leds = static_cast<LedObj*>(ps_malloc(sizeof(LedObj) * show_led_capacity_));
+      allocated = allocated && (shows_[i].leds != nullptr);
+    }
+    if (allocated == false) {
+      DEBUG_ERROR("Failed to allocate RX buffers in PSRAM, the limits of internal RAM apply");
+      free(rx_buffer_);
+      rx_buffer_ = nullptr;
+      for (size_t i = 0; i < ShowBankCount; i++) {
+        free(shows_[i].leds);
+      }
+    }
+  }
+  if (rx_buffer_ == nullptr) {
+    rx_buffer_ = new uint8_t[RxBufferSize];
+    rx_buffer_size_ = RxBufferSize;
+    show_led_capacity_ = MaxLedObjects;
+    for (size_t i = 0; i < ShowBankCount; i++) {
+      shows_[i].leds = new LedObj[show_led_capacity_];
+    }
+  }
+  DEBUG_INFO("  RX buffer: %zu bytes, %zu LED objects per show", rx_buffer_size_, show_led_capacity_);
+}
+
+void* Controller::RxJsonAllocator::allocate(size_t size) {
+  return (psramFound() == true) ? ps_malloc(size) : malloc(size);
+}
+
+void Controller::RxJsonAllocator::deallocate(void* pointer) {
+  free(pointer);
+}
+
+void* Controller::RxJsonAllocator::reallocate(void* pointer, size_t new_size) {
+  return (psramFound() == true) ? ps_realloc(pointer, new_size) : realloc(pointer, new_size);
+}
+
 void Controller::dataReceivedCallback(const uint8_t data[], size_t length) {
   if (data == nullptr || length == 0) {
     DEBUG_ERROR("Received data is NULL or empty!");
@@ -40,286 +104,1609 @@ void Controller::dataReceivedCallback(const uint8_t data[], size_t length) {
     // Start new RX operation
     rx_ongoing_ = true;
     rx_index_ = 0;
+    rx_time_us_ = esp_timer_get_time();
+    rx_packed_ = (data[0] == PackedMagic);
+    rx_header_length_ = 0;
+    rx_packed_failed_ = false;
+  }
+
+  if (rx_packed_ == true) {
+    receivePacked(data, length);
+    return;
+  }
+
+  if (rx_index_ + length > rx_buffer_size_) {
+    DEBUG_ERROR("RX buffer overflow!");
+    return;
+  }
+
+  memcpy(rx_buffer_ + rx_index_, data, length);
+  rx_index_ += length;
+
+  // Check if string terminator is present
+  if (rx_index_ > 0 && rx_buffer_[rx_index_ - 1] == '\0') {
+    DEBUG_INFO("Full doc (%zu) received: '%.*s'", rx_index_, static_cast<int>(rx_index_), rx_buffer_);
+    process_rx_data_ = true;
+  }
+}
+
+void Controller::receivePacked(const uint8_t data[], size_t length) {
+  if (rx_packed_failed_ == true) {
+    return;
+  }
+
+  // Header first, its length fields tell where the request ends
+  while (rx_header_length_ < PackedHeaderSize && length > 0) {
+    rx_header_[rx_header_length_++] = *data++;
+    length--;
+    if (rx_header_length_ == PackedHeaderSize) {
+      rx_packed_remaining_ = rx_header_[1] | (rx_header_[2] << 8);
+      rx_unpacked_length_ = rx_header_[3] | (rx_header_[4] << 8);
+      if (rx_unpacked_length_ > rx_buffer_size_) {
+        DEBUG_ERROR("Packed request too large (%zu)!", rx_unpacked_length_);
+        rx_packed_failed_ = true;
+        return;
+      }
+      rx_decoder_.begin(rx_buffer_, rx_unpacked_length_);
+    }
+  }
+  if (length == 0) {
+    return;
+  }
+
+  if (length > rx_packed_remaining_ || rx_decoder_.decode(data, length) == false) {
+    DEBUG_ERROR("Packed request corrupt!");
+    rx_packed_failed_ = true;
+    return;
+  }
+  rx_packed_remaining_ -= length;
+  rx_index_ = rx_decoder_.getLength();
+
+  if (rx_packed_remaining_ == 0) {
+    if (rx_index_ != rx_unpacked_length_ || rx_index_ == 0 || rx_buffer_[rx_index_ - 1] != '\0') {
+      DEBUG_ERROR("Packed request incomplete (%zu of %zu)!", rx_index_, rx_unpacked_length_);
+      rx_packed_failed_ = true;
+      return;
+    }
+    DEBUG_INFO("Full packed doc (%zu) received: '%.*s'", rx_index_, static_cast<int>(rx_index_), rx_buffer_);
+    process_rx_data_ = true;
+  }
+}
+
+void Controller::run() {
+  if (rx_ongoing_ == true) {
+    // Check if data can be processed
+    if (process_rx_data_ == true) {
+      TRACE(CMD_BEGIN, rx_index_);
+      processReceivedData();
+      TRACE(CMD_END, current_rid_);
+      rx_index_ = 0;
+      rx_ongoing_ = false;
+      process_rx_data_ = false;
+
+    } else if (millis() - rx_start_time_ >= RxTimeout) {
+      DEBUG_ERROR("RX timeout expired, aborting RX operation!");
+      Metrics::getInstance().count(Metrics::Counter::RX_TIMEOUTS);
+      rx_index_ = 0;
+      rx_ongoing_ = false;
+      process_rx_data_ = false;
+    }
+  }
+
+  runSchedule();
+  Trace::getInstance().run();
+}
+
+void Controller::processReceivedData() {
+  if (rx_index_ == 0) {
+    DEBUG_ERROR("No data to process!");
+    return;
+  }
+  current_rid_ = -1;
+  Metrics::getInstance().count(Metrics::Counter::RX_REQUESTS);
+  uint32_t request_crc = crc32(rx_buffer_, rx_index_);  // A retry repeats the rid and the request bytes
+
+  // Parse JSON from the RX buffer
+  uint32_t parse_start_us = micros();
+  DeserializationError error = deserializeJson(rx_json_doc_, rx_buffer_, rx_index_);
+  Metrics::getInstance().record(Metrics::Histogram::JSON_PARSE, micros() - parse_start_us);
+  if (error != DeserializationError::Ok) {
+    sendStatusResponse(-1, KEY_MSG, "Deserialize JSON string failed (%s)", error.c_str());
+    return;
+  }
+
+  // Parse request id
+  if (rx_json_doc_.containsKey(KEY_RID) == false) {
+    sendStatusResponse(-1, KEY_MSG, STATUS_MSG_MISSING_KEY, KEY_RID);
+    return;
+  }
+  current_rid_ = rx_json_doc_[KEY_RID];
+
+  // Parse the command from the JSON document
+  if (rx_json_doc_.containsKey(KEY_CMD) == false) {
+    sendStatusResponse(-1, KEY_MSG, STATUS_MSG_MISSING_KEY, KEY_CMD);
+    return;
+  }
+  const char* cmd = rx_json_doc_[KEY_CMD];
+
+  // Reads are answered fresh, everything else is executed once per rid and request
+  if (current_rid_ >= 0 && isReadOnly(cmd) == false) {
+    if (replayResponse(request_crc) == true) {
+      return;
+    }
+    CachedResponse& entry = response_cache_[response_cache_next_];
+    entry.rid = current_rid_;
+    entry.request_crc = request_crc;
+    entry.time_ms = millis();
+    entry.length = 0;
+    response_cache_next_ = (response_cache_next_ + 1) % MaxCachedResponses;
+  }
+
+  if (rx_json_doc_.containsKey(KEY_AT) == true) {
+    scheduleCommand(cmd);
+    return;
+  }
+  dispatchCommand(cmd);
+}
+
+void Controller::dispatchCommand(const char cmd[]) {
+  if (strcmp(cmd, CMD_GET_VERSION) == 0) {
+    handleGetVersion();
+  } else if (strcmp(cmd, CMD_SYNC_TIME) == 0) {
+    handleSyncTime();
+  } else if (strcmp(cmd, CMD_GET_STATS) == 0) {
+    handleGetStats();
+  } else if (strcmp(cmd, CMD_RESET_STATS) == 0) {
+    handleResetStats();
+  } else if (strcmp(cmd, CMD_GET_TRACE) == 0) {
+    handleGetTrace();
+  } else if (strcmp(cmd, CMD_GET_SYSTEM_ID) == 0) {
+    handleGetSystemId();
+  } else if (strcmp(cmd, CMD_SET_SYSTEM_ID) == 0) {
+    handleSetSystemId();
+  } else if (strcmp(cmd, CMD_GET_TOPOLOGY) == 0) {
+    handleGetTopology();
+  } else if (strcmp(cmd, CMD_SET_TOPOLOGY) == 0) {
+    handleSetTopology();
+  } else if (strcmp(cmd, CMD_GET_REFRESH_INTERVAL) == 0) {
+    handleGetRefreshInterval();
+  } else if (strcmp(cmd, CMD_SET_REFRESH_INTERVAL) == 0) {
+    handleSetRefreshInterval();
+  } else if (strcmp(cmd, CMD_GET_CALIBRATION_NAME) == 0) {
+    handleGetCalibrationName();
+  } else if (strcmp(cmd, CMD_DELETE_CALIBRATION) == 0) {
+    handleDeleteCalibration();
+  } else if (strcmp(cmd, CMD_SAVE_CALIBRATION) == 0) {
+    handleSaveCalibration();
+  } else if (strcmp(cmd, CMD_LIST_PROFILES) == 0) {
+    handleListProfiles();
+  } else if (strcmp(cmd, CMD_SAVE_PROFILE) == 0) {
+    handleSaveProfile();
+  } else if (strcmp(cmd, CMD_SELECT_PROFILE) == 0) {
+    handleSelectProfile();
+  } else if (strcmp(cmd, CMD_DELETE_PROFILE) == 0) {
+    handleDeleteProfile();
+  } else if (strcmp(cmd, CMD_SET_BRIGHTNESS) == 0) {
+    handleSetBrightness();
+  } else if (strcmp(cmd, CMD_GET_BRIGHTNESS) == 0) {
+    handleGetBrightness();
+  } else if (strcmp(cmd, CMD_SET_MASTER) == 0) {
+    handleSetMaster();
+  } else if (strcmp(cmd, CMD_SET_TWINKLE) == 0) {
+    handleSetTwinkle();
+  } else if (strcmp(cmd, CMD_WRITE_LAYOUT) == 0) {
+    handleWriteLayout();
+  } else if (strcmp(cmd, CMD_COMMIT_LAYOUT) == 0) {
+    handleCommitLayout();
+  } else if (strcmp(cmd, CMD_SET_PATTERN) == 0) {
+    handleSetPattern();
+  } else if (strcmp(cmd, CMD_WRITE_CALIBRATION) == 0) {
+    handleWriteCalibration();
+  } else if (strcmp(cmd, CMD_COMMIT_CALIBRATION) == 0) {
+    handleCommitCalibration();
+  } else if (strcmp(cmd, CMD_READ_CALIBRATION) == 0) {
+    handleReadCalibration();
+  } else if (strcmp(cmd, CMD_PLAY) == 0) {
+    handlePlayShow();
+  } else if (strcmp(cmd, CMD_STOP) == 0) {
+    handleStopShow();
+  } else if (strcmp(cmd, CMD_QUEUE) == 0) {
+    handleQueueShow();
+  } else if (strcmp(cmd, CMD_PAUSE) == 0) {
+    handlePauseShow();
+  } else if (strcmp(cmd, CMD_RESUME) == 0) {
+    handleResumeShow();
+  } else if (strcmp(cmd, CMD_SET_TEMPO) == 0) {
+    handleSetTempo();
+  } else if (strcmp(cmd, CMD_SEEK) == 0) {
+    handleSeekShow();
+  } else if (strcmp(cmd, CMD_SET_GAIN) == 0) {
+    handleSetGain();
+  } else if (strcmp(cmd, CMD_SET_STEP) == 0) {
+    handleSetStep();
+  } else if (strcmp(cmd, CMD_KEYFRAME) == 0) {
+    handleKeyframe();
+  } else if (strcmp(cmd, CMD_BATCH) == 0) {
+    handleBatch();
+  } else {
+    sendStatusResponse(-1, KEY_MSG, "Unknown '%s': '%s'", KEY_CMD, cmd);
+  }
+}
+
+void Controller::scheduleCommand(const char cmd[]) {
+  if (strcmp(cmd, CMD_PLAY) != 0 && strcmp(cmd, CMD_STOP) != 0 && strcmp(cmd, CMD_SET_BRIGHTNESS) != 0 &&  //
+      strcmp(cmd, CMD_SET_MASTER) != 0 && strcmp(cmd, CMD_BATCH) != 0) {
+    sendStatusResponse(-1, KEY_MSG, "Command '%s' can not be scheduled!", cmd);
+    return;
+  }
+
+  int64_t at_us = rx_json_doc_[KEY_AT];
+  if (at_us > esp_timer_get_time() + MaxStartDelayUs) {
+    sendStatusResponse(-1, KEY_MSG, "Execution time too far in the future!");
+    return;
+  }
+  if (schedule_count_ == MaxScheduledCommands || rx_index_ > SchedulePoolSize - schedule_pool_used_) {
+    sendStatusResponse(-1, KEY_MSG, "Schedule full!");
+    return;
+  }
+
+  // Keep the raw request, it is parsed again when due. Equal times keep their arrival order.
+  size_t index = schedule_count_;
+  while (index > 0 && schedule_[index - 1].at_us > at_us) {
+    schedule_[index] = schedule_[index - 1];
+    index--;
+  }
+  schedule_[index] = { at_us, schedule_pool_used_, rx_index_ };
+  memcpy(schedule_pool_ + schedule_pool_used_, rx_buffer_, rx_index_);
+  schedule_pool_used_ += rx_index_;
+  schedule_count_++;
+
+  DEBUG_INFO("CMD: '%s' scheduled at %lld us (%zu pending)", cmd, at_us, schedule_count_);
+  sendStatusResponse(0, "", "");
+}
+
+bool Controller::runBatchPass(size_t count, const size_t offsets[], const size_t lengths[], int results[],
+                              size_t& executed) {
+  batch_msg_[0] = '\0';
+  batch_execution_ = true;
+  for (executed = 0; executed < count;) {
+    DeserializationError error = deserializeJson(rx_json_doc_, batch_pool_ + offsets[executed], lengths[executed]);
+    if (error != DeserializationError::Ok) {
+      results[executed++] = -1;
+      snprintf(batch_msg_, sizeof(batch_msg_), "Deserialize JSON string failed (%s)", error.c_str());
+      break;
+    }
+    batch_status_ = 0;
+    dispatchCommand(rx_json_doc_[KEY_CMD]);
+    results[executed++] = batch_status_;
+    if (batch_status_ != 0) {
+      break;
+    }
+  }
+  batch_execution_ = false;
+  return results[executed - 1] == 0;
+}
+
+bool Controller::isShowPlaying() const {
+  return (batch_validation_ == true) ? batch_show_playing_ : Player::getInstance().isIdle() == false;
+}
+
+void Controller::setBatchShow(const SequenceStep sequence[], size_t count) {
+  batch_step_count_ = (count < MaxSequenceSteps) ? count : MaxSequenceSteps;
+  if (sequence != nullptr && batch_step_count_ > 0) {
+    memcpy(batch_sequence_, sequence, batch_step_count_ * sizeof(SequenceStep));
+  }
+  batch_show_playing_ = true;
+}
+
+bool Controller::isBatchable(const char cmd[]) const {
+  // Commands that answer with a plain status right away, no reads, uploads or flash writes
+  constexpr static const char* BatchableCommands[] = {
+    CMD_SET_BRIGHTNESS, CMD_SET_MASTER, CMD_SET_TWINKLE, CMD_SET_PATTERN, CMD_PLAY,     CMD_STOP,     CMD_QUEUE,
+    CMD_PAUSE,          CMD_RESUME,     CMD_SET_TEMPO,   CMD_SEEK,        CMD_SET_GAIN, CMD_SET_STEP,
+  };
+  if (cmd == nullptr) {
+    return false;
+  }
+  for (size_t i = 0; i < sizeof(BatchableCommands) / sizeof(BatchableCommands[0]); i++) {
+    if (strcmp(cmd, BatchableCommands[i]) == 0) {
+      return true;
+    }
+  }
+  return false;
+}
+
+bool Controller::isReadOnly(const char cmd[]) const {
+  constexpr static const char* ReadOnlyCommands[] = {
+    CMD_GET_VERSION,   CMD_SYNC_TIME,      CMD_GET_STATS,        CMD_GET_TRACE,
+    CMD_GET_SYSTEM_ID, CMD_GET_TOPOLOGY,   CMD_GET_REFRESH_INTERVAL, CMD_GET_CALIBRATION_NAME,
+    CMD_LIST_PROFILES, CMD_GET_BRIGHTNESS, CMD_READ_CALIBRATION,
+  };
+  if (cmd == nullptr) {
+    return true;  // Fails anyway, nothing to protect
+  }
+  for (size_t i = 0; i < sizeof(ReadOnlyCommands) / sizeof(ReadOnlyCommands[0]); i++) {
+    if (strcmp(cmd, ReadOnlyCommands[i]) == 0) {
+      return true;
+    }
+  }
+  return false;
+}
+
+bool Controller::replayResponse(uint32_t request_crc) {
+  for (size_t i = 0; i < MaxCachedResponses; i++) {
+    const CachedResponse& entry = response_cache_[i];
+    if (entry.rid != current_rid_ || entry.request_crc != request_crc ||
+        millis() - entry.time_ms >= CachedResponseLifetimeMs) {
+      continue;
+    }
+
+    Metrics::getInstance().count(Metrics::Counter::RX_DUPLICATES);
+    if (entry.length == 0) {
+      // Still executing, its response answers the retry as well
+      DEBUG_INFO("Request %d is a retry, response pending", current_rid_);
+      return true;
+    }
+    DEBUG_INFO("Request %d is a retry, replay response (%zu)", current_rid_, entry.length);
+    if (BleManager::getInstance().writeData(entry.data, entry.length) == false) {
+      DEBUG_ERROR("Failed to send response via BLE!");
+    }
+    return true;
+  }
+  return false;
+}
+
+void Controller::cacheResponse(const uint8_t data[], size_t length, int status) {
+  // The latest pending entry of the rid, responses of storage jobs arrive after other requests
+  for (size_t i = 1; i <= MaxCachedResponses; i++) {
+    CachedResponse& entry = response_cache_[(response_cache_next_ + MaxCachedResponses - i) % MaxCachedResponses];
+    if (current_rid_ < 0 || entry.rid != current_rid_ || entry.length != 0) {
+      continue;
+    }
+    if (status != 0 || length > CachedResponseSize) {
+      entry.rid = -1;  // A retry executes again, a failed request may succeed then (e.g. storage busy)
+      return;
+    }
+    memcpy(entry.data, data, length);
+    entry.length = length;
+    return;
+  }
+}
+
+int64_t Controller::getWakeUpUs() const {
+  if (rx_ongoing_ == true) {
+    // Completion is signaled by an event, only the timeout needs a wake up
+    uint32_t elapsed_ms = millis() - rx_start_time_;
+    return esp_timer_get_time() + ((elapsed_ms < RxTimeout) ? (RxTimeout - elapsed_ms) * 1000LL : 0);
+  }
+  if (schedule_count_ > 0) {
+    return schedule_[0].at_us;
+  }
+  return EventLoop::WakeUpOnEvent;
+}
+
+void Controller::runSchedule() {
+  int64_t now_us = esp_timer_get_time();
+  while (schedule_count_ > 0 && schedule_[0].at_us <= now_us) {
+    const ScheduledCommand& command = schedule_[0];
+    DeserializationError error = deserializeJson(rx_json_doc_, schedule_pool_ + command.offset, command.length);
+    if (error != DeserializationError::Ok) {
+      DEBUG_ERROR("Scheduled request corrupted (%s)!", error.c_str());
+    } else {
+      current_rid_ = rx_json_doc_[KEY_RID];
+      TRACE(CMD_SCHEDULED, current_rid_);
+      DEBUG_INFO("Execute scheduled request %d (%lld us late)", current_rid_, now_us - command.at_us);
+
+      scheduled_execution_ = true;
+      dispatchCommand(rx_json_doc_[KEY_CMD]);
+      scheduled_execution_ = false;
+    }
+    removeScheduledCommand(0);
+  }
+}
+
+void Controller::removeScheduledCommand(size_t index) {
+  // Compact the pool, so the free space always stays in one piece
+  size_t offset = schedule_[index].offset;
+  size_t length = schedule_[index].length;
+  memmove(schedule_pool_ + offset, schedule_pool_ + offset + length, schedule_pool_used_ - offset - length);
+  schedule_pool_used_ -= length;
+
+  for (size_t i = index; i < schedule_count_ - 1; i++) {
+    schedule_[i] = schedule_[i + 1];
+  }
+  schedule_count_--;
+  for (size_t i = 0; i < schedule_count_; i++) {
+    if (schedule_[i].offset > offset) {
+      schedule_[i].offset -= length;
+    }
+  }
+}
+
+void Controller::handleGetVersion() {
+  DEBUG_INFO("CMD: '%s' [...]", CMD_GET_VERSION);
+
+  sendStatusResponse(0, KEY_VERSION, FIRMWARE_VERSION);
+  DEBUG_INFO("CMD: '%s' [OK]", CMD_GET_VERSION);
+}
+
+void Controller::handleSyncTime() {
+  // NTP-style exchange: the host brackets the request with its own send/receive times and estimates the
+  // offset between both clocks from the device receive (rx_us) and transmit (tx_us) times
+  tx_json_doc_.clear();
+  tx_json_doc_[KEY_RID] = current_rid_;
+  tx_json_doc_[KEY_STATUS] = 0;
+  tx_json_doc_[KEY_RX_US] = rx_time_us_;
+  tx_json_doc_[KEY_TX_US] = esp_timer_get_time();
+  sendResponse();
+}
+
+void Controller::handleGetStats() {
+  DEBUG_INFO("CMD: '%s' [...]", CMD_GET_STATS);
+
+  const Metrics& metrics = Metrics::getInstance();
+  tx_json_doc_.clear();
+  tx_json_doc_[KEY_RID] = current_rid_;
+  tx_json_doc_[KEY_STATUS] = 0;
+  tx_json_doc_[KEY_ELAPSED_MS] = metrics.getElapsedMs();
+  tx_json_doc_[KEY_RX_RATE] = metrics.getRxBytesPerSecond();
+  tx_json_doc_[KEY_RX_PEAK_RATE] = metrics.getRxPeakBytesPerSecond();
+  tx_json_doc_[KEY_RX_LIMIT] = rx_buffer_size_;  // Longest request, decoded length of a packed one
+  tx_json_doc_[KEY_SHOW_LED_LIMIT] = show_led_capacity_;
+
+  JsonObject counters = tx_json_doc_.createNestedObject(KEY_COUNTERS);
+  for (size_t i = 0; i < static_cast<size_t>(Metrics::Counter::COUNT); i++) {
+    Metrics::Counter id = static_cast<Metrics::Counter>(i);
+    counters[Metrics::getCounterName(id)] = metrics.getCounter(id);
+  }
+
+  JsonObject boot = tx_json_doc_.createNestedObject(KEY_BOOT);
+  for (size_t i = 0; i < static_cast<size_t>(Metrics::BootStage::COUNT); i++) {
+    Metrics::BootStage stage = static_cast<Metrics::BootStage>(i);
+    boot[Metrics::getBootStageName(stage)] = metrics.getBootStageUs(stage);
+  }
+
+  // Only histograms with samples, chains beyond the topology never have any
+  JsonObject histograms = tx_json_doc_.createNestedObject(KEY_HISTOGRAMS);
+  for (size_t i = 0; i < static_cast<size_t>(Metrics::Histogram::COUNT); i++) {
+    Metrics::Histogram id = static_cast<Metrics::Histogram>(i);
+    Metrics::HistogramData data;
+    metrics.getHistogram(id, data);
+    if (data.count == 0) {
+      continue;
+    }
+    JsonObject histogram = histograms.createNestedObject(Metrics::getHistogramName(id));
+    histogram[KEY_COUNT] = data.count;
+    histogram[KEY_SUM_US] = data.sum_us;
+    histogram[KEY_MAX_US] = data.max_us;
+    JsonArray buckets = histogram.createNestedArray(KEY_BUCKETS);
+    for (size_t bucket = 0; bucket < Metrics::BucketCount; bucket++) {
+      buckets.add(data.buckets[bucket]);
+    }
+  }
+  sendResponse();
+
+  DEBUG_INFO("CMD: '%s' [OK]", CMD_GET_STATS);
+}
+
+void Controller::handleResetStats() {
+  DEBUG_INFO("CMD: '%s' [...]", CMD_RESET_STATS);
+
+  Metrics::getInstance().reset();
+
+  sendStatusResponse(0, "", "");
+  DEBUG_INFO("CMD: '%s' [OK]", CMD_RESET_STATS);
+}
+
+void Controller::handleGetTrace() {
+  DEBUG_INFO("CMD: '%s' [...]", CMD_GET_TRACE);
+
+#if (ENABLE_TRACE == 1)
+  if (rx_json_doc_.containsKey(KEY_OFFSET) == false) {
+    sendStatusResponse(-1, KEY_MSG, STATUS_MSG_MISSING_KEY, KEY_OFFSET);
+    return;
+  }
+  if (rx_json_doc_.containsKey(KEY_LENGTH) == false) {
+    sendStatusResponse(-1, KEY_MSG, STATUS_MSG_MISSING_KEY, KEY_LENGTH);
+    return;
+  }
+
+  // The ring only grows, a range that is valid now is valid in the snapshot as well
+  Trace& trace = Trace::getInstance();
+  size_t offset = rx_json_doc_[KEY_OFFSET];
+  size_t length = rx_json_doc_[KEY_LENGTH];
+  if (offset > trace.getSize() || length == 0 || length > MaxTraceChunk) {
+    sendStatusResponse(-1, KEY_MSG, "Invalid trace range (offset: %zu, length: %zu)!", offset, length);
+    return;
+  }
+
+  // Recording stays paused until the last page is read, so all pages come from the same snapshot
+  trace.freeze();
+  size_t size = trace.getSize();
+
+  Trace::Record records[MaxTraceChunk];
+  char encoded[(sizeof(records) + 2) / 3 * 4 + 1];
+  size_t encoded_length = 0;
+  size_t count = trace.getRecords(records, offset, length);
+  mbedtls_base64_encode(reinterpret_cast<uint8_t*>(encoded), sizeof(encoded), &encoded_length,
+                        reinterpret_cast<const uint8_t*>(records), count * sizeof(Trace::Record));
+  encoded[encoded_length] = '\0';
+  if (offset + count >= size) {
+    trace.resume();
+  }
+
+  tx_json_doc_.clear();
+  tx_json_doc_[KEY_RID] = current_rid_;
+  tx_json_doc_[KEY_STATUS] = 0;
+  tx_json_doc_[KEY_SIZE] = size;
+  tx_json_doc_[KEY_OFFSET] = offset;
+  tx_json_doc_[KEY_DATA] = encoded;
+  sendResponse();
+
+  DEBUG_INFO("CMD: '%s' [OK]", CMD_GET_TRACE);
+#else
+  sendStatusResponse(-1, KEY_MSG, "Trace disabled!");
+#endif
+}
+
+void Controller::handleGetSystemId() {
+  DEBUG_INFO("CMD: '%s' [...]", CMD_GET_SYSTEM_ID);
+
+  const char* id = getSystemId();
+  ASSERT(id != nullptr);
+
+  sendStatusResponse(0, KEY_SYSTEM_ID, "%s", id);
+  DEBUG_INFO("CMD: '%s' [OK]", CMD_GET_SYSTEM_ID);
+}
+
+void Controller::handleSetSystemId() {
+  DEBUG_INFO("CMD: '%s' [...]", CMD_SET_SYSTEM_ID);
+
+  if (rx_json_doc_.containsKey(KEY_SYSTEM_ID) == false) {
+    sendStatusResponse(-1, KEY_MSG, STATUS_MSG_MISSING_KEY, KEY_SYSTEM_ID);
+    return;
+  }
+
+  const char* name = rx_json_doc_[KEY_SYSTEM_ID];
+  size_t len = strnlen(name, SystemIdMaxLength);
+  if (name == nullptr || len == 0 || len >= SystemIdMaxLength) {
+    sendStatusResponse(-1, KEY_MSG, "Invalid system ID (empty or too long)!");
+    return;
+  }
+
+  setSystemId(name);
+  sendStatusResponse(0, "", "");
+  DEBUG_INFO("CMD: '%s' [OK]", CMD_SET_SYSTEM_ID);
+}
+
+void Controller::handleGetTopology() {
+  DEBUG_INFO("CMD: '%s' [...]", CMD_GET_TOPOLOGY);
+
+  const Topology& topology = getTopology();
+  tx_json_doc_.clear();
+  tx_json_doc_[KEY_RID] = current_rid_;
+  tx_json_doc_[KEY_STATUS] = 0;
+  tx_json_doc_[KEY_CHAINS] = topology.chain_count;
+  tx_json_doc_[KEY_CHAIN_SIZE] = topology.chain_size;
+  JsonArray pins = tx_json_doc_.createNestedArray(KEY_PINS);
+  for (size_t i = 0; i < topology.chain_count; i++) {
+    pins.add(topology.select_pins[i]);
+  }
+  sendResponse();
+
+  DEBUG_INFO("CMD: '%s' [OK]", CMD_GET_TOPOLOGY);
+}
+
+void Controller::handleSetTopology() {
+  DEBUG_INFO("CMD: '%s' [...]", CMD_SET_TOPOLOGY);
+
+  if (rx_json_doc_.containsKey(KEY_CHAINS) == false) {
+    sendStatusResponse(-1, KEY_MSG, STATUS_MSG_MISSING_KEY, KEY_CHAINS);
+    return;
+  }
+  if (rx_json_doc_.containsKey(KEY_CHAIN_SIZE) == false) {
+    sendStatusResponse(-1, KEY_MSG, STATUS_MSG_MISSING_KEY, KEY_CHAIN_SIZE);
+    return;
+  }
+  if (rx_json_doc_.containsKey(KEY_PINS) == false) {
+    sendStatusResponse(-1, KEY_MSG, STATUS_MSG_MISSING_KEY, KEY_PINS);
+    return;
+  }
+
+  // Range checked before narrowing to the uint8_t fields, otherwise e.g. 262 chains would pass as 6
+  int32_t chain_count = rx_json_doc_[KEY_CHAINS];
+  int32_t chain_size = rx_json_doc_[KEY_CHAIN_SIZE];
+  if (chain_count < 1 || chain_count > static_cast<int32_t>(CHAIN_COUNT_MAX) || chain_size < 1 ||
+      chain_size > static_cast<int32_t>(CHAIN_SIZE_MAX)) {
+    sendStatusResponse(-1, KEY_MSG, "Invalid topology (max. %zu chains x %zu boards)!", CHAIN_COUNT_MAX,
+                       CHAIN_SIZE_MAX);
+    return;
+  }
+  if (rx_json_doc_[KEY_PINS].size() != static_cast<size_t>(chain_count)) {
+    sendStatusResponse(-1, KEY_MSG, "Number of pins must match the number of chains!");
+    return;
+  }
+
+  Topology topology = {};
+  topology.chain_count = chain_count;
+  topology.chain_size = chain_size;
+  for (size_t i = 0; i < topology.chain_count; i++) {
+    int32_t pin = rx_json_doc_[KEY_PINS][i];
+    if (pin < 0 || pin > UINT8_MAX) {
+      sendStatusResponse(-1, KEY_MSG, "Invalid select pin (%d)!", pin);
+      return;
+    }
+    topology.select_pins[i] = pin;
+  }
+  if (isTopologyValid(topology) == false) {
+    sendStatusResponse(-1, KEY_MSG, "Invalid select pins (reserved, no output or used twice)!");
+    return;
+  }
+
+  // Buffers are sized at boot, so the new topology only takes effect after a reboot
+  if (setTopology(topology) == false) {
+    sendStatusResponse(-1, KEY_MSG, "Failed to store topology!");
+    return;
+  }
+  sendStatusResponse(0, KEY_MSG, "Reboot to apply the new topology");
+  DEBUG_INFO("CMD: '%s' [OK]", CMD_SET_TOPOLOGY);
+}
+
+void Controller::handleGetRefreshInterval() {
+  DEBUG_INFO("CMD: '%s' [...]", CMD_GET_REFRESH_INTERVAL);
+
+  tx_json_doc_.clear();
+  tx_json_doc_[KEY_RID] = current_rid_;
+  tx_json_doc_[KEY_STATUS] = 0;
+  tx_json_doc_[KEY_INTERVAL_MS] = getRefreshInterval();
+  sendResponse();
+
+  DEBUG_INFO("CMD: '%s' [OK]", CMD_GET_REFRESH_INTERVAL);
+}
+
+void Controller::handleSetRefreshInterval() {
+  DEBUG_INFO("CMD: '%s' [...]", CMD_SET_REFRESH_INTERVAL);
+
+  if (rx_json_doc_.containsKey(KEY_INTERVAL_MS) == false) {
+    sendStatusResponse(-1, KEY_MSG, STATUS_MSG_MISSING_KEY, KEY_INTERVAL_MS);
+    return;
+  }
+
+  uint32_t interval_ms = rx_json_doc_[KEY_INTERVAL_MS];
+  if (interval_ms > RefreshIntervalMaxMs) {
+    sendStatusResponse(-1, KEY_MSG, "Invalid refresh interval (max. %u ms)!", RefreshIntervalMaxMs);
+    return;
+  }
+  if (setRefreshInterval(interval_ms) == false) {
+    sendStatusResponse(-1, KEY_MSG, "Failed to store refresh interval!");
+    return;
+  }
+
+  sendStatusResponse(0, "", "");
+  DEBUG_INFO("CMD: '%s' [OK]", CMD_SET_REFRESH_INTERVAL);
+}
+
+void Controller::handleGetCalibrationName() {
+  DEBUG_INFO("CMD: '%s' [...]", CMD_GET_VERSION);
+
+  const char* name = DaisyChain::getInstance().getCalibrationName();
+  ASSERT(name != nullptr);
+
+  sendStatusResponse(0, KEY_NAME, "%s", name);
+  DEBUG_INFO("CMD: '%s' [OK]", CMD_GET_VERSION);
+}
+
+void Controller::handleDeleteCalibration() {
+  DEBUG_INFO("CMD: '%s' [...]", CMD_DELETE_CALIBRATION);
+
+  if (StorageWorker::getInstance().isBusy() == true) {
+    sendStatusResponse(-1, KEY_MSG, "Storage busy, try again later!");
+    return;
+  }
+
+  DaisyChain::getInstance().clearProfiles();
+  DaisyChain::getInstance().loadDefaultValues();
+  DaisyChain::getInstance().applyIdleValues();
+
+  // Erasing the NVS namespace is done by the storage worker, the response is sent on completion
+  auto job = []() { return DaisyChain::getInstance().deleteCalibrationData(); };
+  if (StorageWorker::getInstance().submit(job, storageCompleteCallback, current_rid_) == false) {
+    sendStatusResponse(-1, KEY_MSG, "Failed to queue storage job!");
+    return;
+  }
+  DEBUG_INFO("CMD: '%s' [QUEUED]", CMD_DELETE_CALIBRATION);
+}
+
+void Controller::handleSaveCalibration() {
+  DEBUG_INFO("CMD: '%s' [...]", CMD_SAVE_CALIBRATION);
+
+  if (rx_json_doc_.containsKey(KEY_NAME) == false) {
+    sendStatusResponse(-1, KEY_MSG, STATUS_MSG_MISSING_KEY, KEY_NAME);
+    return;
+  }
+  if (StorageWorker::getInstance().isBusy() == true) {
+    sendStatusResponse(-1, KEY_MSG, "Storage busy, try again later!");
+    return;
+  }
+
+  const char* name = rx_json_doc_[KEY_NAME];
+  if (DaisyChain::getInstance().stageCalibratedValues(name) == false) {
+    sendStatusResponse(-1, KEY_MSG, "Invalid calibration name!");
+    return;
+  }
+
+  // Writing to flash is done by the storage worker, the response is sent on completion
+  auto job = []() { return DaisyChain::getInstance().saveStagedCalibratedValues(); };
+  if (StorageWorker::getInstance().submit(job, storageCompleteCallback, current_rid_) == false) {
+    sendStatusResponse(-1, KEY_MSG, "Failed to queue storage job!");
+    return;
+  }
+  DEBUG_INFO("CMD: '%s' [QUEUED]", CMD_SAVE_CALIBRATION);
+}
+
+void Controller::handleListProfiles() {
+  DEBUG_INFO("CMD: '%s' [...]", CMD_LIST_PROFILES);
+
+  const char* names[DaisyChain::MaxProfiles];
+  size_t count = DaisyChain::getInstance().getProfileNames(names, DaisyChain::MaxProfiles);
+
+  tx_json_doc_.clear();
+  tx_json_doc_[KEY_RID] = current_rid_;
+  tx_json_doc_[KEY_STATUS] = 0;
+  tx_json_doc_[KEY_NAME] = DaisyChain::getInstance().getCalibrationName();
+  JsonArray profiles = tx_json_doc_.createNestedArray(KEY_PROFILES);
+  for (size_t i = 0; i < count; i++) {
+    profiles.add(names[i]);
+  }
+  sendResponse();
+
+  DEBUG_INFO("CMD: '%s' [OK]", CMD_LIST_PROFILES);
+}
+
+void Controller::handleSaveProfile() {
+  DEBUG_INFO("CMD: '%s' [...]", CMD_SAVE_PROFILE);
+
+  if (rx_json_doc_.containsKey(KEY_NAME) == false) {
+    sendStatusResponse(-1, KEY_MSG, STATUS_MSG_MISSING_KEY, KEY_NAME);
+    return;
+  }
+  if (StorageWorker::getInstance().isBusy() == true) {
+    sendStatusResponse(-1, KEY_MSG, "Storage busy, try again later!");
+    return;
+  }
+
+  const char* name = rx_json_doc_[KEY_NAME];
+  if (DaisyChain::getInstance().stageProfile(name) == false) {
+    sendStatusResponse(-1, KEY_MSG, "Invalid profile name or no free profile slot!");
+    return;
+  }
+
+  // Writing to flash is done by the storage worker, the response is sent on completion
+  auto job = []() { return DaisyChain::getInstance().saveStagedCalibratedValues(); };
+  if (StorageWorker::getInstance().submit(job, storageCompleteCallback, current_rid_) == false) {
+    sendStatusResponse(-1, KEY_MSG, "Failed to queue storage job!");
+    return;
+  }
+  DEBUG_INFO("CMD: '%s' [QUEUED]", CMD_SAVE_PROFILE);
+}
+
+void Controller::handleSelectProfile() {
+  DEBUG_INFO("CMD: '%s' [...]", CMD_SELECT_PROFILE);
+
+  if (rx_json_doc_.containsKey(KEY_NAME) == false) {
+    sendStatusResponse(-1, KEY_MSG, STATUS_MSG_MISSING_KEY, KEY_NAME);
+    return;
+  }
+
+  if (StorageWorker::getInstance().isBusy() == true) {
+    sendStatusResponse(-1, KEY_MSG, "Storage busy, try again later!");
+    return;
+  }
+
+  const char* name = rx_json_doc_[KEY_NAME];
+  uint32_t fade_ms = rx_json_doc_[KEY_FADE_MS] | 0;
+  if (fade_ms > DaisyChain::FadeMaxMs) {
+    sendStatusResponse(-1, KEY_MSG, "Invalid fade time: %u ms (max: %u ms)", fade_ms, DaisyChain::FadeMaxMs);
+    return;
+  }
+  if (DaisyChain::getInstance().selectProfile(name, fade_ms) == false) {
+    sendStatusResponse(-1, KEY_MSG, "Unknown profile: '%s'", name != nullptr ? name : "");
+    return;
+  }
+  if (Player::getInstance().isIdle() == true) {
+    // A running show picks up the new idle values when it returns to idle
+    DaisyChain::getInstance().applyIdleValues();
+  }
+
+  // The switch is immediate, remembering it across reboots is done by the storage worker and the response is sent
+  // on completion
+  auto job = []() { return DaisyChain::getInstance().saveActiveProfile(); };
+  if (StorageWorker::getInstance().submit(job, storageCompleteCallback, current_rid_) == false) {
+    sendStatusResponse(-1, KEY_MSG, "Failed to queue storage job!");
+    return;
+  }
+  DEBUG_INFO("CMD: '%s' [QUEUED]", CMD_SELECT_PROFILE);
+}
+
+void Controller::handleDeleteProfile() {
+  DEBUG_INFO("CMD: '%s' [...]", CMD_DELETE_PROFILE);
+
+  if (rx_json_doc_.containsKey(KEY_NAME) == false) {
+    sendStatusResponse(-1, KEY_MSG, STATUS_MSG_MISSING_KEY, KEY_NAME);
+    return;
+  }
+  if (StorageWorker::getInstance().isBusy() == true) {
+    sendStatusResponse(-1, KEY_MSG, "Storage busy, try again later!");
+    return;
+  }
+
+  const char* name = rx_json_doc_[KEY_NAME];
+  if (DaisyChain::getInstance().deleteProfile(name) == false) {
+    sendStatusResponse(-1, KEY_MSG, "Unknown or active profile: '%s'", name != nullptr ? name : "");
+    return;
+  }
+
+  auto job = []() { return DaisyChain::getInstance().deleteStagedProfile(); };
+  if (StorageWorker::getInstance().submit(job, storageCompleteCallback, current_rid_) == false) {
+    sendStatusResponse(-1, KEY_MSG, "Failed to queue storage job!");
+    return;
+  }
+  DEBUG_INFO("CMD: '%s' [QUEUED]", CMD_DELETE_PROFILE);
+}
+
+void Controller::storageCompleteCallback(bool success, int32_t rid) {
+  Controller& controller = Controller::getInstance();
+  controller.current_rid_ = rid;
+
+  if (success == true) {
+    controller.sendStatusResponse(0, "", "");
+  } else {
+    controller.sendStatusResponse(-1, KEY_MSG, "Storage operation failed!");
+  }
+  DEBUG_INFO("Storage job (rid: %d) completed: %s", rid, success ? "OK" : "FAILED");
+}
+
+void Controller::handleSetBrightness() {
+  DEBUG_INFO("CMD: '%s' [...]", CMD_SET_BRIGHTNESS);
+
+  if (rx_json_doc_.containsKey(KEY_LEDS) == false) {
+    sendStatusResponse(-1, KEY_MSG, STATUS_MSG_MISSING_KEY, KEY_LEDS);
+    return;
+  }
+
+  LedObj obj;
+  JsonArray led;
+  size_t led_count = rx_json_doc_[KEY_LEDS].size();
+  for (size_t i = 0; i < led_count; i++) {
+    led = rx_json_doc_[KEY_LEDS][i];
+    uint8_t pcb_idx = led[0];
+    uint8_t led_idx = led[1];
+    uint8_t brightness = led[2];
+    DEBUG_VERBOSE("  LED(%u, %u) = %u", pcb_idx, led_idx, brightness);
+
+    if (setLedObj(obj, pcb_idx, led_idx, brightness) == false) {
+      sendStatusResponse(-1, KEY_MSG, "Invalid LED object: [%u, %u, %u]", pcb_idx, led_idx, brightness);
+      return;
+    }
+    if (batch_validation_ == false) {
+      DaisyChain::getInstance().setIdleLeds(&obj, 1);
+    }
+  }
+  if (batch_validation_ == true) {
+    return;
+  }
+  DaisyChain::getInstance().applyIdleValues();
+
+  sendStatusResponse(0, "", "");
+  DEBUG_INFO("CMD: '%s' [OK]", CMD_SET_BRIGHTNESS);
+}
+
+void Controller::handleSetMaster() {
+  DEBUG_INFO("CMD: '%s' [...]", CMD_SET_MASTER);
+
+  if (rx_json_doc_.containsKey(KEY_LEVEL) == false) {
+    sendStatusResponse(-1, KEY_MSG, STATUS_MSG_MISSING_KEY, KEY_LEVEL);
+    return;
+  }
+
+  uint32_t level = rx_json_doc_[KEY_LEVEL];
+  if (level > static_cast<uint32_t>(BrgName::MAX)) {
+    sendStatusResponse(-1, KEY_MSG, "Invalid master level: %u", level);
+    return;
+  }
+  if (batch_validation_ == true) {
+    return;
+  }
+  DaisyChain::getInstance().setMasterLevel(level);
+
+  sendStatusResponse(0, "", "");
+  DEBUG_INFO("CMD: '%s' [OK]", CMD_SET_MASTER);
+}
+
+void Controller::handleSetTwinkle() {
+  DEBUG_INFO("CMD: '%s' [...]", CMD_SET_TWINKLE);
+
+  if (rx_json_doc_.containsKey(KEY_DEPTH) == false) {
+    sendStatusResponse(-1, KEY_MSG, STATUS_MSG_MISSING_KEY, KEY_DEPTH);
+    return;
+  }
+
+  uint32_t depth = rx_json_doc_[KEY_DEPTH];
+  uint32_t period_ms = rx_json_doc_[KEY_PERIOD_MS] | Effects::PeriodDefaultMs;
+  uint32_t density = rx_json_doc_[KEY_DENSITY] | Effects::DensityDefault;
+  if (depth > Effects::PercentMax || density > Effects::PercentMax) {
+    sendStatusResponse(-1, KEY_MSG, "Invalid twinkle depth or density (max. %u)!", Effects::PercentMax);
+    return;
+  }
+  if (period_ms < Effects::PeriodMinMs || period_ms > Effects::PeriodMaxMs) {
+    sendStatusResponse(-1, KEY_MSG, "Invalid twinkle period (%u..%u ms)!", Effects::PeriodMinMs, Effects::PeriodMaxMs);
+    return;
+  }
+  if (batch_validation_ == true) {
+    return;
+  }
+  Effects::getInstance().setTwinkle(depth, period_ms, density);
+
+  sendStatusResponse(0, "", "");
+  DEBUG_INFO("CMD: '%s' [OK]", CMD_SET_TWINKLE);
+}
+
+void Controller::handleWriteLayout() {
+  DEBUG_INFO("CMD: '%s' [...]", CMD_WRITE_LAYOUT);
+
+  if (rx_json_doc_.containsKey(KEY_OFFSET) == false) {
+    sendStatusResponse(-1, KEY_MSG, STATUS_MSG_MISSING_KEY, KEY_OFFSET);
+    return;
+  }
+  if (rx_json_doc_.containsKey(KEY_DATA) == false) {
+    sendStatusResponse(-1, KEY_MSG, STATUS_MSG_MISSING_KEY, KEY_DATA);
+    return;
+  }
+  if (rx_json_doc_.containsKey(KEY_CRC) == false) {
+    sendStatusResponse(-1, KEY_MSG, STATUS_MSG_MISSING_KEY, KEY_CRC);
+    return;
+  }
+
+  size_t offset = rx_json_doc_[KEY_OFFSET];
+  const char* data = rx_json_doc_[KEY_DATA];
+  uint32_t crc = rx_json_doc_[KEY_CRC];
+  size_t layout_size = getTopology().ledCount() * Effects::LayoutBytesPerLed;
+  if (offset >= layout_size || data == nullptr) {
+    sendStatusResponse(-1, KEY_MSG, "Invalid layout chunk (offset: %zu)!", offset);
+    return;
+  }
+
+  // Same chunking as the idle map, a corrupted chunk never touches the staging area
+  uint8_t chunk[MaxCalibrationChunk];
+  size_t length = 0;
+  size_t max_length = (layout_size - offset < MaxCalibrationChunk) ? layout_size - offset : MaxCalibrationChunk;
+  int error = mbedtls_base64_decode(chunk, max_length, &length,  //
+                                    reinterpret_cast<const uint8_t*>(data), strlen(data));
+  if (error != 0 || length == 0) {
+    sendStatusResponse(-1, KEY_MSG, "Invalid layout data (error: %d)!", error);
+    return;
+  }
+  if (crc32(chunk, length) != crc) {
+    sendStatusResponse(-1, KEY_MSG, "Layout chunk CRC mismatch!");
+    return;
+  }
+
+  memcpy(layout_blob_ + offset, chunk, length);
+  DEBUG_INFO("  Chunk [%zu, %zu) staged", offset, offset + length);
+
+  sendStatusResponse(0, "", "");
+  DEBUG_INFO("CMD: '%s' [OK]", CMD_WRITE_LAYOUT);
+}
+
+void Controller::handleCommitLayout() {
+  DEBUG_INFO("CMD: '%s' [...]", CMD_COMMIT_LAYOUT);
+
+  if (rx_json_doc_.containsKey(KEY_CRC) == false) {
+    sendStatusResponse(-1, KEY_MSG, STATUS_MSG_MISSING_KEY, KEY_CRC);
+    return;
+  }
+  if (StorageWorker::getInstance().isBusy() == true) {
+    sendStatusResponse(-1, KEY_MSG, "Storage busy, try again later!");
+    return;
+  }
+
+  uint32_t crc = rx_json_doc_[KEY_CRC];
+  size_t layout_size = getTopology().ledCount() * Effects::LayoutBytesPerLed;
+  if (crc32(layout_blob_, layout_size) != crc) {
+    sendStatusResponse(-1, KEY_MSG, "Layout CRC mismatch (incomplete upload?)!");
+    return;
+  }
+  Effects::getInstance().setLayout(layout_blob_);
+
+  // Writing to flash is done by the storage worker, the response is sent on completion
+  auto job = []() { return Effects::getInstance().saveLayout(); };
+  if (StorageWorker::getInstance().submit(job, storageCompleteCallback, current_rid_) == false) {
+    sendStatusResponse(-1, KEY_MSG, "Failed to queue storage job!");
+    return;
+  }
+  DEBUG_INFO("CMD: '%s' [QUEUED]", CMD_COMMIT_LAYOUT);
+}
+
+void Controller::handleSetPattern() {
+  DEBUG_INFO("CMD: '%s' [...]", CMD_SET_PATTERN);
+
+  if (rx_json_doc_.containsKey(KEY_PATTERN) == false) {
+    sendStatusResponse(-1, KEY_MSG, STATUS_MSG_MISSING_KEY, KEY_PATTERN);
+    return;
+  }
+
+  const char* name = rx_json_doc_[KEY_PATTERN];
+  Effects::PatternParams params;
+  if (Effects::findPattern(name, params.pattern) == false) {
+    sendStatusResponse(-1, KEY_MSG, "Unknown pattern: '%s'", name != nullptr ? name : "");
+    return;
+  }
+  uint32_t x = rx_json_doc_[KEY_X] | Effects::PatternCenterDefault;
+  uint32_t y = rx_json_doc_[KEY_Y] | Effects::PatternCenterDefault;
+  uint32_t width = rx_json_doc_[KEY_WIDTH] | Effects::PatternWidthDefault;
+  uint32_t level = rx_json_doc_[KEY_LEVEL] | static_cast<uint32_t>(BrgName::MAX);
+  uint32_t angle_deg = rx_json_doc_[KEY_ANGLE] | 0;
+  if (x > UINT8_MAX || y > UINT8_MAX || width > UINT8_MAX || level > static_cast<uint32_t>(BrgName::MAX) ||
+      angle_deg >= 360) {
+    sendStatusResponse(-1, KEY_MSG, "Invalid pattern center, width, level or angle!");
+    return;
+  }
+  params.x = x;
+  params.y = y;
+  params.width = width;
+  params.level = level;
+  params.angle_deg = angle_deg;
+  params.period_ms = rx_json_doc_[KEY_PERIOD_MS] | Effects::PeriodDefaultMs;
+  params.duration_ms = rx_json_doc_[KEY_DURATION_MS] | 0;
+  if (params.pattern != Effects::Pattern::OFF && Effects::getInstance().hasLayout() == false) {
+    sendStatusResponse(-1, KEY_MSG, "No LED layout stored!");
+    return;
+  }
+  if (Effects::getInstance().isPatternValid(params) == false) {
+    sendStatusResponse(-1, KEY_MSG, "Invalid pattern parameters!");
+    return;
+  }
+  if (batch_validation_ == true) {
+    return;
+  }
+  Effects::getInstance().setPattern(params);
+
+  sendStatusResponse(0, "", "");
+  DEBUG_INFO("CMD: '%s' [OK]", CMD_SET_PATTERN);
+}
+
+void Controller::handleGetBrightness() {
+  DEBUG_INFO("CMD: '%s' [...]", CMD_GET_BRIGHTNESS);
+
+  if (rx_json_doc_.containsKey(KEY_LEDS) == false) {
+    sendStatusResponse(-1, KEY_MSG, STATUS_MSG_MISSING_KEY, KEY_LEDS);
+    return;
+  }
+
+  JsonArray response_leds = tx_json_doc_.createNestedArray(KEY_LEDS);
+  LedObj obj;
+  JsonArray led;
+  size_t led_count = rx_json_doc_[KEY_LEDS].size();
+  for (size_t i = 0; i < led_count; i++) {
+    led = rx_json_doc_[KEY_LEDS][i];
+    uint8_t pcb_idx = led[0];
+    uint8_t led_idx = led[1];
+    DEBUG_VERBOSE("  LED(%u, %u)", pcb_idx, led_idx);
+
+    if (setLedObj(obj, pcb_idx, led_idx, 0) == false) {
+      sendStatusResponse(-1, KEY_MSG, "Invalid LED object: [%u, %u]", pcb_idx, led_idx);
+      return;
+    }
+    DaisyChain::getInstance().getIdleLeds(&obj, 1);
+    JsonArray resp_led = response_leds.createNestedArray();
+    resp_led.add(pcb_idx);
+    resp_led.add(led_idx);
+    resp_led.add(obj.brightness);
+  }
+
+  tx_json_doc_[KEY_RID] = current_rid_;
+  tx_json_doc_[KEY_MSG] = "OK";
+  tx_json_doc_[KEY_STATUS] = 0;
+  sendResponse();
+
+  DEBUG_INFO("CMD: '%s' [OK]", CMD_GET_BRIGHTNESS);
+}
+
+void Controller::handleWriteCalibration() {
+  DEBUG_INFO("CMD: '%s' [...]", CMD_WRITE_CALIBRATION);
+
+  if (rx_json_doc_.containsKey(KEY_OFFSET) == false) {
+    sendStatusResponse(-1, KEY_MSG, STATUS_MSG_MISSING_KEY, KEY_OFFSET);
+    return;
+  }
+  if (rx_json_doc_.containsKey(KEY_DATA) == false) {
+    sendStatusResponse(-1, KEY_MSG, STATUS_MSG_MISSING_KEY, KEY_DATA);
+    return;
+  }
+  if (rx_json_doc_.containsKey(KEY_CRC) == false) {
+    sendStatusResponse(-1, KEY_MSG, STATUS_MSG_MISSING_KEY, KEY_CRC);
+    return;
+  }
+
+  size_t offset = rx_json_doc_[KEY_OFFSET];
+  const char* data = rx_json_doc_[KEY_DATA];
+  uint32_t crc = rx_json_doc_[KEY_CRC];
+  size_t led_count = getTopology().ledCount();
+  if (offset >= led_count || data == nullptr) {
+    sendStatusResponse(-1, KEY_MSG, "Invalid calibration chunk (offset: %zu)!", offset);
+    return;
+  }
+
+  // Decode into a scratch buffer first, so a corrupted chunk never touches the staging area
+  uint8_t chunk[MaxCalibrationChunk];
+  size_t length = 0;
+  size_t max_length = (led_count - offset < MaxCalibrationChunk) ? led_count - offset : MaxCalibrationChunk;
+  int error = mbedtls_base64_decode(chunk, max_length, &length,  //
+                                    reinterpret_cast<const uint8_t*>(data), strlen(data));
+  if (error != 0 || length == 0) {
+    sendStatusResponse(-1, KEY_MSG, "Invalid calibration data (error: %d)!", error);
+    return;
+  }
+  if (crc32(chunk, length) != crc) {
+    sendStatusResponse(-1, KEY_MSG, "Calibration chunk CRC mismatch!");
+    return;
+  }
+
+  memcpy(calibration_blob_ + offset, chunk, length);
+  DEBUG_INFO("  Chunk [%zu, %zu) staged", offset, offset + length);
+
+  sendStatusResponse(0, "", "");
+  DEBUG_INFO("CMD: '%s' [OK]", CMD_WRITE_CALIBRATION);
+}
+
+void Controller::handleCommitCalibration() {
+  DEBUG_INFO("CMD: '%s' [...]", CMD_COMMIT_CALIBRATION);
+
+  if (rx_json_doc_.containsKey(KEY_CRC) == false) {
+    sendStatusResponse(-1, KEY_MSG, STATUS_MSG_MISSING_KEY, KEY_CRC);
+    return;
+  }
+
+  uint32_t crc = rx_json_doc_[KEY_CRC];
+  size_t led_count = getTopology().ledCount();
+  if (crc32(calibration_blob_, led_count) != crc) {
+    sendStatusResponse(-1, KEY_MSG, "Calibration CRC mismatch (incomplete upload?)!");
+    return;
+  }
+  for (size_t i = 0; i < led_count; i++) {
+    if (calibration_blob_[i] > static_cast<BrgNumber>(BrgName::MAX)) {
+      sendStatusResponse(-1, KEY_MSG, "Invalid brightness (%u) at index %zu!", calibration_blob_[i], i);
+      return;
+    }
+  }
+
+  DaisyChain::getInstance().setIdleMap(calibration_blob_);
+  DaisyChain::getInstance().applyIdleValues();
+
+  sendStatusResponse(0, "", "");
+  DEBUG_INFO("CMD: '%s' [OK]", CMD_COMMIT_CALIBRATION);
+}
+
+void Controller::handleReadCalibration() {
+  DEBUG_INFO("CMD: '%s' [...]", CMD_READ_CALIBRATION);
+
+  if (rx_json_doc_.containsKey(KEY_OFFSET) == false) {
+    sendStatusResponse(-1, KEY_MSG, STATUS_MSG_MISSING_KEY, KEY_OFFSET);
+    return;
+  }
+  if (rx_json_doc_.containsKey(KEY_LENGTH) == false) {
+    sendStatusResponse(-1, KEY_MSG, STATUS_MSG_MISSING_KEY, KEY_LENGTH);
+    return;
+  }
+
+  size_t offset = rx_json_doc_[KEY_OFFSET];
+  size_t length = rx_json_doc_[KEY_LENGTH];
+  size_t led_count = getTopology().ledCount();
+  if (offset >= led_count || length == 0 || length > led_count - offset || length > MaxCalibrationChunk) {
+    sendStatusResponse(-1, KEY_MSG, "Invalid calibration range (offset: %zu, length: %zu)!", offset, length);
+    return;
+  }
+
+  uint8_t chunk[MaxCalibrationChunk];
+  char encoded[(MaxCalibrationChunk + 2) / 3 * 4 + 1];
+  size_t encoded_length = 0;
+  DaisyChain::getInstance().getIdleMap(chunk, offset, length);
+  mbedtls_base64_encode(reinterpret_cast<uint8_t*>(encoded), sizeof(encoded), &encoded_length, chunk, length);
+  encoded[encoded_length] = '\0';
+
+  tx_json_doc_.clear();
+  tx_json_doc_[KEY_RID] = current_rid_;
+  tx_json_doc_[KEY_STATUS] = 0;
+  tx_json_doc_[KEY_SIZE] = led_count;
+  tx_json_doc_[KEY_OFFSET] = offset;
+  tx_json_doc_[KEY_DATA] = encoded;
+  tx_json_doc_[KEY_CRC] = crc32(chunk, length);
+  sendResponse();
+
+  DEBUG_INFO("CMD: '%s' [OK]", CMD_READ_CALIBRATION);
+}
+
+void Controller::handlePlayShow() {
+  DEBUG_INFO("CMD: '%s' [...]", CMD_PLAY);
+
+  if (rx_json_doc_.containsKey(KEY_FORCE) == false) {
+    sendStatusResponse(-1, KEY_MSG, STATUS_MSG_MISSING_KEY, KEY_FORCE);
+    return;
+  }
+
+  // Optional absolute start time on the device clock (see 'sync_time'), 0 starts immediately
+  int64_t start_at_us = rx_json_doc_[KEY_START_AT] | static_cast<int64_t>(0);
+  if (start_at_us > esp_timer_get_time() + MaxStartDelayUs) {
+    sendStatusResponse(-1, KEY_MSG, "Start time too far in the future!");
+    return;
+  }
+
+  if (isShowPlaying() == true) {
+    if (rx_json_doc_[KEY_FORCE] == 0) {
+      sendStatusResponse(-1, KEY_MSG, "Another show is already playing!");
+      return;
+    }
+    if (batch_validation_ == false) {
+      DEBUG_INFO("Force stop current show!");
+      Player::getInstance().abort();
+    }
+  }
+
+  // A free bank is not used by the player, so the validation pass may parse into it as well
+  ShowBank* show = getFreeShowBank();
+  if (extractGroups(*show) == false) {
+    return;
+  }
+  if (extractSequence(*show) == false) {
+    return;
   }
-
-  if (rx_index_ + length > RxBufferSize) {
-    DEBUG_ERROR("RX buffer overflow!");
+  if (batch_validation_ == true) {
+    setBatchShow(show->sequence, show->length);
     return;
   }
 
-  memcpy(rx_buffer_ + rx_index_, data, length);
-  rx_index_ += length;
-
-  // Check if string terminator is present
-  if (rx_index_ > 0 && rx_buffer_[rx_index_ - 1] == '\0') {
-    DEBUG_INFO("Full doc (%zu) received: '%.*s'", rx_index_, static_cast<int>(rx_index_), rx_buffer_);
-    process_rx_data_ = true;
-  }
+  Keyframes::getInstance().clear();  // The show takes over from a keyframe stream
+  Player::getInstance().playSequence(show->sequence, show->length, start_at_us);
+  sendStatusResponse(0, "", "");
+  DEBUG_INFO("CMD: '%s' [OK]", CMD_PLAY);
 }
 
-void Controller::run() {
-  if (rx_ongoing_ == true) {
-    // Check if data can be processed
-    if (process_rx_data_ == true) {
-      processReceivedData();
-      rx_index_ = 0;
-      rx_ongoing_ = false;
-      process_rx_data_ = false;
+void Controller::handleStopShow() {
+  DEBUG_INFO("CMD: '%s' [...]", CMD_STOP);
 
-    } else if (millis() - rx_start_time_ >= RxTimeout) {
-      DEBUG_ERROR("RX timeout expired, aborting RX operation!");
-      rx_index_ = 0;
-      rx_ongoing_ = false;
-      process_rx_data_ = false;
-    }
+  if (batch_validation_ == true) {
+    batch_show_playing_ = false;
+    return;
   }
+  Keyframes::getInstance().clear();
+  Player::getInstance().abort();
+
+  sendStatusResponse(0, "", "");
+  DEBUG_INFO("CMD: '%s' [OK]", CMD_STOP);
 }
 
-void Controller::processReceivedData() {
-  if (rx_index_ == 0) {
-    DEBUG_ERROR("No data to process!");
+void Controller::handleQueueShow() {
+  DEBUG_INFO("CMD: '%s' [...]", CMD_QUEUE);
+
+  uint32_t fade_ms = rx_json_doc_[KEY_FADE_MS] | 0;
+  if (fade_ms > DaisyChain::FadeMaxMs) {
+    sendStatusResponse(-1, KEY_MSG, "Invalid fade time: %u ms (max: %u ms)", fade_ms, DaisyChain::FadeMaxMs);
     return;
   }
-  current_rid_ = -1;
 
-  // Parse JSON from the RX buffer
-  DeserializationError error = deserializeJson(rx_json_doc_, rx_buffer_, rx_index_);
-  if (error != DeserializationError::Ok) {
-    sendStatusResponse(-1, KEY_MSG, "Deserialize JSON string failed (%s)", error.c_str());
+  // Parsed while the current show keeps playing, a show queued before is replaced
+  ShowBank* show = getFreeShowBank();
+  if (extractGroups(*show) == false) {
     return;
   }
-
-  // Parse request id
-  if (rx_json_doc_.containsKey(KEY_RID) == false) {
-    sendStatusResponse(-1, KEY_MSG, STATUS_MSG_MISSING_KEY, KEY_RID);
+  if (extractSequence(*show) == false) {
     return;
   }
-  current_rid_ = rx_json_doc_[KEY_RID];
-
-  // Parse the command from the JSON document
-  if (rx_json_doc_.containsKey(KEY_CMD) == false) {
-    sendStatusResponse(-1, KEY_MSG, STATUS_MSG_MISSING_KEY, KEY_CMD);
+  if (batch_validation_ == true) {
+    if (Player::getInstance().isSequenceValid(show->sequence, show->length) == false) {
+      sendStatusResponse(-1, KEY_MSG, "Invalid show!");
+    } else if (batch_show_playing_ == false) {
+      setBatchShow(show->sequence, show->length);  // Nothing playing, the queued show starts right away
+    }
     return;
   }
-  const char* cmd = rx_json_doc_[KEY_CMD];
 
-  if (strcmp(cmd, CMD_GET_VERSION) == 0) {
-    handleGetVersion();
-  } else if (strcmp(cmd, CMD_GET_SYSTEM_ID) == 0) {
-    handleGetSystemId();
-  } else if (strcmp(cmd, CMD_SET_SYSTEM_ID) == 0) {
-    handleSetSystemId();
-  } else if (strcmp(cmd, CMD_GET_CALIBRATION_NAME) == 0) {
-    handleGetCalibrationName();
-  } else if (strcmp(cmd, CMD_DELETE_CALIBRATION) == 0) {
-    handleDeleteCalibration();
-  } else if (strcmp(cmd, CMD_SAVE_CALIBRATION) == 0) {
-    handleSaveCalibration();
-  } else if (strcmp(cmd, CMD_SET_BRIGHTNESS) == 0) {
-    handleSetBrightness();
-  } else if (strcmp(cmd, CMD_GET_BRIGHTNESS) == 0) {
-    handleGetBrightness();
-  } else if (strcmp(cmd, CMD_PLAY) == 0) {
-    handlePlayShow();
-  } else if (strcmp(cmd, CMD_STOP) == 0) {
-    handleStopShow();
-  } else {
-    sendStatusResponse(-1, KEY_MSG, "Unknown '%s': '%s'", KEY_CMD, cmd);
+  if (Player::getInstance().isIdle() == true) {
+    Keyframes::getInstance().clear();
   }
+  if (Player::getInstance().queueSequence(show->sequence, show->length, fade_ms) == false) {
+    sendStatusResponse(-1, KEY_MSG, "Invalid show!");
+    return;
+  }
+  sendStatusResponse(0, "", "");
+  DEBUG_INFO("CMD: '%s' [OK]", CMD_QUEUE);
 }
 
-void Controller::handleGetVersion() {
-  DEBUG_INFO("CMD: '%s' [...]", CMD_GET_VERSION);
+void Controller::handlePauseShow() {
+  DEBUG_INFO("CMD: '%s' [...]", CMD_PAUSE);
 
-  sendStatusResponse(0, KEY_VERSION, FIRMWARE_VERSION);
-  DEBUG_INFO("CMD: '%s' [OK]", CMD_GET_VERSION);
+  if (isShowPlaying() == false) {
+    sendStatusResponse(-1, KEY_MSG, "No show is playing!");
+    return;
+  }
+  if (batch_validation_ == true) {
+    return;
+  }
+  Player::getInstance().pause();
+
+  sendStatusResponse(0, "", "");
+  DEBUG_INFO("CMD: '%s' [OK]", CMD_PAUSE);
 }
 
-void Controller::handleGetSystemId() {
-  DEBUG_INFO("CMD: '%s' [...]", CMD_GET_SYSTEM_ID);
+void Controller::handleResumeShow() {
+  DEBUG_INFO("CMD: '%s' [...]", CMD_RESUME);
 
-  const char* id = getSystemId();
-  ASSERT(id != nullptr);
+  if (batch_validation_ == true) {
+    return;
+  }
+  Player::getInstance().resume();
 
-  sendStatusResponse(0, KEY_SYSTEM_ID, "%s", id);
-  DEBUG_INFO("CMD: '%s' [OK]", CMD_GET_SYSTEM_ID);
+  sendStatusResponse(0, "", "");
+  DEBUG_INFO("CMD: '%s' [OK]", CMD_RESUME);
 }
 
-void Controller::handleSetSystemId() {
-  DEBUG_INFO("CMD: '%s' [...]", CMD_SET_SYSTEM_ID);
+void Controller::handleSetTempo() {
+  DEBUG_INFO("CMD: '%s' [...]", CMD_SET_TEMPO);
 
-  if (rx_json_doc_.containsKey(KEY_SYSTEM_ID) == false) {
-    sendStatusResponse(-1, KEY_MSG, STATUS_MSG_MISSING_KEY, KEY_SYSTEM_ID);
+  if (rx_json_doc_.containsKey(KEY_TEMPO) == false) {
+    sendStatusResponse(-1, KEY_MSG, STATUS_MSG_MISSING_KEY, KEY_TEMPO);
     return;
   }
 
-  const char* name = rx_json_doc_[KEY_SYSTEM_ID];
-  size_t len = strnlen(name, SystemIdMaxLength);
-  if (name == nullptr || len == 0 || len >= SystemIdMaxLength) {
-    sendStatusResponse(-1, KEY_MSG, "Invalid system ID (empty or too long)!");
+  uint32_t tempo = rx_json_doc_[KEY_TEMPO];
+  if (tempo < Player::TempoMinPercent || tempo > Player::TempoMaxPercent) {
+    sendStatusResponse(-1, KEY_MSG, "Invalid tempo: %u", tempo);
+    return;
+  }
+  if (batch_validation_ == true) {
     return;
   }
+  Player::getInstance().setTempo(tempo);
+  DEBUG_INFO("  Tempo %u %%", tempo);
 
-  setSystemId(name);
   sendStatusResponse(0, "", "");
-  DEBUG_INFO("CMD: '%s' [OK]", CMD_SET_SYSTEM_ID);
+  DEBUG_INFO("CMD: '%s' [OK]", CMD_SET_TEMPO);
 }
 
-void Controller::handleGetCalibrationName() {
-  DEBUG_INFO("CMD: '%s' [...]", CMD_GET_VERSION);
-
-  const char* name = DaisyChain::getInstance().getCalibrationName();
-  ASSERT(name != nullptr);
-
-  sendStatusResponse(0, KEY_NAME, "%s", name);
-  DEBUG_INFO("CMD: '%s' [OK]", CMD_GET_VERSION);
-}
+void Controller::handleSeekShow() {
+  DEBUG_INFO("CMD: '%s' [...]", CMD_SEEK);
 
-void Controller::handleDeleteCalibration() {
-  DEBUG_INFO("CMD: '%s' [...]", CMD_DELETE_CALIBRATION);
+  if (rx_json_doc_.containsKey(KEY_POSITION_MS) == false) {
+    sendStatusResponse(-1, KEY_MSG, STATUS_MSG_MISSING_KEY, KEY_POSITION_MS);
+    return;
+  }
 
-  DaisyChain::getInstance().deleteCalibrationData();
-  DaisyChain::getInstance().loadDefaultValues();
-  DaisyChain::getInstance().applyIdleValues();
+  uint32_t position_ms = rx_json_doc_[KEY_POSITION_MS];
+  if (batch_validation_ == true) {
+    uint32_t length_ms = 0;
+    for (size_t i = 0; i < batch_step_count_; i++) {
+      length_ms += Player::getInstance().getStepDuration(batch_sequence_[i]);
+    }
+    if (batch_show_playing_ == false || position_ms >= length_ms) {
+      sendStatusResponse(-1, KEY_MSG, "Can not seek to %u ms!", position_ms);
+    }
+    return;
+  }
+  if (Player::getInstance().seek(position_ms) == false) {
+    sendStatusResponse(-1, KEY_MSG, "Can not seek to %u ms!", position_ms);
+    return;
+  }
 
   sendStatusResponse(0, "", "");
-  DEBUG_INFO("CMD: '%s' [OK]", CMD_DELETE_CALIBRATION);
+  DEBUG_INFO("CMD: '%s' [OK]", CMD_SEEK);
 }
 
-void Controller::handleSaveCalibration() {
-  DEBUG_INFO("CMD: '%s' [...]", CMD_SAVE_CALIBRATION);
+void Controller::handleSetGain() {
+  DEBUG_INFO("CMD: '%s' [...]", CMD_SET_GAIN);
 
-  if (rx_json_doc_.containsKey(KEY_NAME) == false) {
-    sendStatusResponse(-1, KEY_MSG, STATUS_MSG_MISSING_KEY, KEY_NAME);
+  if (rx_json_doc_.containsKey(KEY_GROUP) == false) {
+    sendStatusResponse(-1, KEY_MSG, STATUS_MSG_MISSING_KEY, KEY_GROUP);
+    return;
+  }
+  if (rx_json_doc_.containsKey(KEY_GAIN) == false) {
+    sendStatusResponse(-1, KEY_MSG, STATUS_MSG_MISSING_KEY, KEY_GAIN);
     return;
   }
 
-  const char* name = rx_json_doc_[KEY_NAME];
-  DaisyChain::getInstance().saveCalibratedValues(name);
+  uint32_t group = rx_json_doc_[KEY_GROUP];
+  uint32_t gain = rx_json_doc_[KEY_GAIN];
+  if (group >= MaxLedGroups || gain > Player::GainMaxPercent) {
+    sendStatusResponse(-1, KEY_MSG, "Invalid gain (%u) or group (%u)!", gain, group);
+    return;
+  }
+  if (batch_validation_ == true) {
+    return;
+  }
+  // Applies from the next frame on, the show keeps playing
+  Player::getInstance().setGroupGain(static_cast<uint8_t>(group), static_cast<uint8_t>(gain));
+  DEBUG_INFO("  Group %u: gain %u %%", group, gain);
 
   sendStatusResponse(0, "", "");
-  DEBUG_INFO("CMD: '%s' [OK]", CMD_SAVE_CALIBRATION);
+  DEBUG_INFO("CMD: '%s' [OK]", CMD_SET_GAIN);
 }
 
-void Controller::handleSetBrightness() {
-  DEBUG_INFO("CMD: '%s' [...]", CMD_SET_BRIGHTNESS);
+void Controller::handleSetStep() {
+  DEBUG_INFO("CMD: '%s' [...]", CMD_SET_STEP);
 
-  if (rx_json_doc_.containsKey(KEY_LEDS) == false) {
-    sendStatusResponse(-1, KEY_MSG, STATUS_MSG_MISSING_KEY, KEY_LEDS);
+  if (rx_json_doc_.containsKey(KEY_STEP) == false) {
+    sendStatusResponse(-1, KEY_MSG, STATUS_MSG_MISSING_KEY, KEY_STEP);
+    return;
+  }
+  if (rx_json_doc_.containsKey(KEY_DURATIONS) == false) {
+    sendStatusResponse(-1, KEY_MSG, STATUS_MSG_MISSING_KEY, KEY_DURATIONS);
     return;
   }
 
-  LedObj obj;
-  JsonArray led;
-  size_t led_count = rx_json_doc_[KEY_LEDS].size();
-  for (size_t i = 0; i < led_count; i++) {
-    led = rx_json_doc_[KEY_LEDS][i];
-    uint8_t pcb_idx = led[0];
-    uint8_t led_idx = led[1];
-    uint8_t brightness = led[2];
-    DEBUG_INFO("  LED(%u, %u) = %u", pcb_idx, led_idx, brightness);
-
-    if (setLedObj(obj, pcb_idx, led_idx, brightness) == false) {
-      sendStatusResponse(-1, KEY_MSG, "Invalid LED object: [%u, %u, %u]", pcb_idx, led_idx, brightness);
+  // Same order as in a sequence step: ramp down, pause, ramp up, pulse
+  size_t index = rx_json_doc_[KEY_STEP];
+  JsonArray durations = rx_json_doc_[KEY_DURATIONS];
+  if (durations.size() != 4) {
+    sendStatusResponse(-1, KEY_MSG, "Invalid number of durations: %zu", durations.size());
+    return;
+  }
+  uint32_t ramp_down_ms = durations[0];
+  uint32_t pause_ms = durations[1];
+  uint32_t ramp_up_ms = durations[2];
+  uint32_t pulse_ms = durations[3];
+  if (batch_validation_ == true) {
+    if (batch_show_playing_ == false || index >= batch_step_count_) {
+      sendStatusResponse(-1, KEY_MSG, "Invalid step index (%zu) or no show playing!", index);
       return;
     }
-    DaisyChain::getInstance().setIdleLeds(&obj, 1);
+    // A later seek in the batch sees the new durations
+    batch_sequence_[index].ramp_down_duration_ms = ramp_down_ms;
+    batch_sequence_[index].pause_duration_ms = pause_ms;
+    batch_sequence_[index].ramp_up_duration_ms = ramp_up_ms;
+    batch_sequence_[index].pulse_duration_ms = pulse_ms;
+    return;
   }
-  DaisyChain::getInstance().applyIdleValues();
+  if (Player::getInstance().setStepDurations(index, ramp_down_ms, pause_ms, ramp_up_ms, pulse_ms) == false) {
+    sendStatusResponse(-1, KEY_MSG, "Invalid step index (%zu) or no show playing!", index);
+    return;
+  }
+  DEBUG_INFO("  Step %zu: ramp_down=%ums, pause=%ums, ramp_up=%ums, pulse=%ums", index + 1, ramp_down_ms, pause_ms,
+             ramp_up_ms, pulse_ms);
 
   sendStatusResponse(0, "", "");
-  DEBUG_INFO("CMD: '%s' [OK]", CMD_SET_BRIGHTNESS);
+  DEBUG_INFO("CMD: '%s' [OK]", CMD_SET_STEP);
 }
 
-void Controller::handleGetBrightness() {
-  DEBUG_INFO("CMD: '%s' [...]", CMD_GET_BRIGHTNESS);
+void Controller::handleKeyframe() {
+  DEBUG_VERBOSE("CMD: '%s' [...]", CMD_KEYFRAME);
 
+  if (rx_json_doc_.containsKey(KEY_TIME) == false) {
+    sendStatusResponse(-1, KEY_MSG, STATUS_MSG_MISSING_KEY, KEY_TIME);
+    return;
+  }
   if (rx_json_doc_.containsKey(KEY_LEDS) == false) {
     sendStatusResponse(-1, KEY_MSG, STATUS_MSG_MISSING_KEY, KEY_LEDS);
     return;
   }
+  if (Player::getInstance().isIdle() == false) {
+    sendStatusResponse(-1, KEY_MSG, "A show is playing!");
+    return;
+  }
+
+  // Device time (see 'sync_time') the LEDs reach their values, the host streams ahead of it
+  int64_t time_us = rx_json_doc_[KEY_TIME];
+  if (time_us > esp_timer_get_time() + MaxStartDelayUs) {
+    sendStatusResponse(-1, KEY_MSG, "Keyframe too far in the future!");
+    return;
+  }
+  const char* curve_name = rx_json_doc_[KEY_CURVE] | "linear";
+  Keyframes::Curve curve;
+  if (Keyframes::findCurve(curve_name, curve) == false) {
+    sendStatusResponse(-1, KEY_MSG, "Unknown curve: '%s'", curve_name);
+    return;
+  }
 
-  JsonArray response_leds = tx_json_doc_.createNestedArray(KEY_LEDS);
-  LedObj obj;
-  JsonArray led;
   size_t led_count = rx_json_doc_[KEY_LEDS].size();
+  if (led_count > MaxLedObjects) {
+    sendStatusResponse(-1, KEY_MSG, "Keyframe exceeds max number (%zu) of LED objects!", MaxLedObjects);
+    return;
+  }
+  JsonArray led;
   for (size_t i = 0; i < led_count; i++) {
     led = rx_json_doc_[KEY_LEDS][i];
     uint8_t pcb_idx = led[0];
     uint8_t led_idx = led[1];
-    DEBUG_INFO("  LED(%u, %u)", pcb_idx, led_idx);
-
-    if (setLedObj(obj, pcb_idx, led_idx, 0) == false) {
-      sendStatusResponse(-1, KEY_MSG, "Invalid LED object: [%u, %u]", pcb_idx, led_idx);
+    uint8_t brightness = led[2];
+    if (setLedObj(leds_[i], pcb_idx, led_idx, brightness) == false) {
+      sendStatusResponse(-1, KEY_MSG, "Invalid LED object: [%u, %u, %u]", pcb_idx, led_idx, brightness);
       return;
     }
-    DaisyChain::getInstance().getIdleLeds(&obj, 1);
-    JsonArray resp_led = response_leds.createNestedArray();
-    resp_led.add(pcb_idx);
-    resp_led.add(led_idx);
-    resp_led.add(obj.brightness);
   }
-
-  tx_json_doc_[KEY_RID] = current_rid_;
-  tx_json_doc_[KEY_MSG] = "OK";
-  tx_json_doc_[KEY_STATUS] = 0;
-
-  size_t len = serializeJson(tx_json_doc_, tx_buffer_, TxBufferSize);
-  if (len == 0 || len >= TxBufferSize) {
-    DEBUG_ERROR("Failed to serialize JSON response!");
+  if (Keyframes::getInstance().push(time_us, curve, leds_, led_count) == false) {
+    sendStatusResponse(-1, KEY_MSG, "Keyframe buffer full or out of order!");
     return;
   }
-  tx_buffer_[len] = '\0';  // Ensure null-terminated string
-  len++;                   // Include null terminator in length
 
-  DEBUG_INFO("Sending response (%zu): %s", len, tx_buffer_);
-  if (BleManager::getInstance().writeData(tx_buffer_, len) == false) {
-    DEBUG_ERROR("Failed to send response via BLE!");
-  }
+  // The free slots let the host pace the stream to the lookahead it needs
+  tx_json_doc_.clear();
+  tx_json_doc_[KEY_RID] = current_rid_;
+  tx_json_doc_[KEY_STATUS] = 0;
+  tx_json_doc_[KEY_FREE] = Keyframes::getInstance().getFreeKeyframes();
+  sendResponse();
 
-  DEBUG_INFO("CMD: '%s' [OK]", CMD_GET_BRIGHTNESS);
+  DEBUG_VERBOSE("CMD: '%s' [OK]", CMD_KEYFRAME);
 }
 
-void Controller::handlePlayShow() {
-  DEBUG_INFO("CMD: '%s' [...]", CMD_PLAY);
+void Controller::handleBatch() {
+  DEBUG_INFO("CMD: '%s' [...]", CMD_BATCH);
 
-  if (rx_json_doc_.containsKey(KEY_FORCE) == false) {
-    sendStatusResponse(-1, KEY_MSG, STATUS_MSG_MISSING_KEY, KEY_FORCE);
+  if (rx_json_doc_.containsKey(KEY_CMDS) == false) {
+    sendStatusResponse(-1, KEY_MSG, STATUS_MSG_MISSING_KEY, KEY_CMDS);
     return;
   }
 
-  if (Player::getInstance().isIdle() == false) {
-    if (rx_json_doc_[KEY_FORCE] == 0) {
-      sendStatusResponse(-1, KEY_MSG, "Another show is already playing!");
+  JsonArray cmds = rx_json_doc_[KEY_CMDS];
+  size_t count = cmds.size();
+  if (count == 0 || count > MaxBatchCommands) {
+    sendStatusResponse(-1, KEY_MSG, "Invalid number of batched commands: %zu", count);
+    return;
+  }
+
+  // Check all sub-commands before the first one runs and keep a copy of each, the handlers read their keys from
+  // rx_json_doc_, which is reused for every sub-command
+  size_t offsets[MaxBatchCommands];
+  size_t lengths[MaxBatchCommands];
+  size_t pool_used = 0;
+  for (size_t i = 0; i < count; i++) {
+    JsonObject sub = cmds[i];
+    const char* cmd = sub[KEY_CMD];
+    if (isBatchable(cmd) == false || sub.containsKey(KEY_AT) == true) {
+      sendStatusResponse(-1, KEY_MSG, "Command %zu ('%s') can not be batched!", i + 1, cmd != nullptr ? cmd : "");
+      return;
+    }
+    size_t length = measureJson(sub);
+    if (length >= sizeof(batch_pool_) - pool_used) {
+      sendStatusResponse(-1, KEY_MSG, "Batch too large!");
       return;
     }
-    DEBUG_INFO("Force stop current show!");
-    Player::getInstance().abort();
+    offsets[i] = pool_used;
+    lengths[i] = serializeJson(sub, batch_pool_ + pool_used, sizeof(batch_pool_) - pool_used);
+    pool_used += lengths[i];
   }
 
-  if (extractGroups() == false) {
-    return;
-  }
-  if (extractSequence() == false) {
-    return;
+  // A validation pass first, the sub-commands are only applied if all of them pass. They run within this call,
+  // before the next frame is committed, so their changes appear together.
+  int results[MaxBatchCommands];
+  size_t executed = 0;
+  Player& player = Player::getInstance();
+  bool playing = player.isIdle() == false;
+  setBatchShow(player.getSequence(), playing == true ? player.getStepCount() : 0);
+  batch_show_playing_ = playing;
+  batch_validation_ = true;
+  bool valid = runBatchPass(count, offsets, lengths, results, executed);
+  batch_validation_ = false;
+  if (valid == true) {
+    runBatchPass(count, offsets, lengths, results, executed);
   }
 
-  Player::getInstance().playSequence(sequence_, sequence_length_);
-  sendStatusResponse(0, "", "");
-  DEBUG_INFO("CMD: '%s' [OK]", CMD_PLAY);
-}
-
-void Controller::handleStopShow() {
-  DEBUG_INFO("CMD: '%s' [...]", CMD_STOP);
-
-  Player::getInstance().abort();
+  bool failed = results[executed - 1] != 0;
+  tx_json_doc_.clear();
+  tx_json_doc_[KEY_RID] = current_rid_;
+  tx_json_doc_[KEY_STATUS] = failed ? -1 : 0;
+  JsonArray response_results = tx_json_doc_.createNestedArray(KEY_RESULTS);
+  for (size_t i = 0; i < executed; i++) {
+    response_results.add(results[i]);
+  }
+  if (failed == true) {
+    DEBUG_ERROR("Batched command %zu failed: %s", executed, batch_msg_);
+    tx_json_doc_[KEY_MSG] = batch_msg_;
+  }
+  sendResponse();
 
-  sendStatusResponse(0, "", "");
-  DEBUG_INFO("CMD: '%s' [OK]", CMD_STOP);
+  DEBUG_INFO("CMD: '%s' [%s]", CMD_BATCH, failed ? "FAILED" : "OK");
 }
 
 void Controller::sendStatusResponse(int status, const char key[], const char value[], ...) {
-  char buffer[128];
+  char buffer[StatusMsgMaxLength];
   ASSERT(key != nullptr);
   ASSERT(value != nullptr);
 
@@ -328,13 +1715,33 @@ void Controller::sendStatusResponse(int status, const char key[], const char val
   vsnprintf(buffer, sizeof(buffer), value, args);
   va_end(args);
 
+  if (batch_execution_ == true) {
+    batch_status_ = status;
+    if (status != 0) {
+      snprintf(batch_msg_, sizeof(batch_msg_), "%s", buffer);
+    }
+    return;
+  }
+  if (scheduled_execution_ == true) {
+    if (status != 0) {
+      DEBUG_ERROR("Scheduled request %d failed: %s", current_rid_, buffer);
+    }
+    return;
+  }
+
   tx_json_doc_.clear();
   tx_json_doc_[KEY_RID] = current_rid_;
   tx_json_doc_[KEY_STATUS] = status;
   if (strlen(key) > 0) {
     tx_json_doc_[key] = buffer;
   }
+  sendResponse();
+}
 
+void Controller::sendResponse() {
+  if (scheduled_execution_ == true || batch_execution_ == true) {
+    return;
+  }
   size_t len = serializeJson(tx_json_doc_, tx_buffer_, TxBufferSize);
   if (len == 0 || len >= TxBufferSize) {
     DEBUG_ERROR("Failed to serialize JSON response!");
@@ -344,6 +1751,7 @@ void Controller::sendStatusResponse(int status, const char key[], const char val
   len++;                   // Include null terminator in length
 
   DEBUG_INFO("Sending response (%zu): %s", len, tx_buffer_);
+  cacheResponse(tx_buffer_, len, tx_json_doc_[KEY_STATUS].as<int>());
   if (BleManager::getInstance().writeData(tx_buffer_, len) == false) {
     DEBUG_ERROR("Failed to send response via BLE!");
   }
@@ -353,19 +1761,30 @@ bool Controller::setLedObj(LedObj& obj, uint8_t pcb_idx, uint8_t led_idx, uint8_
   pcb_idx -= 1;  // Convert to zero-based index
   led_idx -= 1;  // Convert to zero-based index
 
-  if (pcb_idx >= (CHAIN_SIZE * CHAIN_COUNT) || led_idx >= LED_COUNT ||  //
+  const Topology& topology = getTopology();
+  if (pcb_idx >= (topology.chain_size * topology.chain_count) || led_idx >= LED_COUNT ||  //
       brightness > static_cast<uint8_t>(BrgName::MAX)) {
     return false;
   }
 
-  obj.chain_idx = static_cast<ChainIdx>(pcb_idx / CHAIN_SIZE);
-  obj.pcb_idx = pcb_idx % CHAIN_SIZE;
+  obj.chain_idx = static_cast<ChainIdx>(pcb_idx / topology.chain_size);
+  obj.pcb_idx = pcb_idx % topology.chain_size;
   obj.led_idx = led_idx;
   obj.brightness = static_cast<BrgNumber>(brightness);
   return true;
 }
 
-bool Controller::extractGroups() {
+Controller::ShowBank* Controller::getFreeShowBank() {
+  // The player holds at most two banks (playing and queued), so one is always free
+  for (size_t i = 0; i < ShowBankCount; i++) {
+    if (Player::getInstance().isSequenceInUse(shows_[i].sequence) == false) {
+      return &shows_[i];
+    }
+  }
+  return &shows_[0];
+}
+
+bool Controller::extractGroups(ShowBank& show) {
   if (rx_json_doc_.containsKey(KEY_GROUPS) == false) {
     sendStatusResponse(-1, KEY_MSG, STATUS_MSG_MISSING_KEY, KEY_GROUPS);
     return false;
@@ -386,12 +1805,12 @@ bool Controller::extractGroups() {
     group = rx_json_doc_[KEY_GROUPS][i];
 
     led_count = group.size();
-    groups_[i].leds = &leds_[led_count_total];
+    groups_[i].leds = &show.leds[led_count_total];
     groups_[i].size = led_count;
 
     led_count_total += led_count;
-    if (led_count_total > MaxLedObjects) {
-      sendStatusResponse(-1, KEY_MSG, "Groups exceed max number (%zu) of LED objects!", MaxLedObjects);
+    if (led_count_total > show_led_capacity_) {
+      sendStatusResponse(-1, KEY_MSG, "Groups exceed max number (%zu) of LED objects!", show_led_capacity_);
       return false;
     }
 
@@ -400,7 +1819,7 @@ bool Controller::extractGroups() {
       led = group[j];
       uint8_t pcb_idx = led[0];
       uint8_t led_idx = led[1];
-      DEBUG_INFO("  Group %d, LED(%u, %u)", i + 1, pcb_idx, led_idx);
+      DEBUG_VERBOSE("  Group %d, LED(%u, %u)", i + 1, pcb_idx, led_idx);
 
       if (setLedObj(groups_[i].leds[j], pcb_idx, led_idx, 0) == false) {
         sendStatusResponse(-1, KEY_MSG, "Invalid LED object in group %zu: [%u, %u]", i + 1, pcb_idx, led_idx);
@@ -411,21 +1830,21 @@ bool Controller::extractGroups() {
   return true;
 }
 
-bool Controller::extractSequence() {
+bool Controller::extractSequence(ShowBank& show) {
   if (rx_json_doc_.containsKey(KEY_SEQUENCE) == false) {
     sendStatusResponse(-1, KEY_MSG, STATUS_MSG_MISSING_KEY, KEY_SEQUENCE);
     return false;
   }
 
-  sequence_length_ = rx_json_doc_[KEY_SEQUENCE].size();
-  if (sequence_length_ == 0 || sequence_length_ > MaxSequenceSteps) {
-    sendStatusResponse(-1, KEY_MSG, "Invalid number of sequence steps: %zu", sequence_length_);
+  show.length = rx_json_doc_[KEY_SEQUENCE].size();
+  if (show.length == 0 || show.length > MaxSequenceSteps) {
+    sendStatusResponse(-1, KEY_MSG, "Invalid number of sequence steps: %zu", show.length);
     return false;
   }
-  DEBUG_INFO("Start parsing %zu sequence steps:", sequence_length_);
+  DEBUG_INFO("Start parsing %zu sequence steps:", show.length);
 
   JsonArray step;
-  for (size_t i = 0; i < sequence_length_; i++) {
+  for (size_t i = 0; i < show.length; i++) {
     step = rx_json_doc_[KEY_SEQUENCE][i];
     size_t group_idx = step[0];
     uint32_t ramp_down_ms = step[1];
@@ -434,23 +1853,29 @@ bool Controller::extractSequence() {
     uint32_t pulse_ms = step[4];
     uint32_t repetitions = step[5];
     bool return_to_idle = step[6] != 0;
+    uint32_t stagger_ms = step[7] | 0;  // Optional, older clients send 7 elements
 
     if (group_idx >= group_count_) {
       sendStatusResponse(-1, KEY_MSG, "Invalid group index (%zu) in sequence step %zu", group_idx, i + 1);
       return false;
     }
 
-    sequence_[i].leds = groups_[group_idx].leds;
-    sequence_[i].size = groups_[group_idx].size;
-    sequence_[i].ramp_down_duration_ms = ramp_down_ms;
-    sequence_[i].pause_duration_ms = pause_ms;
-    sequence_[i].ramp_up_duration_ms = ramp_up_ms;
-    sequence_[i].pulse_duration_ms = pulse_ms;
-    sequence_[i].repetitions = repetitions;
-    sequence_[i].idle_return = return_to_idle;
+    show.sequence[i].leds = groups_[group_idx].leds;
+    show.sequence[i].size = groups_[group_idx].size;
+    show.sequence[i].ramp_down_duration_ms = ramp_down_ms;
+    show.sequence[i].pause_duration_ms = pause_ms;
+    show.sequence[i].ramp_up_duration_ms = ramp_up_ms;
+    show.sequence[i].pulse_duration_ms = pulse_ms;
+    show.sequence[i].repetitions = repetitions;
+    show.sequence[i].idle_return = return_to_idle;
+    show.sequence[i].stagger_ms = stagger_ms;
+    show.sequence[i].group = static_cast<uint8_t>(group_idx);
 
     DEBUG_INFO("  Step %zu: Group %zu, ramp_down=%ums, pause=%ums, ramp_up=%ums, pulse=%ums, reps=%u, return=%u", i + 1,
                group_idx, ramp_down_ms, pause_ms, ramp_up_ms, pulse_ms, repetitions, return_to_idle);
+    if (stagger_ms > 0) {
+      DEBUG_INFO("    stagger=%ums", stagger_ms);
+    }
   }
   return true;
 }
@@ -2,16 +2,39 @@
 #define CONTROLLER_H
 
 #include <ArduinoJson.h>
+#include "Effects.h"
+#include "Lzss.h"
+#include "Player.h"
 #include "common.h"
 
 class Controller {
-  constexpr static uint32_t RxTimeout = 1000;        // Timeout for RX in milliseconds
-  constexpr static size_t RxBufferSize = 1024 * 10;  // Size of the RX buffer
-  constexpr static size_t TxBufferSize = 1024 * 10;  // Size of the TX buffer
+  constexpr static uint32_t RxTimeout = 1000;             // Timeout for RX in milliseconds
+  constexpr static size_t RxBufferSize = 1024 * 10;       // Size of the RX buffer in internal RAM
+  constexpr static size_t RxBufferSizePsram = 1024 * 60;  // Size of the RX buffer if the module has PSRAM
+  constexpr static size_t TxBufferSize = 1024 * 10;       // Size of the TX buffer
 
-  constexpr static size_t MaxLedObjects = 256;    // Maximum number of LED objects in a single command
-  constexpr static size_t MaxLedGroups = 16;      // Maximum number of LED groups in a single command
-  constexpr static size_t MaxSequenceSteps = 16;  // Maximum number of sequence steps in a single command
+  // A packed request starts with a header instead of '{': magic, packed length and decoded length (uint16_t, LE). The
+  // packed bytes follow and decode into the RX buffer as they arrive, the decoded request ends with '\0' as usual.
+  constexpr static uint8_t PackedMagic = 0x1F;
+  constexpr static size_t PackedHeaderSize = 5;
+
+  constexpr static size_t MaxLedObjects = 256;               // Maximum number of LED objects in a single command
+  constexpr static size_t MaxLedGroups = Player::MaxGroups;  // Maximum number of LED groups in a single command
+  constexpr static size_t MaxSequenceSteps = 16;             // Maximum number of sequence steps in a single command
+  constexpr static size_t ShowBankCount = 3;                 // Playing, queued and the one being parsed
+  // LED objects of a show if the module has PSRAM, a show may address every LED of the largest topology
+  constexpr static size_t MaxShowLedObjectsPsram = LED_COUNT_TOTAL_MAX;
+  constexpr static size_t MaxCalibrationChunk = 720;  // Maximum idle map bytes in a single command
+  constexpr static size_t MaxTraceChunk = 60;         // Maximum trace records in a single response
+  constexpr static int64_t MaxStartDelayUs = 10LL * 60 * 1000 * 1000;  // Latest accepted show start (10 min)
+  constexpr static size_t MaxScheduledCommands = 16;     // Maximum number of pending time-stamped commands
+  constexpr static size_t SchedulePoolSize = 1024 * 8;  // Storage for the raw pending requests
+  constexpr static size_t MaxBatchCommands = 16;        // Maximum number of sub-commands in a batch
+  constexpr static size_t StatusMsgMaxLength = 128;
+
+  constexpr static size_t MaxCachedResponses = 8;              // Recent responses kept for retried requests
+  constexpr static size_t CachedResponseSize = 256;            // Larger responses are reads, they are not cached
+  constexpr static uint32_t CachedResponseLifetimeMs = 60000;  // Retries come within seconds
 
   constexpr static char KEY_RID[] = "rid";
   constexpr static char KEY_CMD[] = "cmd";
@@ -24,17 +47,94 @@ class Controller {
   constexpr static char KEY_STATUS[] = "status";
   constexpr static char KEY_VERSION[] = "version";
   constexpr static char KEY_SYSTEM_ID[] = "system_id";
+  constexpr static char KEY_OFFSET[] = "offset";
+  constexpr static char KEY_LENGTH[] = "length";
+  constexpr static char KEY_DATA[] = "data";
+  constexpr static char KEY_CRC[] = "crc";
+  constexpr static char KEY_SIZE[] = "size";
+  constexpr static char KEY_FADE_MS[] = "fade_ms";
+  constexpr static char KEY_PROFILES[] = "profiles";
+  constexpr static char KEY_CHAINS[] = "chains";
+  constexpr static char KEY_CHAIN_SIZE[] = "chain_size";
+  constexpr static char KEY_PINS[] = "pins";
+  constexpr static char KEY_RX_US[] = "rx_us";
+  constexpr static char KEY_TX_US[] = "tx_us";
+  constexpr static char KEY_START_AT[] = "start_at";
+  constexpr static char KEY_AT[] = "at";
+  constexpr static char KEY_LEVEL[] = "level";
+  constexpr static char KEY_ELAPSED_MS[] = "elapsed_ms";
+  constexpr static char KEY_COUNTERS[] = "counters";
+  constexpr static char KEY_HISTOGRAMS[] = "histograms";
+  constexpr static char KEY_RX_RATE[] = "rx_bytes_per_s";
+  constexpr static char KEY_RX_PEAK_RATE[] = "rx_peak_bytes_per_s";
+  constexpr static char KEY_RX_LIMIT[] = "rx_limit";
+  constexpr static char KEY_SHOW_LED_LIMIT[] = "show_led_limit";
+  constexpr static char KEY_COUNT[] = "count";
+  constexpr static char KEY_SUM_US[] = "sum_us";
+  constexpr static char KEY_MAX_US[] = "max_us";
+  constexpr static char KEY_BUCKETS[] = "buckets";
+  constexpr static char KEY_BOOT[] = "boot";
+  constexpr static char KEY_INTERVAL_MS[] = "interval_ms";
+  constexpr static char KEY_DEPTH[] = "depth";
+  constexpr static char KEY_PERIOD_MS[] = "period_ms";
+  constexpr static char KEY_DENSITY[] = "density";
+  constexpr static char KEY_PATTERN[] = "pattern";
+  constexpr static char KEY_X[] = "x";
+  constexpr static char KEY_Y[] = "y";
+  constexpr static char KEY_ANGLE[] = "angle";
+  constexpr static char KEY_WIDTH[] = "width";
+  constexpr static char KEY_DURATION_MS[] = "duration_ms";
+  constexpr static char KEY_TIME[] = "time";
+  constexpr static char KEY_CURVE[] = "curve";
+  constexpr static char KEY_FREE[] = "free";
+  constexpr static char KEY_TEMPO[] = "tempo";
+  constexpr static char KEY_POSITION_MS[] = "position_ms";
+  constexpr static char KEY_GROUP[] = "group";
+  constexpr static char KEY_GAIN[] = "gain";
+  constexpr static char KEY_STEP[] = "step";
+  constexpr static char KEY_DURATIONS[] = "durations";
+  constexpr static char KEY_CMDS[] = "cmds";
+  constexpr static char KEY_RESULTS[] = "results";
 
   constexpr static char CMD_GET_VERSION[] = "get_version";
+  constexpr static char CMD_SYNC_TIME[] = "sync_time";
+  constexpr static char CMD_GET_STATS[] = "get_stats";
+  constexpr static char CMD_RESET_STATS[] = "reset_stats";
+  constexpr static char CMD_GET_TRACE[] = "get_trace";
   constexpr static char CMD_GET_SYSTEM_ID[] = "get_system_id";
   constexpr static char CMD_SET_SYSTEM_ID[] = "set_system_id";
+  constexpr static char CMD_GET_TOPOLOGY[] = "get_topology";
+  constexpr static char CMD_SET_TOPOLOGY[] = "set_topology";
+  constexpr static char CMD_GET_REFRESH_INTERVAL[] = "get_refresh_interval";
+  constexpr static char CMD_SET_REFRESH_INTERVAL[] = "set_refresh_interval";
   constexpr static char CMD_GET_CALIBRATION_NAME[] = "get_calibration_name";
   constexpr static char CMD_DELETE_CALIBRATION[] = "delete_calibration";
   constexpr static char CMD_SAVE_CALIBRATION[] = "save_calibration";
+  constexpr static char CMD_LIST_PROFILES[] = "list_profiles";
+  constexpr static char CMD_SAVE_PROFILE[] = "save_profile";
+  constexpr static char CMD_SELECT_PROFILE[] = "select_profile";
+  constexpr static char CMD_DELETE_PROFILE[] = "delete_profile";
   constexpr static char CMD_SET_BRIGHTNESS[] = "set_brightness";
   constexpr static char CMD_GET_BRIGHTNESS[] = "get_brightness";
+  constexpr static char CMD_SET_MASTER[] = "set_master";
+  constexpr static char CMD_SET_TWINKLE[] = "set_twinkle";
+  constexpr static char CMD_WRITE_LAYOUT[] = "write_layout";
+  constexpr static char CMD_COMMIT_LAYOUT[] = "commit_layout";
+  constexpr static char CMD_SET_PATTERN[] = "set_pattern";
+  constexpr static char CMD_WRITE_CALIBRATION[] = "write_calibration";
+  constexpr static char CMD_COMMIT_CALIBRATION[] = "commit_calibration";
+  constexpr static char CMD_READ_CALIBRATION[] = "read_calibration";
   constexpr static char CMD_PLAY[] = "play_show";
   constexpr static char CMD_STOP[] = "stop_show";
+  constexpr static char CMD_QUEUE[] = "queue_show";
+  constexpr static char CMD_PAUSE[] = "pause_show";
+  constexpr static char CMD_RESUME[] = "resume_show";
+  constexpr static char CMD_SET_TEMPO[] = "set_tempo";
+  constexpr static char CMD_SEEK[] = "seek_show";
+  constexpr static char CMD_SET_GAIN[] = "set_gain";
+  constexpr static char CMD_SET_STEP[] = "set_step";
+  constexpr static char CMD_BATCH[] = "batch";
+  constexpr static char CMD_KEYFRAME[] = "keyframe";
 
   constexpr static char STATUS_MSG_MISSING_KEY[] = "JSON key ('%s') not found!";
 
@@ -50,50 +150,160 @@ class Controller {
   void initialize();
   void dataReceivedCallback(const uint8_t data[], size_t length);
   void run();
+  int64_t getWakeUpUs() const;  // Next time run() has work to do (see EventLoop::wait)
 
  private:
   struct GroupInfo {
     LedObj* leds;
     size_t size;
   };
+  struct ShowBank {
+    LedObj* leds;  // All groups are in this array (the start of each group is pointed to by groups_[])
+    SequenceStep sequence[MaxSequenceSteps];
+    size_t length;
+  };
+  struct CachedResponse {
+    int32_t rid;           // -1 if the slot is free
+    uint32_t request_crc;  // A reused rid with another request is a new request
+    uint32_t time_ms;      // Reception of the request
+    size_t length;         // 0 while the response is pending (e.g. a storage job)
+    uint8_t data[CachedResponseSize];
+  };
+  // Request document allocator, a large request does not fit into what the internal heap has left
+  struct RxJsonAllocator : ArduinoJson::Allocator {
+    void* allocate(size_t size) override;
+    void deallocate(void* pointer) override;
+    void* reallocate(void* pointer, size_t new_size) override;
+  };
+  struct ScheduledCommand {
+    int64_t at_us;  // Device time (esp_timer) the command is executed at
+    size_t offset;  // Start of the raw request in schedule_pool_
+    size_t length;
+  };
   Controller() = default;
 
+  void allocateBuffers();
+  void receivePacked(const uint8_t data[], size_t length);
   void processReceivedData();
+  void dispatchCommand(const char cmd[]);
+  void scheduleCommand(const char cmd[]);
+  bool isBatchable(const char cmd[]) const;
+  bool runBatchPass(size_t count, const size_t offsets[], const size_t lengths[], int results[], size_t& executed);
+  bool isShowPlaying() const;
+  void setBatchShow(const SequenceStep sequence[], size_t count);
+  bool isReadOnly(const char cmd[]) const;
+  bool replayResponse(uint32_t request_crc);
+  void cacheResponse(const uint8_t data[], size_t length, int status);
+  void runSchedule();
+  void removeScheduledCommand(size_t index);
 
   void handleGetVersion();
+  void handleSyncTime();
+  void handleGetStats();
+  void handleResetStats();
+  void handleGetTrace();
   void handleGetSystemId();
   void handleSetSystemId();
+  void handleGetTopology();
+  void handleSetTopology();
+  void handleGetRefreshInterval();
+  void handleSetRefreshInterval();
   void handleGetCalibrationName();
   void handleDeleteCalibration();
   void handleSaveCalibration();
+  void handleListProfiles();
+  void handleSaveProfile();
+  void handleSelectProfile();
+  void handleDeleteProfile();
   void handleSetBrightness();
   void handleGetBrightness();
+  void handleSetMaster();
+  void handleSetTwinkle();
+  void handleWriteLayout();
+  void handleCommitLayout();
+  void handleSetPattern();
+  void handleWriteCalibration();
+  void handleCommitCalibration();
+  void handleReadCalibration();
 
   void handlePlayShow();
   void handleStopShow();
+  void handleQueueShow();
+  void handlePauseShow();
+  void handleResumeShow();
+  void handleSetTempo();
+  void handleSeekShow();
+  void handleSetGain();
+  void handleSetStep();
+  void handleKeyframe();
+  void handleBatch();
 
+  static void storageCompleteCallback(bool success, int32_t rid);
   void sendStatusResponse(int status, const char key[], const char value[], ...);
+  void sendResponse();
   bool setLedObj(LedObj& obj, uint8_t pcb_idx, uint8_t led_idx, uint8_t brightness);
-  bool extractGroups();
-  bool extractSequence();
+  ShowBank* getFreeShowBank();
+  bool extractGroups(ShowBank& show);
+  bool extractSequence(ShowBank& show);
 
-  uint8_t rx_buffer_[RxBufferSize];
+  // Decoded requests are limited by the 16 bit length of the packed header, so larger requests need PSRAM
+  uint8_t* rx_buffer_ = nullptr;
+  size_t rx_buffer_size_ = 0;
   uint8_t tx_buffer_[TxBufferSize];
   size_t rx_index_ = 0;  // Current index in RX buffer
 
   uint32_t rx_start_time_ = 0;  // Start time for RX buffer
+  int64_t rx_time_us_ = 0;      // Device time when the first chunk of the current request arrived
   bool rx_ongoing_ = false;     // Flag to indicate if RX is ongoing
   bool process_rx_data_ = false;
 
-  StaticJsonDocument<2 * RxBufferSize> rx_json_doc_;
+  bool rx_packed_ = false;               // The current request is packed, see PackedMagic
+  uint8_t rx_header_[PackedHeaderSize];  // Header of a packed request, it may be split between chunks
+  size_t rx_header_length_ = 0;
+  size_t rx_packed_remaining_ = 0;  // Packed bytes still to be received
+  size_t rx_unpacked_length_ = 0;   // Decoded length announced by the header
+  bool rx_packed_failed_ = false;   // Corrupt request, the rest is dropped until the RX timeout
+  LzssDecoder rx_decoder_;
+
+  RxJsonAllocator rx_json_allocator_;
+  JsonDocument rx_json_doc_{ &rx_json_allocator_ };
   StaticJsonDocument<2 * TxBufferSize> tx_json_doc_;
 
-  LedObj leds_[MaxLedObjects];  // All groups are in this array (the start of each group is pointed to by groups_[])
+  LedObj leds_[MaxLedObjects];
   GroupInfo groups_[MaxLedGroups];
   size_t group_count_ = 0;
 
-  SequenceStep sequence_[MaxSequenceSteps];
-  size_t sequence_length_ = 0;
+  // A show is parsed into a bank the player does not use, so the next one can be prepared while another plays
+  ShowBank shows_[ShowBankCount];
+  size_t show_led_capacity_ = 0;  // LED objects of each bank
+
+  BrgNumber calibration_blob_[LED_COUNT_TOTAL_MAX];                        // Staging area for chunked idle map uploads
+  uint8_t layout_blob_[LED_COUNT_TOTAL_MAX * Effects::LayoutBytesPerLed];  // Staging area for LED layout uploads
+
+  // Time-ordered queue of pending time-stamped commands, drained by run() before the next frame is committed
+  ScheduledCommand schedule_[MaxScheduledCommands];
+  size_t schedule_count_ = 0;
+  uint8_t schedule_pool_[SchedulePoolSize];
+  size_t schedule_pool_used_ = 0;
+  bool scheduled_execution_ = false;  // The request was acknowledged when queued, so responses are suppressed
+
+  // Sub-commands of a batch, serialized one after the other and parsed again one by one when executed
+  char batch_pool_[RxBufferSize];
+  bool batch_execution_ = false;  // Responses of sub-commands are collected into the batch response
+  int batch_status_ = 0;          // Status of the last sub-command
+  char batch_msg_[StatusMsgMaxLength] = "";
+
+  // Validation pass of a batch, the handlers check their arguments and return before applying anything. Show
+  // commands check against the show the preceding sub-commands leave playing, a copy set_step may change.
+  bool batch_validation_ = false;
+  bool batch_show_playing_ = false;
+  SequenceStep batch_sequence_[MaxSequenceSteps];
+  size_t batch_step_count_ = 0;
+
+  // Successful responses of recent requests by rid and request CRC, a retried request gets its response again
+  // instead of being executed twice (e.g. after a lost indication). A failed request is executed again.
+  CachedResponse response_cache_[MaxCachedResponses];
+  size_t response_cache_next_ = 0;  // Oldest slot, overwritten next
 
   int32_t current_rid_ = -1;
 };
@@ -1,14 +1,21 @@
 #include "DaisyChain.h"
 #include <Preferences.h>
+#include "Effects.h"
+#include "EventLoop.h"
+#include "Metrics.h"
+#include "Trace.h"
 
-#define DEBUG_ENABLE_DAISYCHAIN 1
-#if ((DEBUG_ENABLE_DAISYCHAIN == 1) && (ENABLE_DEBUG_OUTPUT == 1))
-#define DEBUG_INFO(f, ...) debugPrint("[INF][Chain]", f, ##__VA_ARGS__)
+#define LOG_LEVEL_DAISYCHAIN LOG_LEVEL_INFO
+#if ((LOG_LEVEL_DAISYCHAIN >= LOG_LEVEL_ERROR) && (ENABLE_DEBUG_OUTPUT == 1))
 #define DEBUG_ERROR(f, ...) debugPrint("[ERR][Chain]", f, ##__VA_ARGS__)
 #else
-#define DEBUG_INFO(...)
 #define DEBUG_ERROR(...)
 #endif
+#if ((LOG_LEVEL_DAISYCHAIN >= LOG_LEVEL_INFO) && (ENABLE_DEBUG_OUTPUT == 1))
+#define DEBUG_INFO(f, ...) debugPrint("[INF][Chain]", f, ##__VA_ARGS__)
+#else
+#define DEBUG_INFO(...)
+#endif
 
 DaisyChain::DaisyChain() {
 #if (DISABLE_HARDWARE == 0)
@@ -34,23 +41,15 @@ DaisyChain::DaisyChain() {
 
 void DaisyChain::initialize() {
   DEBUG_INFO("Initialize DaisyChain [...]");
+  allocateBuffers();
 #if (DISABLE_HARDWARE == 0)
-  pinMode(Chain0SelectPin, OUTPUT);
-  pinMode(Chain1SelectPin, OUTPUT);
-  pinMode(Chain2SelectPin, OUTPUT);
-  pinMode(Chain3SelectPin, OUTPUT);
-  pinMode(Chain4SelectPin, OUTPUT);
-  pinMode(Chain5SelectPin, OUTPUT);
-
-  // Selecta all chains for simultaneous init
-  digitalWrite(Chain0SelectPin, HIGH);
-  digitalWrite(Chain1SelectPin, HIGH);
-  digitalWrite(Chain2SelectPin, HIGH);
-  digitalWrite(Chain3SelectPin, HIGH);
-  digitalWrite(Chain4SelectPin, HIGH);
-  digitalWrite(Chain5SelectPin, HIGH);
+  // Select all chains for simultaneous init
+  for (size_t chain = 0; chain < topology_.chain_count; chain++) {
+    pinMode(topology_.select_pins[chain], OUTPUT);
+    digitalWrite(topology_.select_pins[chain], HIGH);
+  }
 #endif
-  chain_.init();
+  chain_.init(topology_.chain_size);
   writeData();
 
   if (loadCalibratedValues() == false) {
@@ -58,255 +57,535 @@ void DaisyChain::initialize() {
     loadDefaultValues();
   }
   applyIdleValues();
+  commitFrame();
 
   flushAll();
   DEBUG_INFO("Initialize DaisyChain [OK]");
 }
 
+void DaisyChain::allocateBuffers() {
+  // The topology is fixed for the lifetime of the firmware, so all buffers are sized exactly once
+  topology_ = getTopology();
+  led_count_ = topology_.ledCount();
+  chain_stride_ = topology_.chain_size * LED_COUNT;
+  record_size_ = sizeof(CalibrationHeader) + led_count_ + sizeof(uint32_t);
+
+  active_brightness_ = new BrgNumber[led_count_]();
+  frame_brightness_ = new BrgNumber[led_count_]();
+  idle_brightness_ = new BrgNumber[led_count_]();
+  fade_from_ = new BrgNumber[led_count_]();
+  for (size_t slot = 0; slot < MaxProfiles; slot++) {
+    profiles_[slot] = new uint8_t[record_size_]();
+  }
+  staged_record_ = new uint8_t[record_size_]();
+  Effects::getInstance().initialize(led_count_);
+  DEBUG_INFO("  %u chains x %u boards (%zu LEDs)", topology_.chain_count, topology_.chain_size, led_count_);
+}
+
 bool DaisyChain::loadCalibratedValues() {
-  /* NVS storage layout:
+  /* NVS storage layout (format version 2):
    * "calibration" namespace:
-   * - "format_version" (uint8_t)
-   * - "calib_name" (string)
-   * - "calib_chain0" (uint8_t[CHAIN_SIZE][LED_COUNT])
-   * - "calib_chain1" (uint8_t[CHAIN_SIZE][LED_COUNT])
-   * - "calib_chain2" (uint8_t[CHAIN_SIZE][LED_COUNT])
-   * - "calib_chain3" (uint8_t[CHAIN_SIZE][LED_COUNT])
-   * - "calib_chain4" (uint8_t[CHAIN_SIZE][LED_COUNT])
-   * - "calib_chain5" (uint8_t[CHAIN_SIZE][LED_COUNT])
+   * - "calib_p0" ... "calib_p3" (CalibrationHeader, idle values of all chains, CRC-32)
+   * - "calib_active" (uint8_t, index of the active profile)
    */
   Preferences preferences;
   preferences.begin("calibration", false);  // open (create if needed) the namespace in RW mode
 
-  if (preferences.isKey("format_version") == false) {
-    preferences.end();
+  bool legacy = preferences.isKey("format_version");
+  uint8_t legacy_version = preferences.getUChar("format_version");
+  preferences.end();
+  if (legacy == true) {
+    DEBUG_INFO("Legacy calibration format (%u) found, migrating data ...", legacy_version);
+    if (migrateCalibrationData(legacy_version) == false) {
+      return false;
+    }
+  }
+
+  preferences.begin("calibration", true);
+  for (size_t slot = 0; slot < MaxProfiles; slot++) {
+    char key[ProfileKeyLength];
+    getProfileKey(slot, key);
+    profile_valid_[slot] = false;
+    persisted_crc_[slot] = 0;
+
+    if (preferences.isKey(key) == false) {
+      continue;
+    }
+    uint8_t* record = profiles_[slot];
+    const CalibrationHeader* header = getRecordHeader(record);
+    size_t length = preferences.getBytes(key, record, record_size_);
+    if (length != record_size_ || header->format_version != CalibrationFormatVersion) {
+      DEBUG_ERROR("Calibration profile %zu has unsupported format!", slot);
+      continue;
+    }
+    if (header->chain_count != topology_.chain_count || header->chain_size != topology_.chain_size) {
+      DEBUG_ERROR("Calibration profile %zu belongs to another topology!", slot);
+      continue;
+    }
+    uint32_t crc = getRecordCrc(record);
+    if (crc32(record, record_size_ - sizeof(crc)) != crc) {
+      DEBUG_ERROR("Calibration profile %zu CRC mismatch!", slot);
+      continue;
+    }
+    profile_valid_[slot] = true;
+    persisted_crc_[slot] = crc;
+    DEBUG_INFO("Calibration profile %zu: '%s'", slot, header->name);
+  }
+  active_profile_ = preferences.getUChar("calib_active", 0);
+  preferences.end();
+
+  if (active_profile_ >= MaxProfiles || profile_valid_[active_profile_] == false) {
+    active_profile_ = 0;
+    while (active_profile_ < MaxProfiles && profile_valid_[active_profile_] == false) {
+      active_profile_++;
+    }
+    if (active_profile_ == MaxProfiles) {
+      active_profile_ = 0;
+      return false;
+    }
+  }
+
+  restoreCalibrationRecord(profiles_[active_profile_]);
+  DEBUG_INFO("Calibration '%s' loaded [OK]", calibration_name_);
+  return true;
+}
+
+bool DaisyChain::migrateCalibrationData(uint8_t from_version) {
+  if (from_version != 0) {
+    DEBUG_ERROR("No migration path from calibration format version %u!", from_version);
     return false;
   }
-  uint8_t format_version = preferences.getUChar("format_version");
-  if (format_version != CalibrationFormatVersion) {
-    preferences.end();
-    DEBUG_INFO("Calibration format version mismatch, migrating data ...");
-    return migrateCalibrationData(format_version);
-  }
-
-  // Check if all keys are present
-  if (preferences.isKey("calib_name") == false ||    //
-      preferences.isKey("calib_chain0") == false ||  //
-      preferences.isKey("calib_chain1") == false ||  //
-      preferences.isKey("calib_chain2") == false ||  //
-      preferences.isKey("calib_chain3") == false ||  //
-      preferences.isKey("calib_chain4") == false ||  //
-      preferences.isKey("calib_chain5") == false) {
+
+  /* Legacy NVS storage layout (format version 0), always six chains of ten boards:
+   * "calibration" namespace:
+   * - "format_version" (uint8_t)
+   * - "calib_name" (string)
+   * - "calib_chain0" ... "calib_chain5" (uint8_t[10][LED_COUNT])
+   */
+  constexpr static size_t LegacyChainCount = 6;
+  constexpr static size_t LegacyChainSize = 10;
+  constexpr static const char* LegacyChainKeys[LegacyChainCount] = {
+    "calib_chain0", "calib_chain1", "calib_chain2", "calib_chain3", "calib_chain4", "calib_chain5",
+  };
+
+  if (topology_.chain_count != LegacyChainCount || topology_.chain_size != LegacyChainSize) {
+    DEBUG_ERROR("Legacy calibration data does not match the topology!");
+    return false;
+  }
+
+  Preferences preferences;
+  preferences.begin("calibration", false);  // open (create if needed) the namespace in RW mode
+
+  if (preferences.isKey("calib_name") == false) {
     preferences.end();
     DEBUG_ERROR("Calibration data incomplete!");
     return false;
   }
+  for (size_t chain = 0; chain < LegacyChainCount; chain++) {
+    if (preferences.getBytesLength(LegacyChainKeys[chain]) != chain_stride_) {
+      preferences.end();
+      DEBUG_ERROR("Calibration data incomplete!");
+      return false;
+    }
+  }
 
   preferences.getString("calib_name", calibration_name_, CalibrationNameMaxLength);
+  for (size_t chain = 0; chain < LegacyChainCount; chain++) {
+    preferences.getBytes(LegacyChainKeys[chain], idle_brightness_ + chain * chain_stride_, chain_stride_);
+  }
 
-  size_t length0 = preferences.getBytesLength("calib_chain0");
-  size_t length1 = preferences.getBytesLength("calib_chain1");
-  size_t length2 = preferences.getBytesLength("calib_chain2");
-  size_t length3 = preferences.getBytesLength("calib_chain3");
-  size_t length4 = preferences.getBytesLength("calib_chain4");
-  size_t length5 = preferences.getBytesLength("calib_chain5");
-
-  if (length0 != sizeof(idle_brightness0_) ||  //
-      length1 != sizeof(idle_brightness1_) ||  //
-      length2 != sizeof(idle_brightness2_) ||  //
-      length3 != sizeof(idle_brightness3_) ||  //
-      length4 != sizeof(idle_brightness4_) ||  //
-      length5 != sizeof(idle_brightness5_)) {
+  // Replace the legacy keys by the first profile record, so the next boot needs no migration. The legacy keys are
+  // only removed once the record is stored, until then the next boot migrates again.
+  char key[ProfileKeyLength];
+  getProfileKey(0, key);
+  uint8_t* record = profiles_[0];
+  buildCalibrationRecord(record);
+  if (preferences.putBytes(key, record, record_size_) != record_size_ ||
+      preferences.getBytes(key, staged_record_, record_size_) != record_size_ ||
+      memcmp(staged_record_, record, record_size_) != 0) {
     preferences.end();
+    DEBUG_ERROR("Failed to write migrated calibration record!");
     return false;
   }
-
-  preferences.getBytes("calib_chain0", idle_brightness0_, sizeof(idle_brightness0_));
-  preferences.getBytes("calib_chain1", idle_brightness1_, sizeof(idle_brightness1_));
-  preferences.getBytes("calib_chain2", idle_brightness2_, sizeof(idle_brightness2_));
-  preferences.getBytes("calib_chain3", idle_brightness3_, sizeof(idle_brightness3_));
-  preferences.getBytes("calib_chain4", idle_brightness4_, sizeof(idle_brightness4_));
-  preferences.getBytes("calib_chain5", idle_brightness5_, sizeof(idle_brightness5_));
-
+  preferences.putUChar("calib_active", 0);
+  preferences.remove("format_version");  // First, a partly removed legacy record must not be migrated again
+  preferences.remove("calib_name");
+  for (size_t chain = 0; chain < LegacyChainCount; chain++) {
+    preferences.remove(LegacyChainKeys[chain]);
+  }
   preferences.end();
-  DEBUG_INFO("Calibration '%s' loaded [OK]", calibration_name_);
+
+  DEBUG_INFO("Calibration '%s' migrated to format version %u [OK]", calibration_name_, CalibrationFormatVersion);
   return true;
 }
 
-bool DaisyChain::migrateCalibrationData(uint8_t from_version) {
-  // No migration needed for now
-  return false;
+bool DaisyChain::stageCalibratedValues(const char calibration_name[]) {
+  // Overwrite the active profile, this keeps 'save_calibration' backwards compatible
+  return stageProfile(active_profile_, calibration_name);
+}
+
+bool DaisyChain::stageProfile(const char profile_name[]) {
+  int slot = findProfile(profile_name);
+  if (slot < 0) {
+    // Not existing yet, use the first free slot
+    for (slot = 0; slot < static_cast<int>(MaxProfiles) && profile_valid_[slot] == true; slot++) {
+    }
+    if (slot == static_cast<int>(MaxProfiles)) {
+      DEBUG_ERROR("No free calibration profile slot!");
+      return false;
+    }
+  }
+  return stageProfile(slot, profile_name);
 }
 
-bool DaisyChain::saveCalibratedValues(const char calibration_name[]) {
-  if (calibration_name == nullptr || strnlen(calibration_name, sizeof(calibration_name_)) > CalibrationNameMaxLength) {
+bool DaisyChain::stageProfile(size_t slot, const char profile_name[]) {
+  if (profile_name == nullptr || strnlen(profile_name, sizeof(calibration_name_)) > CalibrationNameMaxLength) {
     DEBUG_ERROR("Invalid calibration name!");
     return false;
   }
 
-  strncpy(calibration_name_, calibration_name, CalibrationNameMaxLength);
-  calibration_name_[CalibrationNameMaxLength - 1] = '\0';  // Ensure
+  strncpy(calibration_name_, profile_name, CalibrationNameMaxLength);
+  calibration_name_[CalibrationNameMaxLength] = '\0';  // Full length names are kept, they are lookup keys
+
+  // Snapshot the current idle values into the RAM profile, the flash write happens later on the storage worker
+  buildCalibrationRecord(profiles_[slot]);
+  profile_valid_[slot] = true;
+  active_profile_ = slot;
+  memcpy(staged_record_, profiles_[slot], record_size_);
+  staged_slot_ = slot;
+  return true;
+}
+
+bool DaisyChain::saveStagedCalibratedValues() {
+  char key[ProfileKeyLength];
+  getProfileKey(staged_slot_, key);
+  uint32_t crc = getRecordCrc(staged_record_);
 
   Preferences preferences;
   preferences.begin("calibration", false);  // open (create if needed) the namespace in RW mode
+  preferences.putUChar("calib_active", staged_slot_);
 
-  preferences.putUChar("format_version", CalibrationFormatVersion);
-  preferences.putString("calib_name", calibration_name_);
-  preferences.putBytes("calib_chain0", idle_brightness0_, sizeof(idle_brightness0_));
-  preferences.putBytes("calib_chain1", idle_brightness1_, sizeof(idle_brightness1_));
-  preferences.putBytes("calib_chain2", idle_brightness2_, sizeof(idle_brightness2_));
-  preferences.putBytes("calib_chain3", idle_brightness3_, sizeof(idle_brightness3_));
-  preferences.putBytes("calib_chain4", idle_brightness4_, sizeof(idle_brightness4_));
-  preferences.putBytes("calib_chain5", idle_brightness5_, sizeof(idle_brightness5_));
+  if (crc == persisted_crc_[staged_slot_]) {
+    // NVS rewrites a blob as a whole, so an unchanged record is the only write that can be avoided
+    preferences.end();
+    DEBUG_INFO("Calibration unchanged, skipping NVS write [OK]");
+    return true;
+  }
 
+  size_t length = preferences.putBytes(key, staged_record_, record_size_);
   preferences.end();
+
+  if (length != record_size_) {
+    DEBUG_ERROR("Failed to write calibration record!");
+    return false;
+  }
+  persisted_crc_[staged_slot_] = crc;
   DEBUG_INFO("Calibrated values saved [OK]");
   return true;
 }
 
+bool DaisyChain::selectProfile(const char profile_name[], uint32_t fade_ms) {
+  int slot = findProfile(profile_name);
+  if (slot < 0) {
+    return false;
+  }
+
+  restoreCalibrationRecord(profiles_[slot]);
+  active_profile_ = slot;
+  if (fade_ms > 0) {
+    startCrossfade(fade_ms);
+  }
+  return true;
+}
+
+bool DaisyChain::deleteProfile(const char profile_name[]) {
+  int slot = findProfile(profile_name);
+  if (slot < 0 || static_cast<size_t>(slot) == active_profile_) {
+    return false;
+  }
+
+  profile_valid_[slot] = false;
+  staged_slot_ = slot;
+  return true;
+}
+
+bool DaisyChain::saveActiveProfile() {
+  Preferences preferences;
+  preferences.begin("calibration", false);  // open (create if needed) the namespace in RW mode
+  preferences.putUChar("calib_active", active_profile_);
+  preferences.end();
+  return true;
+}
+
+bool DaisyChain::deleteStagedProfile() {
+  char key[ProfileKeyLength];
+  getProfileKey(staged_slot_, key);
+
+  Preferences preferences;
+  preferences.begin("calibration", false);  // open (create if needed) the namespace in RW mode
+  preferences.remove(key);
+  preferences.end();
+  persisted_crc_[staged_slot_] = 0;
+  return true;
+}
+
+size_t DaisyChain::getProfileNames(const char* names[], size_t size) const {
+  size_t count = 0;
+  for (size_t slot = 0; slot < MaxProfiles && count < size; slot++) {
+    if (profile_valid_[slot] == true) {
+      names[count++] = getRecordHeader(profiles_[slot])->name;
+    }
+  }
+  return count;
+}
+
+int DaisyChain::findProfile(const char profile_name[]) const {
+  if (profile_name == nullptr) {
+    return -1;
+  }
+  for (size_t slot = 0; slot < MaxProfiles; slot++) {
+    if (profile_valid_[slot] == true &&
+        strncmp(getRecordHeader(profiles_[slot])->name, profile_name, CalibrationNameMaxLength + 1) == 0) {
+      return slot;
+    }
+  }
+  return -1;
+}
+
+void DaisyChain::getProfileKey(size_t slot, char key[]) const {
+  snprintf(key, ProfileKeyLength, "calib_p%u", static_cast<unsigned>(slot));
+}
+
+DaisyChain::CalibrationHeader* DaisyChain::getRecordHeader(uint8_t record[]) const {
+  return reinterpret_cast<CalibrationHeader*>(record);  // Byte aligned, see CalibrationHeader
+}
+
+const DaisyChain::CalibrationHeader* DaisyChain::getRecordHeader(const uint8_t record[]) const {
+  return reinterpret_cast<const CalibrationHeader*>(record);
+}
+
+uint32_t DaisyChain::getRecordCrc(const uint8_t record[]) const {
+  uint32_t crc = 0;
+  memcpy(&crc, record + record_size_ - sizeof(crc), sizeof(crc));  // Not aligned
+  return crc;
+}
+
+void DaisyChain::buildCalibrationRecord(uint8_t record[]) const {
+  memset(record, 0, record_size_);
+  CalibrationHeader* header = getRecordHeader(record);
+  header->format_version = CalibrationFormatVersion;
+  header->chain_count = topology_.chain_count;
+  header->chain_size = topology_.chain_size;
+  strncpy(header->name, calibration_name_, CalibrationNameMaxLength);
+  memcpy(record + sizeof(CalibrationHeader), idle_brightness_, led_count_);
+
+  uint32_t crc = crc32(record, record_size_ - sizeof(crc));
+  memcpy(record + record_size_ - sizeof(crc), &crc, sizeof(crc));
+}
+
+void DaisyChain::restoreCalibrationRecord(const uint8_t record[]) {
+  strncpy(calibration_name_, getRecordHeader(record)->name, CalibrationNameMaxLength);
+  calibration_name_[CalibrationNameMaxLength] = '\0';
+  memcpy(idle_brightness_, record + sizeof(CalibrationHeader), led_count_);
+}
+
 bool DaisyChain::deleteCalibrationData() {
   Preferences preferences;
   preferences.begin("calibration", false);  // open (create if needed) the namespace in RW mode
   preferences.clear();                      // clears all keys in "calibration"
   preferences.end();
+  memset(persisted_crc_, 0, sizeof(persisted_crc_));
   return true;
 }
 
+void DaisyChain::clearProfiles() {
+  memset(profile_valid_, 0, sizeof(profile_valid_));
+  active_profile_ = 0;
+}
+
 const char* DaisyChain::getCalibrationName() const {
   return calibration_name_;
 }
 
 void DaisyChain::loadDefaultValues() {
-  memset(idle_brightness0_, 0, sizeof(idle_brightness0_));
-  memset(idle_brightness1_, 0, sizeof(idle_brightness1_));
-  memset(idle_brightness2_, 0, sizeof(idle_brightness2_));
-  memset(idle_brightness3_, 0, sizeof(idle_brightness3_));
-  memset(idle_brightness4_, 0, sizeof(idle_brightness4_));
-  memset(idle_brightness5_, 0, sizeof(idle_brightness5_));
+  memset(idle_brightness_, 0, led_count_);
 }
 
 void DaisyChain::applyIdleValues() {
-  memcpy(active_brightness0_, idle_brightness0_, sizeof(active_brightness0_));
-  memcpy(active_brightness1_, idle_brightness1_, sizeof(active_brightness1_));
-  memcpy(active_brightness2_, idle_brightness2_, sizeof(active_brightness2_));
-  memcpy(active_brightness3_, idle_brightness3_, sizeof(active_brightness3_));
-  memcpy(active_brightness4_, idle_brightness4_, sizeof(active_brightness4_));
-  memcpy(active_brightness5_, idle_brightness5_, sizeof(active_brightness5_));
-  chain0_changed_ = true;
-  chain1_changed_ = true;
-  chain2_changed_ = true;
-  chain3_changed_ = true;
-  chain4_changed_ = true;
-  chain5_changed_ = true;
+  memcpy(active_brightness_, idle_brightness_, led_count_);
+  for (size_t chain = 0; chain < topology_.chain_count; chain++) {
+    active_changed_[chain] = true;
+  }
+}
+
+void DaisyChain::commitFrame() {
+  // Publish all chains modified since the last commit in one step, so a following flushAll() always
+  // transmits one coherent frame even if the update spans several chains
+  TRACE(FRAME_COMMIT, 0);
+  if (fade_duration_ms_ > 0) {
+    uint32_t elapsed_ms = millis() - fade_start_ms_;
+    if (elapsed_ms < fade_duration_ms_) {
+      // Blend from the snapshot towards the back buffer, every chain changes while fading
+      uint32_t weight = (elapsed_ms << 8) / fade_duration_ms_;  // 0..255
+      for (size_t i = 0; i < led_count_; i++) {
+        frame_brightness_[i] =
+            static_cast<BrgNumber>((fade_from_[i] * (256 - weight) + active_brightness_[i] * weight) >> 8);
+      }
+      for (size_t chain = 0; chain < topology_.chain_count; chain++) {
+        active_changed_[chain] = false;
+        chain_changed_[chain] = true;
+      }
+      return;
+    }
+    // Fade complete, publish the unblended back buffer
+    fade_duration_ms_ = 0;
+    for (size_t chain = 0; chain < topology_.chain_count; chain++) {
+      active_changed_[chain] = true;
+    }
+  }
+
+  // An effect frame starts from the plain back buffer of every chain and modulates it on top
+  bool effect_frame = Effects::getInstance().isFrameDue();
+  for (size_t chain = 0; chain < topology_.chain_count; chain++) {
+    if (active_changed_[chain] == true || effect_frame == true) {
+      size_t offset = chain * chain_stride_;
+      memcpy(frame_brightness_ + offset, active_brightness_ + offset, chain_stride_);
+      active_changed_[chain] = false;
+      chain_changed_[chain] = true;
+    }
+  }
+  if (effect_frame == true) {
+    Effects::getInstance().render(frame_brightness_, active_brightness_, idle_brightness_);
+  }
+}
+
+void DaisyChain::startCrossfade(uint32_t duration_ms) {
+  // Start from what is currently shown (including a fade still in progress)
+  memcpy(fade_from_, frame_brightness_, led_count_);
+  fade_start_ms_ = millis();
+  fade_duration_ms_ = duration_ms;
+}
+
+int64_t DaisyChain::getWakeUpUs() const {
+  if (fade_duration_ms_ > 0) {
+    return EventLoop::WakeUpFrameTick;
+  }
+  uint32_t refresh_interval_ms = getRefreshInterval();
+  if (refresh_interval_ms == 0) {
+    return EventLoop::WakeUpOnEvent;
+  }
+  uint32_t chain_interval_ms = refresh_interval_ms / topology_.chain_count;
+  uint32_t elapsed_ms = millis() - last_refresh_ms_;
+  return esp_timer_get_time() + ((elapsed_ms < chain_interval_ms) ? (chain_interval_ms - elapsed_ms) * 1000LL : 0);
+}
+
+void DaisyChain::setMasterLevel(uint8_t level) {
+  // Dim in hardware with the global brightness control (7 bit) of the drivers, so the gamma corrected
+  // grayscale values keep their full resolution
+  constexpr size_t BcMaxValue = TurboTLC59711<CHAIN_SIZE_MAX>::BcMaxValue;
+  master_level_ = (level < static_cast<uint8_t>(BrgName::MAX)) ? level : static_cast<uint8_t>(BrgName::MAX);
+  uint8_t bc = (master_level_ * BcMaxValue + 50) / static_cast<uint8_t>(BrgName::MAX);
+  chain_.setBrightness(bc, bc, bc);
+
+  for (size_t chain = 0; chain < topology_.chain_count; chain++) {
+    chain_changed_[chain] = true;
+  }
+}
+
+uint8_t DaisyChain::getMasterLevel() const {
+  return master_level_;
 }
 
 void DaisyChain::flushAll(bool force) {
-  flushChain(ChainIdx::CHAIN_0, force);
-  flushChain(ChainIdx::CHAIN_1, force);
-  flushChain(ChainIdx::CHAIN_2, force);
-  flushChain(ChainIdx::CHAIN_3, force);
-  flushChain(ChainIdx::CHAIN_4, force);
-  flushChain(ChainIdx::CHAIN_5, force);
+  for (size_t chain = 0; chain < topology_.chain_count; chain++) {
+    flushChain(static_cast<ChainIdx>(chain), force);
+  }
 }
 
-void DaisyChain::flushChain(ChainIdx idx, bool force) {
-  BrgNumber(*current_brightness)[CHAIN_SIZE][LED_COUNT] = nullptr;
+void DaisyChain::runRefresh() {
+  // Rewrite one chain per turn so glitched boards recover without a burst of all chains delaying a request.
+  // Chains written within the last turn (e.g. by a running show) are up to date and only pass on the turn.
+  uint32_t refresh_interval_ms = getRefreshInterval();
+  if (refresh_interval_ms == 0) {
+    return;
+  }
+  uint32_t chain_interval_ms = refresh_interval_ms / topology_.chain_count;
+  if (millis() - last_refresh_ms_ < chain_interval_ms) {
+    return;
+  }
+  last_refresh_ms_ = millis();
 
-  switch (idx) {
-    case ChainIdx::CHAIN_0:
-      if (chain0_changed_ == false && force == false) {
-        return;
-      }
-      chain0_changed_ = false;
-      current_brightness = &active_brightness0_;
-      break;
-    case ChainIdx::CHAIN_1:
-      if (chain1_changed_ == false && force == false) {
-        return;
-      }
-      chain1_changed_ = false;
-      current_brightness = &active_brightness1_;
-      break;
-    case ChainIdx::CHAIN_2:
-      if (chain2_changed_ == false && force == false) {
-        return;
-      }
-      chain2_changed_ = false;
-      current_brightness = &active_brightness2_;
+  size_t chain = refresh_chain_;
+  refresh_chain_ = (refresh_chain_ + 1) % topology_.chain_count;
+  if (millis() - last_flush_ms_[chain] >= chain_interval_ms) {
+    flushChain(static_cast<ChainIdx>(chain), true);
+  }
+}
+
+void DaisyChain::flushChain(ChainIdx idx, bool force) {
+  size_t chain = static_cast<size_t>(idx);
+  if (chain >= topology_.chain_count) {
+    DEBUG_INFO("Invalid chain index!");
+    return;
+  }
+  if (chain_changed_[chain] == false && force == false) {
+    return;
+  }
+  chain_changed_[chain] = false;
+  last_flush_ms_[chain] = millis();
+  uint32_t flush_start_us = micros();
+  TRACE(FLUSH_BEGIN, chain);
+  const BrgNumber* current_brightness = frame_brightness_ + chain * chain_stride_;
+
+  // Common chain lengths get a packing loop with compile-time bounds, everything else uses the generic one
+  switch (topology_.chain_size) {
+    case 8:
+      packChain<8>(current_brightness);
       break;
-    case ChainIdx::CHAIN_3:
-      if (chain3_changed_ == false && force == false) {
-        return;
-      }
-      chain3_changed_ = false;
-      current_brightness = &active_brightness3_;
+    case 10:
+      packChain<10>(current_brightness);
       break;
-    case ChainIdx::CHAIN_4:
-      if (chain4_changed_ == false && force == false) {
-        return;
-      }
-      chain4_changed_ = false;
-      current_brightness = &active_brightness4_;
+    case 12:
+      packChain<12>(current_brightness);
       break;
-    case ChainIdx::CHAIN_5:
-      if (chain5_changed_ == false && force == false) {
-        return;
-      }
-      chain5_changed_ = false;
-      current_brightness = &active_brightness5_;
+    case 16:
+      packChain<16>(current_brightness);
       break;
     default:
-      DEBUG_INFO("Invalid chain index!");
-      return;
+      packChain<0>(current_brightness);
+      break;
   }
 
-  for (uint8_t tlc_idx = 0; tlc_idx < CHAIN_SIZE; tlc_idx++) {
+  selectChain(idx);
+  writeData();
+  Metrics::getInstance().recordChainFlush(chain, micros() - flush_start_us);
+  TRACE(FLUSH_END, chain);
+}
+
+template <size_t ChainSize>
+void DaisyChain::packChain(const BrgNumber brightness[]) {
+  const size_t chain_size = (ChainSize != 0) ? ChainSize : topology_.chain_size;
+
+  for (uint8_t tlc_idx = 0; tlc_idx < chain_size; tlc_idx++) {
     // Invert tlc_idx and led_idx to match physical wiring/naming
-    uint16_t tlc_idx_inv = CHAIN_SIZE - tlc_idx - 1;
+    uint16_t tlc_idx_inv = chain_size - tlc_idx - 1;
+    const BrgNumber* tlc_brightness = brightness + tlc_idx * LED_COUNT;
 
     for (uint8_t led_idx = 0; led_idx < (LED_COUNT / 3); led_idx++) {  // LED index is [0, 1, 2, 3]
-      uint16_t ch_r = linearizeBrightness((*current_brightness)[tlc_idx][led_idx * 3]);
-      uint16_t ch_g = linearizeBrightness((*current_brightness)[tlc_idx][led_idx * 3 + 1]);
-      uint16_t ch_b = linearizeBrightness((*current_brightness)[tlc_idx][led_idx * 3 + 2]);
+      uint16_t ch_r = linearizeBrightness(tlc_brightness[led_idx * 3]);
+      uint16_t ch_g = linearizeBrightness(tlc_brightness[led_idx * 3 + 1]);
+      uint16_t ch_b = linearizeBrightness(tlc_brightness[led_idx * 3 + 2]);
 
       uint8_t led_idx_inv = (LED_COUNT / 3 - 1) - led_idx;        // Invert led index to match physical wiring/naming
       chain_.setLed(tlc_idx_inv, led_idx_inv, ch_b, ch_g, ch_r);  // Note the order: B, G, R
     }
   }
-
-  selectChain(idx);
-  writeData();
 }
 
 void DaisyChain::selectChain(ChainIdx idx) {
-  digitalWrite(Chain0SelectPin, LOW);
-  digitalWrite(Chain1SelectPin, LOW);
-  digitalWrite(Chain2SelectPin, LOW);
-  digitalWrite(Chain3SelectPin, LOW);
-  digitalWrite(Chain4SelectPin, LOW);
-  digitalWrite(Chain5SelectPin, LOW);
-
-  switch (idx) {
-    case ChainIdx::CHAIN_0:
-      digitalWrite(Chain0SelectPin, HIGH);
-      break;
-    case ChainIdx::CHAIN_1:
-      digitalWrite(Chain1SelectPin, HIGH);
-      break;
-    case ChainIdx::CHAIN_2:
-      digitalWrite(Chain2SelectPin, HIGH);
-      break;
-    case ChainIdx::CHAIN_3:
-      digitalWrite(Chain3SelectPin, HIGH);
-      break;
-    case ChainIdx::CHAIN_4:
-      digitalWrite(Chain4SelectPin, HIGH);
-      break;
-    case ChainIdx::CHAIN_5:
-      digitalWrite(Chain5SelectPin, HIGH);
-      break;
-    default:
-      break;
+  size_t selected = static_cast<size_t>(idx);
+  for (size_t chain = 0; chain < topology_.chain_count; chain++) {
+    digitalWrite(topology_.select_pins[chain], (chain == selected) ? HIGH : LOW);
   }
 }
 
@@ -318,7 +597,11 @@ void DaisyChain::writeData() {
   trans.tx_buffer = chain_.getChainBuffer();
   trans.rx_buffer = nullptr;
 
+  uint32_t transfer_start_us = micros();
+  TRACE(SPI_BEGIN, chain_.getChainBufferSize());
   ESP_ERROR_CHECK(spi_device_transmit(spi_, &trans));
+  TRACE(SPI_END, chain_.getChainBufferSize());
+  Metrics::getInstance().record(Metrics::Histogram::SPI_TRANSFER, micros() - transfer_start_us);
 #endif
 }
 
@@ -326,134 +609,65 @@ uint16_t DaisyChain::linearizeBrightness(BrgNumber brightness) {
   return BRIGHTNESS_LINEARIZATION_TABLE[static_cast<int>(brightness)];
 }
 
+size_t DaisyChain::getLedOffset(size_t chain, size_t pcb_idx, size_t led_idx) const {
+  return chain * chain_stride_ + pcb_idx * LED_COUNT + led_idx;
+}
+
+bool DaisyChain::isLedValid(const LedObj& led) const {
+  return static_cast<size_t>(led.chain_idx) < topology_.chain_count && led.pcb_idx < topology_.chain_size &&
+         led.led_idx < LED_COUNT;
+}
+
 void DaisyChain::getActiveLeds(LedObj leds[], size_t size) const {
   for (size_t i = 0; i < size; i++) {
-    ChainIdx chain_idx = leds[i].chain_idx;
-    uint8_t pcb_idx = leds[i].pcb_idx;
-    uint8_t led_idx = leds[i].led_idx;
-
-    switch (chain_idx) {
-      case ChainIdx::CHAIN_0:
-        leds[i].brightness = active_brightness0_[pcb_idx][led_idx];
-        break;
-      case ChainIdx::CHAIN_1:
-        leds[i].brightness = active_brightness1_[pcb_idx][led_idx];
-        break;
-      case ChainIdx::CHAIN_2:
-        leds[i].brightness = active_brightness2_[pcb_idx][led_idx];
-        break;
-      case ChainIdx::CHAIN_3:
-        leds[i].brightness = active_brightness3_[pcb_idx][led_idx];
-        break;
-      case ChainIdx::CHAIN_4:
-        leds[i].brightness = active_brightness4_[pcb_idx][led_idx];
-        break;
-      case ChainIdx::CHAIN_5:
-        leds[i].brightness = active_brightness5_[pcb_idx][led_idx];
-        break;
-      default:
-        break;
+    if (isLedValid(leds[i]) == false) {
+      continue;
     }
+    size_t chain = static_cast<size_t>(leds[i].chain_idx);
+    leds[i].brightness = active_brightness_[getLedOffset(chain, leds[i].pcb_idx, leds[i].led_idx)];
   }
 }
 
 void DaisyChain::setActiveLeds(LedObj leds[], size_t size) {
   for (size_t i = 0; i < size; i++) {
-    ChainIdx chain_idx = leds[i].chain_idx;
-    uint8_t pcb_idx = leds[i].pcb_idx;
-    uint8_t led_idx = leds[i].led_idx;
-    BrgNumber brightness = leds[i].brightness;
-
-    switch (chain_idx) {
-      case ChainIdx::CHAIN_0:
-        active_brightness0_[pcb_idx][led_idx] = brightness;
-        chain0_changed_ = true;
-        break;
-      case ChainIdx::CHAIN_1:
-        active_brightness1_[pcb_idx][led_idx] = brightness;
-        chain1_changed_ = true;
-        break;
-      case ChainIdx::CHAIN_2:
-        active_brightness2_[pcb_idx][led_idx] = brightness;
-        chain2_changed_ = true;
-        break;
-      case ChainIdx::CHAIN_3:
-        active_brightness3_[pcb_idx][led_idx] = brightness;
-        chain3_changed_ = true;
-        break;
-      case ChainIdx::CHAIN_4:
-        active_brightness4_[pcb_idx][led_idx] = brightness;
-        chain4_changed_ = true;
-        break;
-      case ChainIdx::CHAIN_5:
-        active_brightness5_[pcb_idx][led_idx] = brightness;
-        chain5_changed_ = true;
-        break;
-      default:
-        break;
+    if (isLedValid(leds[i]) == false) {
+      continue;
     }
+    size_t chain = static_cast<size_t>(leds[i].chain_idx);
+    active_brightness_[getLedOffset(chain, leds[i].pcb_idx, leds[i].led_idx)] = leds[i].brightness;
+    active_changed_[chain] = true;
   }
 }
 
 void DaisyChain::getIdleLeds(LedObj leds[], size_t size) const {
   for (size_t i = 0; i < size; i++) {
-    ChainIdx chain_idx = leds[i].chain_idx;
-    uint8_t pcb_idx = leds[i].pcb_idx;
-    uint8_t led_idx = leds[i].led_idx;
-
-    switch (chain_idx) {
-      case ChainIdx::CHAIN_0:
-        leds[i].brightness = idle_brightness0_[pcb_idx][led_idx];
-        break;
-      case ChainIdx::CHAIN_1:
-        leds[i].brightness = idle_brightness1_[pcb_idx][led_idx];
-        break;
-      case ChainIdx::CHAIN_2:
-        leds[i].brightness = idle_brightness2_[pcb_idx][led_idx];
-        break;
-      case ChainIdx::CHAIN_3:
-        leds[i].brightness = idle_brightness3_[pcb_idx][led_idx];
-        break;
-      case ChainIdx::CHAIN_4:
-        leds[i].brightness = idle_brightness4_[pcb_idx][led_idx];
-        break;
-      case ChainIdx::CHAIN_5:
-        leds[i].brightness = idle_brightness5_[pcb_idx][led_idx];
-        break;
-      default:
-        break;
+    if (isLedValid(leds[i]) == false) {
+      continue;
     }
+    size_t chain = static_cast<size_t>(leds[i].chain_idx);
+    leds[i].brightness = idle_brightness_[getLedOffset(chain, leds[i].pcb_idx, leds[i].led_idx)];
   }
 }
 
 void DaisyChain::setIdleLeds(LedObj leds[], size_t size) {
   for (size_t i = 0; i < size; i++) {
-    ChainIdx chain_idx = leds[i].chain_idx;
-    uint8_t pcb_idx = leds[i].pcb_idx;
-    uint8_t led_idx = leds[i].led_idx;
-    BrgNumber brightness = leds[i].brightness;
-
-    switch (chain_idx) {
-      case ChainIdx::CHAIN_0:
-        idle_brightness0_[pcb_idx][led_idx] = brightness;
-        break;
-      case ChainIdx::CHAIN_1:
-        idle_brightness1_[pcb_idx][led_idx] = brightness;
-        break;
-      case ChainIdx::CHAIN_2:
-        idle_brightness2_[pcb_idx][led_idx] = brightness;
-        break;
-      case ChainIdx::CHAIN_3:
-        idle_brightness3_[pcb_idx][led_idx] = brightness;
-        break;
-      case ChainIdx::CHAIN_4:
-        idle_brightness4_[pcb_idx][led_idx] = brightness;
-        break;
-      case ChainIdx::CHAIN_5:
-        idle_brightness5_[pcb_idx][led_idx] = brightness;
-        break;
-      default:
-        break;
+    if (isLedValid(leds[i]) == false) {
+      continue;
     }
+    size_t chain = static_cast<size_t>(leds[i].chain_idx);
+    idle_brightness_[getLedOffset(chain, leds[i].pcb_idx, leds[i].led_idx)] = leds[i].brightness;
   }
 }
+
+void DaisyChain::getIdleMap(BrgNumber map[], size_t offset, size_t length) const {
+  // The idle map is ordered by global pcb index and led index, which matches the in-memory layout
+  if (offset >= led_count_ || length > led_count_ - offset) {
+    DEBUG_ERROR("Invalid idle map range!");
+    return;
+  }
+  memcpy(map, idle_brightness_ + offset, length);
+}
+
+void DaisyChain::setIdleMap(const BrgNumber map[]) {
+  memcpy(idle_brightness_, map, led_count_);
+}
@@ -7,18 +7,16 @@
 #include "driver/spi_master.h"
 
 class DaisyChain {
-  constexpr static uint8_t CalibrationFormatVersion = 0;
-  constexpr static size_t CalibrationNameMaxLength = 64;
-  // HSPI pins
-  constexpr static int SpiClockFreq = 8000000;  // 8 MHz
+ public:
+  // HSPI pins, no chain select line may use them (see isTopologyValid)
   constexpr static int SpiClockPin = 12;
   constexpr static int SpiDataPin = 11;
-  constexpr static int Chain0SelectPin = 48;
-  constexpr static int Chain1SelectPin = 47;
-  constexpr static int Chain2SelectPin = 21;
-  constexpr static int Chain3SelectPin = 10;
-  constexpr static int Chain4SelectPin = 9;
-  constexpr static int Chain5SelectPin = 3;
+
+ private:
+  constexpr static uint8_t CalibrationFormatVersion = 2;
+  constexpr static size_t CalibrationNameMaxLength = 64;
+  constexpr static size_t ProfileKeyLength = 12;  // "calib_pN" + null terminator
+  constexpr static int SpiClockFreq = 8000000;    // 8 MHz
 
   // Gamma brightness lookup table <https://victornpb.github.io/gamma-table-generator>
   // gamma = 2.0 steps = 101 range = 0-65535
@@ -33,6 +31,9 @@ class DaisyChain {
   };
 
  public:
+  constexpr static size_t MaxProfiles = 4;              // Calibration profiles held in RAM and NVS
+  constexpr static uint32_t FadeMaxMs = 10 * 60 * 1000;  // Longest crossfade, the blend weight is elapsed_ms << 8
+
   DaisyChain(const DaisyChain&) = delete;
   DaisyChain& operator=(const DaisyChain&) = delete;
 
@@ -46,46 +47,92 @@ class DaisyChain {
   void setActiveLeds(LedObj leds[], size_t size);
   void getIdleLeds(LedObj leds[], size_t size) const;
   void setIdleLeds(LedObj leds[], size_t size);
+  void getIdleMap(BrgNumber map[], size_t offset, size_t length) const;
+  void setIdleMap(const BrgNumber map[]);
   void loadDefaultValues();
   void applyIdleValues();
+  void commitFrame();
   void flushAll(bool force = false);
   void flushChain(ChainIdx idx, bool force = false);
-  bool saveCalibratedValues(const char calibration_name[]);
+  void runRefresh();
+  void startCrossfade(uint32_t duration_ms);
+  int64_t getWakeUpUs() const;  // Frame rate while a crossfade is running, next refresh otherwise (see EventLoop)
+  void setMasterLevel(uint8_t level);
+  uint8_t getMasterLevel() const;
+  bool stageCalibratedValues(const char calibration_name[]);
+  bool stageProfile(const char profile_name[]);
+  bool saveStagedCalibratedValues();
+  bool selectProfile(const char profile_name[], uint32_t fade_ms);
+  bool saveActiveProfile();
+  bool deleteProfile(const char profile_name[]);
+  bool deleteStagedProfile();
   bool deleteCalibrationData();
+  void clearProfiles();
+  size_t getProfileNames(const char* names[], size_t size) const;
   const char* getCalibrationName() const;
 
  private:
+  // A calibration record is stored as header, idle values (Topology::ledCount() bytes) and a CRC-32 over both
+  struct CalibrationHeader {
+    uint8_t format_version;
+    uint8_t chain_count;  // Topology the idle values belong to
+    uint8_t chain_size;
+    char name[CalibrationNameMaxLength + 1];
+  };
+
   DaisyChain();
+  void allocateBuffers();
   void selectChain(ChainIdx idx);
   void writeData();
+  template <size_t ChainSize>
+  void packChain(const BrgNumber brightness[]);
   bool loadCalibratedValues();
   bool migrateCalibrationData(uint8_t from_version);
+  bool stageProfile(size_t slot, const char profile_name[]);
+  int findProfile(const char profile_name[]) const;
+  void getProfileKey(size_t slot, char key[]) const;
+  CalibrationHeader* getRecordHeader(uint8_t record[]) const;
+  const CalibrationHeader* getRecordHeader(const uint8_t record[]) const;
+  uint32_t getRecordCrc(const uint8_t record[]) const;
+  void buildCalibrationRecord(uint8_t record[]) const;
+  void restoreCalibrationRecord(const uint8_t record[]);
+  size_t getLedOffset(size_t chain, size_t pcb_idx, size_t led_idx) const;
+  bool isLedValid(const LedObj& led) const;
   uint16_t linearizeBrightness(BrgNumber brightness);
 
-  BrgNumber active_brightness0_[CHAIN_SIZE][LED_COUNT];
-  BrgNumber active_brightness1_[CHAIN_SIZE][LED_COUNT];
-  BrgNumber active_brightness2_[CHAIN_SIZE][LED_COUNT];
-  BrgNumber active_brightness3_[CHAIN_SIZE][LED_COUNT];
-  BrgNumber active_brightness4_[CHAIN_SIZE][LED_COUNT];
-  BrgNumber active_brightness5_[CHAIN_SIZE][LED_COUNT];
+  Topology topology_ = {};
+  size_t led_count_ = 0;     // All buffers below hold led_count_ values, allocated once at startup
+  size_t chain_stride_ = 0;  // Values per chain
+  size_t record_size_ = 0;   // Size of a calibration record
+
+  // Back buffer, written by setActiveLeds() and published to the chains with commitFrame()
+  BrgNumber* active_brightness_ = nullptr;
+  // Front buffer, holds the last committed frame and is the only source for flushChain()
+  BrgNumber* frame_brightness_ = nullptr;
+  BrgNumber* idle_brightness_ = nullptr;
 
   char calibration_name_[CalibrationNameMaxLength + 1] = "NULL";
+  uint8_t* profiles_[MaxProfiles] = {};
+  bool profile_valid_[MaxProfiles] = {};
+  uint32_t persisted_crc_[MaxProfiles] = {};  // CRC of the records currently stored in NVS (0 if none)
+  size_t active_profile_ = 0;
+  uint8_t* staged_record_ = nullptr;  // Snapshot handed to the storage worker by stageProfile()
+  size_t staged_slot_ = 0;
 
-  BrgNumber idle_brightness0_[CHAIN_SIZE][LED_COUNT];
-  BrgNumber idle_brightness1_[CHAIN_SIZE][LED_COUNT];
-  BrgNumber idle_brightness2_[CHAIN_SIZE][LED_COUNT];
-  BrgNumber idle_brightness3_[CHAIN_SIZE][LED_COUNT];
-  BrgNumber idle_brightness4_[CHAIN_SIZE][LED_COUNT];
-  BrgNumber idle_brightness5_[CHAIN_SIZE][LED_COUNT];
+  BrgNumber* fade_from_ = nullptr;  // Frame shown when the crossfade started
+  uint32_t fade_start_ms_ = 0;
+  uint32_t fade_duration_ms_ = 0;  // 0 if no crossfade is running
+  uint8_t master_level_ = static_cast<uint8_t>(BrgName::MAX);
 
   spi_device_handle_t spi_ = nullptr;
-  TurboTLC59711<CHAIN_SIZE> chain_ = {};
-  bool chain0_changed_ = false;
-  bool chain1_changed_ = false;
-  bool chain2_changed_ = false;
-  bool chain3_changed_ = false;
-  bool chain4_changed_ = false;
-  bool chain5_changed_ = false;
+  TurboTLC59711<CHAIN_SIZE_MAX> chain_ = {};
+
+  // The frame buffers and change flags are owned by the loop task, storage jobs only work on staged records
+  bool active_changed_[CHAIN_COUNT_MAX] = {};  // Chains modified in the back buffer since the last commit
+  bool chain_changed_[CHAIN_COUNT_MAX] = {};   // Chains committed to the front buffer but not yet flushed
+  uint32_t last_flush_ms_[CHAIN_COUNT_MAX] = {};
+  uint32_t last_refresh_ms_ = 0;
+  size_t refresh_chain_ = 0;  // Next chain in the round-robin refresh
 };
 
 #endif  // DAISY_CHAIN_H
@@ -0,0 +1,333 @@
+#include "Effects.h"
+#include <Preferences.h>
+#include <math.h>
+#include "EventLoop.h"
+
+#define LOG_LEVEL_EFFECTS LOG_LEVEL_INFO
+#if ((LOG_LEVEL_EFFECTS >= LOG_LEVEL_ERROR) && (ENABLE_DEBUG_OUTPUT == 1))
+#define DEBUG_ERROR(f, ...) debugPrint("[ERR][Effects]", f, ##__VA_ARGS__)
+#else
+#define DEBUG_ERROR(...)
+#endif
+#if ((LOG_LEVEL_EFFECTS >= LOG_LEVEL_INFO) && (ENABLE_DEBUG_OUTPUT == 1))
+#define DEBUG_INFO(f, ...) debugPrint("[INF][Effects]", f, ##__VA_ARGS__)
+#else
+#define DEBUG_INFO(...)
+#endif
+
+void Effects::initialize(size_t led_count) {
+  DEBUG_INFO("Initialize Effects [...]");
+  led_count_ = led_count;
+  states_ = new TwinkleState[led_count_]();
+  layout_ = new uint8_t[led_count_ * LayoutBytesPerLed]();
+  pattern_position_ = new uint8_t[led_count_]();
+  random_state_ ^= esp_random();  // Different sky after every boot
+  loadLayout();
+  DEBUG_INFO("Initialize Effects [OK]");
+}
+
+void Effects::setTwinkle(uint8_t depth_percent, uint32_t period_ms, uint8_t density_percent) {
+  bool was_enabled = isTwinkleEnabled();
+  bool was_active = isActive();
+  depth_ = (depth_percent * 255U) / PercentMax;
+  rate_ = PhaseCycle / period_ms;
+  density_ = (density_percent * 255U) / PercentMax;
+  DEBUG_INFO("Twinkle: depth %u%%, period %u ms, density %u%%", depth_percent, period_ms, density_percent);
+
+  if (was_enabled == false && isTwinkleEnabled() == true) {
+    // Random phases, so the stars don't start in sync
+    for (size_t i = 0; i < led_count_; i++) {
+      startCycle(states_[i]);
+      states_[i].phase = nextRandom() & (PhaseCycle - 1);
+    }
+  }
+  if (was_active == false && isActive() == true) {
+    last_frame_ms_ = millis() - FrameIntervalMs;
+  }
+  if (was_active == true && isActive() == false) {
+    restore_frame_ = true;
+  }
+}
+
+bool Effects::isTwinkleEnabled() const {
+  return depth_ > 0 && density_ > 0 && states_ != nullptr;
+}
+
+bool Effects::isActive() const {
+  return isTwinkleEnabled() == true || pattern_.pattern != Pattern::OFF;
+}
+
+bool Effects::isFrameDue() {
+  if (restore_frame_ == true) {
+    restore_frame_ = false;
+    return true;
+  }
+  return isActive() == true && millis() - last_frame_ms_ >= FrameIntervalMs;
+}
+
+void Effects::render(BrgNumber frame[], const BrgNumber active[], const BrgNumber idle[]) {
+  uint32_t now_ms = millis();
+  uint32_t elapsed_ms = now_ms - last_frame_ms_;
+  last_frame_ms_ = now_ms;
+
+  if (isTwinkleEnabled() == true) {
+    renderTwinkle(frame, active, idle, elapsed_ms);
+  }
+  if (pattern_.pattern != Pattern::OFF) {
+    renderPattern(frame, now_ms);
+  }
+}
+
+void Effects::renderTwinkle(BrgNumber frame[], const BrgNumber active[], const BrgNumber idle[],
+                            uint32_t elapsed_ms) {
+  for (size_t i = 0; i < led_count_; i++) {
+    TwinkleState& state = states_[i];
+    state.phase += state.rate * elapsed_ms;
+    if (state.phase >= PhaseCycle) {
+      startCycle(state);
+    }
+
+    // LEDs driven by a show are left alone
+    if (active[i] != idle[i] || state.depth == 0) {
+      continue;
+    }
+    // Eased triangle 0..255..0 over the cycle, scaled by the depth of this cycle
+    uint32_t triangle = (state.phase < PhaseCycle / 2) ? state.phase : PhaseCycle - 1 - state.phase;
+    triangle >>= PhaseBits - 1 - 8;
+    uint32_t dip = (triangle * triangle * state.depth) >> 16;
+    frame[i] = static_cast<BrgNumber>((idle[i] * (256 - dip)) >> 8);
+  }
+}
+
+int64_t Effects::getWakeUpUs() const {
+  if (restore_frame_ == true) {
+    return esp_timer_get_time();
+  }
+  if (isActive() == false) {
+    return EventLoop::WakeUpOnEvent;
+  }
+  uint32_t elapsed_ms = millis() - last_frame_ms_;
+  return esp_timer_get_time() + ((elapsed_ms < FrameIntervalMs) ? (FrameIntervalMs - elapsed_ms) * 1000LL : 0);
+}
+
+uint32_t Effects::nextRandom() {
+  // xorshift32, plenty for visual randomness and only a few cycles per call
+  random_state_ ^= random_state_ << 13;
+  random_state_ ^= random_state_ >> 17;
+  random_state_ ^= random_state_ << 5;
+  return random_state_;
+}
+
+void Effects::startCycle(TwinkleState& state) {
+  uint32_t random = nextRandom();
+  state.phase &= PhaseCycle - 1;
+  // Rate between 0.5x and 1.5x of the average, depth up to the maximum, only a share of the stars twinkles
+  state.rate = static_cast<uint16_t>((rate_ * (128 + (random & 0xFF))) >> 8);
+  if (state.rate == 0) {
+    state.rate = 1;
+  }
+  state.depth = (((random >> 8) & 0xFF) < density_) ? static_cast<uint8_t>(((random >> 16) & 0xFF) * depth_ >> 8) : 0;
+}
+
+void Effects::renderPattern(BrgNumber frame[], uint32_t now_ms) {
+  uint32_t elapsed_ms = now_ms - pattern_start_ms_;
+  if (pattern_.duration_ms > 0 && elapsed_ms >= pattern_.duration_ms) {
+    // This frame already starts from the plain back buffer, so it restores what the pattern covered
+    DEBUG_INFO("Pattern finished");
+    pattern_.pattern = Pattern::OFF;
+    return;
+  }
+
+  if (pattern_.pattern == Pattern::NOISE) {
+    // Drift one cell per period, the noise lattice repeats every 256 cells, so wrapping there is seamless
+    // Drift in 1/256 cells (< 256 * 256) and cell size clamped in setPattern(), so the lattice maths stays bounded
+    uint32_t cycle_ms = elapsed_ms % (pattern_.period_ms * 256);
+    float drift = static_cast<float>(cycle_ms) / pattern_.period_ms * 256.0f;
+    float angle = pattern_.angle_deg * static_cast<float>(M_PI) / 180.0f;
+    int32_t drift_x = static_cast<int32_t>(drift * cosf(angle));
+    int32_t drift_y = static_cast<int32_t>(drift * sinf(angle));
+    for (size_t i = 0; i < led_count_; i++) {
+      // Layout coordinates in 1/256 units, divided by the cell size gives lattice coordinates in 1/256 units
+      int32_t x = (layout_[i * LayoutBytesPerLed] << 8) / pattern_.width - drift_x;
+      int32_t y = (layout_[i * LayoutBytesPerLed + 1] << 8) / pattern_.width - drift_y;
+      BrgNumber value = static_cast<BrgNumber>((noise(x, y) * pattern_.level) >> 8);
+      frame[i] = (value > frame[i]) ? value : frame[i];
+    }
+    return;
+  }
+
+  // Bands are a precomputed position per LED minus the travelled phase, only the comparison runs per frame
+  uint8_t phase = static_cast<uint8_t>(((elapsed_ms % pattern_.period_ms) << 8) / pattern_.period_ms);
+  for (size_t i = 0; i < led_count_; i++) {
+    uint8_t offset = pattern_position_[i] - phase;
+    if (offset >= pattern_.width) {
+      continue;
+    }
+    // Eased triangle 0..255..0 across the band
+    uint32_t triangle = (offset * 512U) / pattern_.width;
+    triangle = (triangle < 256) ? triangle : 511 - triangle;
+    uint32_t shape = (triangle * triangle) >> 8;
+    BrgNumber value = static_cast<BrgNumber>((shape * pattern_.level) >> 8);
+    frame[i] = (value > frame[i]) ? value : frame[i];
+  }
+}
+
+uint8_t Effects::noise(int32_t x, int32_t y) {
+  // Value noise: random values on an integer lattice (256 x 256 cells), smoothly interpolated in between
+  auto lattice = [](int32_t ix, int32_t iy) -> uint32_t {
+    uint32_t hash = static_cast<uint32_t>(ix & 0xFF) * 374761393U + static_cast<uint32_t>(iy & 0xFF) * 668265263U;
+    hash = (hash ^ (hash >> 13)) * 1274126177U;
+    return (hash >> 24) & 0xFF;
+  };
+  auto smooth = [](uint32_t f) -> uint32_t { return (f * f * (3 * 256 - 2 * f)) >> 16; };  // 3f^2 - 2f^3
+
+  int32_t ix = x >> 8;  // Arithmetic shift, floor for negative coordinates
+  int32_t iy = y >> 8;
+  uint32_t fx = smooth(x & 0xFF);
+  uint32_t fy = smooth(y & 0xFF);
+  uint32_t top = lattice(ix, iy) * (256 - fx) + lattice(ix + 1, iy) * fx;
+  uint32_t bottom = lattice(ix, iy + 1) * (256 - fx) + lattice(ix + 1, iy + 1) * fx;
+  return static_cast<uint8_t>((top * (256 - fy) + bottom * fy) >> 16);
+}
+
+bool Effects::hasLayout() const {
+  return layout_valid_;
+}
+
+void Effects::setLayout(const uint8_t layout[]) {
+  memcpy(layout_, layout, led_count_ * LayoutBytesPerLed);
+  layout_valid_ = true;
+  if (pattern_.pattern != Pattern::OFF) {
+    mapPattern();
+  }
+  DEBUG_INFO("LED layout updated");
+}
+
+void Effects::loadLayout() {
+  /* NVS storage layout:
+   * "layout" namespace:
+   * - "xy" (x, y of all LEDs)
+   * - "crc" (uint32_t, CRC-32 of "xy")
+   */
+  Preferences preferences;
+  preferences.begin("layout", true);
+  size_t length = led_count_ * LayoutBytesPerLed;
+  layout_valid_ = preferences.isKey("xy") == true && preferences.getBytesLength("xy") == length &&
+                  preferences.getBytes("xy", layout_, length) == length &&
+                  preferences.getUInt("crc") == crc32(layout_, length);
+  preferences.end();
+  DEBUG_INFO("LED layout: %s", layout_valid_ ? "loaded" : "none");
+}
+
+bool Effects::saveLayout() {
+  size_t length = led_count_ * LayoutBytesPerLed;
+  Preferences preferences;
+  preferences.begin("layout", false);
+  bool success = preferences.putBytes("xy", layout_, length) == length &&
+                 preferences.putUInt("crc", crc32(layout_, length)) == sizeof(uint32_t);
+  preferences.end();
+  if (success == false) {
+    DEBUG_ERROR("Failed to store LED layout!");
+  }
+  return success;
+}
+
+bool Effects::findPattern(const char name[], Pattern& pattern) {
+  constexpr static const char* PatternNames[] = { "off", "wipe", "ripple", "beam", "noise" };
+  if (name == nullptr) {
+    return false;
+  }
+  for (size_t i = 0; i < sizeof(PatternNames) / sizeof(PatternNames[0]); i++) {
+    if (strcmp(name, PatternNames[i]) == 0) {
+      pattern = static_cast<Pattern>(i);
+      return true;
+    }
+  }
+  return false;
+}
+
+bool Effects::isPatternValid(const PatternParams& params) const {
+  if (params.pattern == Pattern::OFF) {
+    return true;
+  }
+  if (layout_valid_ == false) {
+    DEBUG_ERROR("No LED layout stored!");
+    return false;
+  }
+  if (params.period_ms < PeriodMinMs || params.period_ms > PeriodMaxMs || params.width == 0 ||
+      params.level > PercentMax || params.angle_deg >= 360) {
+    DEBUG_ERROR("Invalid pattern parameters!");
+    return false;
+  }
+  if (params.pattern == Pattern::NOISE && (params.width < NoiseCellMin || params.width > NoiseCellMax)) {
+    DEBUG_ERROR("Invalid noise cell size!");
+    return false;
+  }
+  return true;
+}
+
+bool Effects::setPattern(const PatternParams& params) {
+  if (isPatternValid(params) == false) {
+    return false;
+  }
+
+  bool was_active = isActive();
+  pattern_ = params;
+  pattern_start_ms_ = millis();
+  if (pattern_.pattern != Pattern::OFF) {
+    mapPattern();
+  }
+  DEBUG_INFO("Pattern %u: period %u ms, width %u, level %u", static_cast<uint8_t>(pattern_.pattern),
+             pattern_.period_ms, pattern_.width, pattern_.level);
+
+  if (was_active == false && isActive() == true) {
+    last_frame_ms_ = millis() - FrameIntervalMs;
+  }
+  // Also restore when switching patterns, the new one may not cover all LEDs the old one lit
+  if (was_active == true) {
+    restore_frame_ = true;
+  }
+  return true;
+}
+
+void Effects::mapPattern() {
+  // Position of every LED along the pattern, normalized so one cycle covers the whole layout. This is the only
+  // place with floating point and trigonometry, the frames just compare against the travelled phase.
+  if (pattern_.pattern == Pattern::NOISE) {
+    return;
+  }
+  float angle = pattern_.angle_deg * static_cast<float>(M_PI) / 180.0f;
+  float direction_x = cosf(angle);
+  float direction_y = sinf(angle);
+  float minimum = INFINITY;
+  float maximum = -INFINITY;
+  auto measure = [&](size_t i) -> float {
+    float dx = static_cast<float>(layout_[i * LayoutBytesPerLed]) - pattern_.x;
+    float dy = static_cast<float>(layout_[i * LayoutBytesPerLed + 1]) - pattern_.y;
+    switch (pattern_.pattern) {
+      case Pattern::WIPE:
+        return dx * direction_x + dy * direction_y;
+      case Pattern::RIPPLE:
+        return sqrtf(dx * dx + dy * dy);
+      default:  // BEAM, full turn is 0..1
+        return fmodf(atan2f(dy, dx) - angle + 4.0f * static_cast<float>(M_PI), 2.0f * static_cast<float>(M_PI)) /
+               (2.0f * static_cast<float>(M_PI));
+    }
+  };
+
+  float scale = 256.0f;  // A full turn of the beam is one cycle
+  if (pattern_.pattern == Pattern::BEAM) {
+    minimum = 0.0f;
+  } else {
+    for (size_t i = 0; i < led_count_; i++) {
+      float value = measure(i);
+      minimum = (value < minimum) ? value : minimum;
+      maximum = (value > maximum) ? value : maximum;
+    }
+    scale = (maximum > minimum) ? 255.0f / (maximum - minimum) : 0.0f;
+  }
+  for (size_t i = 0; i < led_count_; i++) {
+    // Bands travel towards higher positions, so the stored position is the distance the band has to cover
+    pattern_position_[i] = static_cast<uint8_t>((measure(i) - minimum) * scale);
+  }
+}
@@ -0,0 +1,104 @@
+#ifndef EFFECTS_H
+#define EFFECTS_H
+
+#include "common.h"
+
+// Procedural effects computed on the device every effect frame:
+// - Star twinkling: every LED that is at its idle value dips below it in random, non-repeating cycles. Each LED
+//   keeps a fixed-point phase, rate and depth, a new rate and depth are drawn whenever a cycle ends.
+// - Spatial patterns: brightness computed from the (x, y) position of each LED (see setLayout) and the time, the
+//   pattern lights LEDs up on top of whatever is shown.
+class Effects {
+ public:
+  enum class Pattern : uint8_t {
+    OFF = 0,
+    WIPE,    // Straight bands travelling across the layout in the direction of the angle
+    RIPPLE,  // Rings travelling outwards from the center
+    BEAM,    // Beam rotating around the center, starting at the angle
+    NOISE,   // Smooth value noise drifting in the direction of the angle, one cell per period
+  };
+
+  struct PatternParams {
+    Pattern pattern;
+    uint8_t x;  // Center of ripple and beam in layout coordinates
+    uint8_t y;
+    uint16_t angle_deg;    // 0..359, 0 points along +x
+    uint32_t period_ms;    // Time of one cycle
+    uint8_t width;         // Band width in 1/256 of a cycle, noise cell size in layout coordinates
+    uint8_t level;         // Peak brightness 0..100
+    uint32_t duration_ms;  // 0 runs until the pattern is replaced
+  };
+
+  constexpr static uint32_t FrameIntervalMs = 20;    // Effect frame rate (50 Hz)
+  constexpr static uint32_t PeriodMinMs = 200;       // Shortest twinkle or pattern cycle
+  constexpr static uint32_t PeriodMaxMs = 60000;     // Longest twinkle or pattern cycle
+  constexpr static uint32_t PeriodDefaultMs = 3000;  // Average twinkle cycle if none is given
+  constexpr static uint8_t DensityDefault = 30;      // Share of the stars twinkling per cycle in percent
+  constexpr static uint8_t PercentMax = 100;
+  constexpr static size_t LayoutBytesPerLed = 2;         // x, y (0..255) of every LED in the order of the idle map
+  constexpr static uint32_t PatternCenterDefault = 128;  // Middle of the layout
+  constexpr static uint32_t PatternWidthDefault = 64;    // Quarter of a cycle
+
+  Effects(const Effects&) = delete;
+  Effects& operator=(const Effects&) = delete;
+
+  static Effects& getInstance() {
+    static Effects instance;
+    return instance;
+  }
+
+  void initialize(size_t led_count);
+  void setTwinkle(uint8_t depth_percent, uint32_t period_ms, uint8_t density_percent);
+  bool isTwinkleEnabled() const;
+  bool isFrameDue();
+  void render(BrgNumber frame[], const BrgNumber active[], const BrgNumber idle[]);
+  int64_t getWakeUpUs() const;  // Next effect frame (see EventLoop::wait)
+
+  bool hasLayout() const;
+  void setLayout(const uint8_t layout[]);  // Takes effect immediately, saveLayout() persists it
+  bool saveLayout();                       // NVS write, runs on the storage worker
+  bool isPatternValid(const PatternParams& params) const;
+  bool setPattern(const PatternParams& params);
+  static bool findPattern(const char name[], Pattern& pattern);
+
+ private:
+  constexpr static uint32_t PhaseBits = 20;  // One twinkle cycle, rates are phase steps per millisecond
+  constexpr static uint32_t PhaseCycle = 1UL << PhaseBits;
+  constexpr static uint8_t NoiseCellMin = 4;    // Smaller cells alias on the LED grid
+  constexpr static uint8_t NoiseCellMax = 128;  // Larger cells show no structure across the layout
+
+  struct TwinkleState {
+    uint32_t phase;  // 0..PhaseCycle
+    uint16_t rate;   // Phase increment per millisecond
+    uint8_t depth;   // Dip of this cycle, 0..255 of the idle value
+    uint8_t reserved;
+  };
+
+  Effects() = default;
+  bool isActive() const;
+  uint32_t nextRandom();
+  void startCycle(TwinkleState& state);
+  void renderTwinkle(BrgNumber frame[], const BrgNumber active[], const BrgNumber idle[], uint32_t elapsed_ms);
+  void renderPattern(BrgNumber frame[], uint32_t now_ms);
+  void loadLayout();
+  void mapPattern();
+  static uint8_t noise(int32_t x, int32_t y);
+
+  TwinkleState* states_ = nullptr;
+  size_t led_count_ = 0;
+  uint32_t random_state_ = 0x9E3779B9;
+
+  uint8_t* layout_ = nullptr;  // x, y per LED
+  bool layout_valid_ = false;
+  uint8_t* pattern_position_ = nullptr;  // Position of each LED along the pattern (0..255 is one cycle)
+  PatternParams pattern_ = {};
+  uint32_t pattern_start_ms_ = 0;
+
+  uint8_t depth_ = 0;           // Maximum dip 0..255, 0 disables the effect
+  uint16_t rate_ = 0;           // Phase increment per millisecond of the average cycle
+  uint8_t density_ = 0;         // Chance 0..255 that a star twinkles in a cycle
+  bool restore_frame_ = false;  // One more frame after disabling, restores the plain idle values
+  uint32_t last_frame_ms_ = 0;
+};
+
+#endif  // EFFECTS_H
@@ -0,0 +1,90 @@
+#include "EventLoop.h"
+
+#define LOG_LEVEL_EVENTLOOP LOG_LEVEL_INFO
+#if ((LOG_LEVEL_EVENTLOOP >= LOG_LEVEL_ERROR) && (ENABLE_DEBUG_OUTPUT == 1))
+#define DEBUG_ERROR(f, ...) debugPrint("[ERR][Events]", f, ##__VA_ARGS__)
+#else
+#define DEBUG_ERROR(...)
+#endif
+#if ((LOG_LEVEL_EVENTLOOP >= LOG_LEVEL_INFO) && (ENABLE_DEBUG_OUTPUT == 1))
+#define DEBUG_INFO(f, ...) debugPrint("[INF][Events]", f, ##__VA_ARGS__)
+#else
+#define DEBUG_INFO(...)
+#endif
+
+void EventLoop::initialize() {
+  DEBUG_INFO("Initialize EventLoop [...]");
+  events_ = xEventGroupCreate();
+
+  esp_timer_create_args_t timer_args = {};
+  timer_args.callback = frameTickCallback;
+  timer_args.arg = this;
+  timer_args.name = "frame_tick";
+  ESP_ERROR_CHECK(esp_timer_create(&timer_args, &frame_timer_));
+
+#if (ENABLE_POWER_MANAGEMENT == 1) && defined(CONFIG_PM_ENABLE)
+  // Scale down while idle, light sleep additionally needs tickless idle in the SDK configuration
+#if ESP_IDF_VERSION_MAJOR >= 5
+  esp_pm_config_t pm_config = {};
+#else
+  esp_pm_config_esp32s3_t pm_config = {};
+#endif
+  pm_config.max_freq_mhz = MaxCpuFrequencyMhz;
+  pm_config.min_freq_mhz = MinCpuFrequencyMhz;
+#if defined(CONFIG_FREERTOS_USE_TICKLESS_IDLE)
+  pm_config.light_sleep_enable = true;
+#endif
+  esp_err_t error = esp_pm_configure(&pm_config);
+  if (error != ESP_OK) {
+    DEBUG_ERROR("Power management not available (%s)!", esp_err_to_name(error));
+  }
+  esp_pm_lock_create(ESP_PM_CPU_FREQ_MAX, 0, "animate", &cpu_lock_);
+  esp_pm_lock_create(ESP_PM_NO_LIGHT_SLEEP, 0, "animate", &sleep_lock_);
+#else
+  DEBUG_INFO("Power management disabled");
+#endif
+  DEBUG_INFO("Initialize EventLoop [OK]");
+}
+
+void EventLoop::notify(EventBits_t events) {
+  if (events_ != nullptr) {
+    xEventGroupSetBits(events_, events);
+  }
+}
+
+EventBits_t EventLoop::wait(int64_t wake_up_us) {
+  setFrameTick(wake_up_us == WakeUpFrameTick);
+
+  TickType_t timeout = portMAX_DELAY;
+  if (wake_up_us != WakeUpFrameTick && wake_up_us != WakeUpOnEvent) {
+    int64_t remaining_us = wake_up_us - esp_timer_get_time();
+    timeout = (remaining_us > 0) ? pdMS_TO_TICKS((remaining_us + 999) / 1000) : 0;
+  }
+  // Bits set while the loop was busy are still pending, so no event is lost between two waits
+  return xEventGroupWaitBits(events_, EVENT_ALL, pdTRUE, pdFALSE, timeout);
+}
+
+void EventLoop::setFrameTick(bool enabled) {
+  if (enabled == frame_tick_enabled_) {
+    return;
+  }
+  frame_tick_enabled_ = enabled;
+
+  if (enabled == true) {
+#if (ENABLE_POWER_MANAGEMENT == 1) && defined(CONFIG_PM_ENABLE)
+    esp_pm_lock_acquire(cpu_lock_);
+    esp_pm_lock_acquire(sleep_lock_);
+#endif
+    esp_timer_start_periodic(frame_timer_, FrameTickUs);
+  } else {
+    esp_timer_stop(frame_timer_);
+#if (ENABLE_POWER_MANAGEMENT == 1) && defined(CONFIG_PM_ENABLE)
+    esp_pm_lock_release(sleep_lock_);
+    esp_pm_lock_release(cpu_lock_);
+#endif
+  }
+}
+
+void EventLoop::frameTickCallback(void* parameter) {
+  static_cast<EventLoop*>(parameter)->notify(EVENT_FRAME_TICK);
+}
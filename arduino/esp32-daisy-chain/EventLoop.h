@@ -0,0 +1,56 @@
+#ifndef EVENT_LOOP_H
+#define EVENT_LOOP_H
+
+#include <freertos/event_groups.h>
+#include "common.h"
+#include "esp_timer.h"
+#if (ENABLE_POWER_MANAGEMENT == 1) && defined(CONFIG_PM_ENABLE)
+#include "esp_pm.h"
+#endif
+
+// Lets the Arduino loop task block until there is something to do instead of spinning. The BLE host task, the
+// storage task and the frame timer set event bits, the modules report when they have to run next on their own.
+class EventLoop {
+ public:
+  constexpr static EventBits_t EVENT_RX_DATA = BIT0;     // Request data received
+  constexpr static EventBits_t EVENT_TX_CONFIRM = BIT1;  // Indication confirmed by the client
+  constexpr static EventBits_t EVENT_BLE_STATE = BIT2;   // Connection, subscription or MTU changed
+  constexpr static EventBits_t EVENT_STORAGE = BIT3;     // Storage job finished
+  constexpr static EventBits_t EVENT_FRAME_TICK = BIT4;  // Frame timer expired
+  constexpr static EventBits_t EVENT_ALL = EVENT_RX_DATA | EVENT_TX_CONFIRM | EVENT_BLE_STATE | EVENT_STORAGE |  //
+                                           EVENT_FRAME_TICK;
+
+  constexpr static int64_t WakeUpFrameTick = 0;        // Run at the frame rate, e.g. while a show is playing
+  constexpr static int64_t WakeUpOnEvent = INT64_MAX;  // Nothing to do until an event arrives
+
+  EventLoop(const EventLoop&) = delete;
+  EventLoop& operator=(const EventLoop&) = delete;
+
+  static EventLoop& getInstance() {
+    static EventLoop instance;
+    return instance;
+  }
+
+  void initialize();
+  void notify(EventBits_t events);
+  EventBits_t wait(int64_t wake_up_us);
+
+ private:
+  constexpr static uint64_t FrameTickUs = 1000;  // Loop period while animating, below the 5 ms ramp tick
+  constexpr static uint32_t MaxCpuFrequencyMhz = 240;
+  constexpr static uint32_t MinCpuFrequencyMhz = 80;  // Lowest frequency keeping the APB (SPI, UART) at 80 MHz
+
+  EventLoop() = default;
+  static void frameTickCallback(void* parameter);
+  void setFrameTick(bool enabled);
+
+  EventGroupHandle_t events_ = nullptr;
+  esp_timer_handle_t frame_timer_ = nullptr;
+  bool frame_tick_enabled_ = false;
+#if (ENABLE_POWER_MANAGEMENT == 1) && defined(CONFIG_PM_ENABLE)
+  esp_pm_lock_handle_t cpu_lock_ = nullptr;    // Full speed while animating
+  esp_pm_lock_handle_t sleep_lock_ = nullptr;  // No light sleep while animating
+#endif
+};
+
+#endif  // EVENT_LOOP_H
@@ -0,0 +1,157 @@
+#include "Keyframes.h"
+#include "DaisyChain.h"
+#include "EventLoop.h"
+#include "esp_timer.h"
+
+#define LOG_LEVEL_KEYFRAMES LOG_LEVEL_INFO
+#if ((LOG_LEVEL_KEYFRAMES >= LOG_LEVEL_ERROR) && (ENABLE_DEBUG_OUTPUT == 1))
+#define DEBUG_ERROR(f, ...) debugPrint("[ERR][Keyframes]", f, ##__VA_ARGS__)
+#else
+#define DEBUG_ERROR(...)
+#endif
+#if ((LOG_LEVEL_KEYFRAMES >= LOG_LEVEL_INFO) && (ENABLE_DEBUG_OUTPUT == 1))
+#define DEBUG_INFO(f, ...) debugPrint("[INF][Keyframes]", f, ##__VA_ARGS__)
+#else
+#define DEBUG_INFO(...)
+#endif
+
+bool Keyframes::push(int64_t at_us, Curve curve, const LedObj leds[], size_t count) {
+  if (count_ == MaxKeyframes || count > MaxEntries - entry_count_) {
+    DEBUG_ERROR("Keyframe buffer full!");
+    return false;
+  }
+  if (count_ > 0 && at_us < keyframes_[(head_ + count_ - 1) % MaxKeyframes].at_us) {
+    DEBUG_ERROR("Keyframe out of order!");
+    return false;
+  }
+
+  Keyframe& keyframe = keyframes_[(head_ + count_) % MaxKeyframes];
+  keyframe.at_us = at_us;
+  keyframe.queued_us = esp_timer_get_time();
+  keyframe.first = (entry_head_ + entry_count_) % MaxEntries;
+  keyframe.count = count;
+  keyframe.curve = curve;
+  for (size_t i = 0; i < count; i++) {
+    getEntry(keyframe, i).led = leds[i];
+  }
+  entry_count_ += count;
+  count_++;
+  return true;
+}
+
+void Keyframes::clear() {
+  head_ = 0;
+  count_ = 0;
+  entry_head_ = 0;
+  entry_count_ = 0;
+  transition_started_ = false;
+  last_keyframe_us_ = 0;
+}
+
+bool Keyframes::isIdle() const {
+  return count_ == 0;
+}
+
+size_t Keyframes::getFreeKeyframes() const {
+  return MaxKeyframes - count_;
+}
+
+bool Keyframes::findCurve(const char name[], Curve& curve) {
+  constexpr static const char* CurveNames[] = { "linear", "ease", "step" };
+  if (name == nullptr) {
+    return false;
+  }
+  for (size_t i = 0; i < sizeof(CurveNames) / sizeof(CurveNames[0]); i++) {
+    if (strcmp(name, CurveNames[i]) == 0) {
+      curve = static_cast<Curve>(i);
+      return true;
+    }
+  }
+  return false;
+}
+
+int64_t Keyframes::getWakeUpUs() const {
+  if (count_ == 0) {
+    return EventLoop::WakeUpOnEvent;
+  }
+  const Keyframe& keyframe = keyframes_[head_];
+  if (keyframe.curve == Curve::STEP) {
+    return keyframe.at_us;
+  }
+  int64_t next_frame_us = last_frame_us_ + FrameIntervalUs;
+  return (keyframe.at_us < next_frame_us) ? keyframe.at_us : next_frame_us;
+}
+
+void Keyframes::run() {
+  if (count_ == 0) {
+    return;
+  }
+  int64_t now_us = esp_timer_get_time();
+  if (now_us - last_frame_us_ < static_cast<int64_t>(FrameIntervalUs) && now_us < keyframes_[head_].at_us) {
+    return;
+  }
+  last_frame_us_ = now_us;
+
+  // Reach all keyframes that are due, a late arrival or a stalled loop may have made several of them due at once
+  while (count_ > 0) {
+    Keyframe& keyframe = keyframes_[head_];
+    if (transition_started_ == false) {
+      startTransition(keyframe);
+    }
+
+    if (now_us >= keyframe.at_us) {
+      for (size_t i = 0; i < keyframe.count; i++) {
+        DaisyChain::getInstance().setActiveLeds(&getEntry(keyframe, i).led, 1);
+      }
+      last_keyframe_us_ = keyframe.at_us;
+      pop();
+      continue;
+    }
+
+    if (keyframe.curve == Curve::STEP) {
+      return;
+    }
+    // Progress 0..256 of the transition, eased with 3p^2 - 2p^3 if requested
+    uint32_t progress = static_cast<uint32_t>(((now_us - transition_start_us_) << 8) /  //
+                                              (keyframe.at_us - transition_start_us_));
+    if (keyframe.curve == Curve::EASE) {
+      progress = (progress * progress * (3 * 256 - 2 * progress)) >> 16;
+    }
+    for (size_t i = 0; i < keyframe.count; i++) {
+      Entry& entry = getEntry(keyframe, i);
+      LedObj led = entry.led;
+      int32_t delta = static_cast<int32_t>(entry.led.brightness) - entry.start;
+      led.brightness = static_cast<BrgNumber>(entry.start + ((delta * static_cast<int32_t>(progress)) >> 8));
+      DaisyChain::getInstance().setActiveLeds(&led, 1);
+    }
+    return;
+  }
+}
+
+void Keyframes::startTransition(Keyframe& keyframe) {
+  // The transition starts at the previous keyframe, unless this one arrived after that
+  transition_start_us_ = (keyframe.queued_us > last_keyframe_us_) ? keyframe.queued_us : last_keyframe_us_;
+  for (size_t i = 0; i < keyframe.count; i++) {
+    Entry& entry = getEntry(keyframe, i);
+    LedObj led = entry.led;
+    DaisyChain::getInstance().getActiveLeds(&led, 1);
+    entry.start = led.brightness;
+  }
+  transition_started_ = true;
+}
+
+void Keyframes::pop() {
+  const Keyframe& keyframe = keyframes_[head_];
+  entry_head_ = (entry_head_ + keyframe.count) % MaxEntries;
+  entry_count_ -= keyframe.count;
+  head_ = (head_ + 1) % MaxKeyframes;
+  count_--;
+  transition_started_ = false;
+  if (count_ == 0) {
+    DEBUG_INFO("Keyframe buffer drained");
+  }
+}
+
+Keyframes::Entry& Keyframes::getEntry(const Keyframe& keyframe, size_t index) {
+  return entries_[(keyframe.first + index) % MaxEntries];
+}
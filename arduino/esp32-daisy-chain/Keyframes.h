@@ -0,0 +1,69 @@
+#ifndef KEYFRAMES_H
+#define KEYFRAMES_H
+
+#include "common.h"
+
+// Streams sparse, time-stamped keyframes from the host and interpolates between them on the device, so a few
+// keyframes per second over BLE still give a smooth output. Every keyframe sets a target for its own LED set at its
+// time, the LEDs move there from their value at the previous keyframe (or the arrival, if it came late). The queue
+// is the lookahead buffer that rides out gaps of the link, if it runs dry the LEDs hold their last value.
+class Keyframes {
+ public:
+  constexpr static size_t MaxKeyframes = 32;          // Lookahead buffer, e.g. 6 s at 5 keyframes per second
+  constexpr static size_t MaxEntries = 2048;          // LED values of all buffered keyframes
+  constexpr static uint32_t FrameIntervalUs = 10000;  // Interpolation rate (100 Hz)
+
+  enum class Curve : uint8_t {
+    LINEAR = 0,
+    EASE,  // Smoothstep, starts and ends slowly
+    STEP,  // Holds the previous value and jumps at the keyframe time
+  };
+
+  Keyframes(const Keyframes&) = delete;
+  Keyframes& operator=(const Keyframes&) = delete;
+
+  static Keyframes& getInstance() {
+    static Keyframes instance;
+    return instance;
+  }
+
+  bool push(int64_t at_us, Curve curve, const LedObj leds[], size_t count);
+  void clear();
+  bool isIdle() const;
+  size_t getFreeKeyframes() const;
+  void run();
+  int64_t getWakeUpUs() const;  // Next interpolation step or keyframe (see EventLoop::wait)
+  static bool findCurve(const char name[], Curve& curve);
+
+ private:
+  struct Keyframe {
+    int64_t at_us;      // Device time (esp_timer) the LEDs reach their targets
+    int64_t queued_us;  // Arrival, a late keyframe starts its transition here
+    size_t first;       // First entry in entries_ (wraps around)
+    size_t count;
+    Curve curve;
+  };
+  struct Entry {
+    LedObj led;       // Target brightness
+    BrgNumber start;  // Brightness at the start of the transition, captured when it begins
+  };
+
+  Keyframes() = default;
+  void startTransition(Keyframe& keyframe);
+  void pop();
+  Entry& getEntry(const Keyframe& keyframe, size_t index);
+
+  Keyframe keyframes_[MaxKeyframes];
+  size_t head_ = 0;
+  size_t count_ = 0;
+  Entry entries_[MaxEntries];
+  size_t entry_head_ = 0;
+  size_t entry_count_ = 0;
+
+  bool transition_started_ = false;
+  int64_t transition_start_us_ = 0;
+  int64_t last_keyframe_us_ = 0;  // Time of the last reached keyframe
+  int64_t last_frame_us_ = 0;
+};
+
+#endif  // KEYFRAMES_H
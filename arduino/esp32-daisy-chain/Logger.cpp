@@ -0,0 +1,208 @@
+#include "Logger.h"
+
+static const char* const ConversionChars = "diouxXcsfFeEgGaAp";
+static const char* const LengthModifiers = "hlLqjzt";
+
+Logger::Logger() {
+  for (size_t i = 0; i < Capacity; i++) {
+    ring_[i].sequence.store(i, std::memory_order_relaxed);
+  }
+}
+
+void Logger::initialize() {
+  // Messages logged before are kept in the ring and printed once the task runs
+  xTaskCreatePinnedToCore(taskFunction, "logger", TaskStackSize, this, TaskPriority, &task_, TaskCore);
+}
+
+Logger::Entry* Logger::acquire(uint32_t& position) {
+  // Bounded multi-producer queue, the loop task and the BLE host task log concurrently
+  position = head_.load(std::memory_order_relaxed);
+  while (true) {
+    Entry& entry = ring_[position & (Capacity - 1)];
+    int32_t diff = static_cast<int32_t>(entry.sequence.load(std::memory_order_acquire) - position);
+    if (diff == 0) {
+      if (head_.compare_exchange_weak(position, position + 1, std::memory_order_relaxed) == true) {
+        return &entry;
+      }
+    } else if (diff < 0) {
+      dropped_.fetch_add(1, std::memory_order_relaxed);
+      return nullptr;
+    } else {
+      position = head_.load(std::memory_order_relaxed);
+    }
+  }
+}
+
+void Logger::publish(Entry& entry, uint32_t position) {
+  entry.sequence.store(position + 1, std::memory_order_release);
+}
+
+void Logger::copyStrings(Entry& entry) {
+  // Walk the conversions of the format string to find the arguments printed with '%s' and their precision
+  size_t arg = 0;
+  size_t text_length = 0;
+  for (const char* p = entry.fmt; *p != '\0' && arg < entry.arg_count; p++) {
+    if (*p != '%') {
+      continue;
+    }
+    p++;
+    if (*p == '%') {
+      continue;
+    }
+
+    int32_t precision = -1;
+    while (*p != '\0' && strchr(ConversionChars, *p) == nullptr) {
+      if (*p == '*' && arg < entry.arg_count) {
+        arg++;  // Width argument
+      } else if (*p == '.') {
+        precision = 0;
+        if (*(p + 1) == '*' && arg < entry.arg_count) {
+          precision = static_cast<int32_t>(entry.values[arg++]);
+          p++;
+        }
+      } else if (precision >= 0 && *p >= '0' && *p <= '9') {
+        precision = precision * 10 + (*p - '0');
+      }
+      p++;
+    }
+    if (*p == '\0' || arg >= entry.arg_count) {
+      break;
+    }
+
+    if (*p == 's' && entry.types[arg] == ArgType::POINTER) {
+      const char* string = reinterpret_cast<const char*>(static_cast<uintptr_t>(entry.values[arg]));
+      if (string == nullptr) {
+        string = "(null)";
+      }
+      size_t available = TextSize - 1 - text_length;
+      if (precision >= 0 && static_cast<size_t>(precision) < available) {
+        available = precision;
+      }
+      size_t length = strnlen(string, available);
+      memcpy(entry.text + text_length, string, length);
+      entry.text[text_length + length] = '\0';
+      entry.values[arg] = text_length;
+      entry.types[arg] = ArgType::TEXT;
+      text_length += length;
+      if (text_length < TextSize - 1) {
+        text_length++;  // Keep the terminator, a full buffer leaves the following strings empty
+      }
+    }
+    arg++;
+  }
+}
+
+bool Logger::drain(char line[], size_t size) {
+  Entry& entry = ring_[tail_ & (Capacity - 1)];
+  if (entry.sequence.load(std::memory_order_acquire) != tail_ + 1) {
+    return false;
+  }
+
+  uint32_t sec = (entry.ms / 1000) & 0x0F;  // wrap seconds 0..15
+  uint16_t msec = entry.ms % 1000;
+  int length = snprintf(line, size, "[%u.%03u] %s: ", static_cast<unsigned>(sec), msec, entry.prefix);
+  size_t used = (length > 0 && static_cast<size_t>(length) < size) ? length : size - 1;
+  used += format(entry, line + used, size - used);
+
+  // Hand the slot back before the slow UART output
+  entry.sequence.store(tail_ + Capacity, std::memory_order_release);
+  tail_++;
+
+  Serial.write(reinterpret_cast<const uint8_t*>(line), used);
+  Serial.write(reinterpret_cast<const uint8_t*>("\n"), 1);
+  return true;
+}
+
+size_t Logger::format(const Entry& entry, char out[], size_t size) const {
+  // Every conversion is printed on its own with a length modifier matching the stored argument type
+  size_t used = 0;
+  size_t arg = 0;
+  for (const char* p = entry.fmt; *p != '\0' && used + 1 < size; p++) {
+    if (*p != '%' || *(p + 1) == '%') {
+      out[used++] = *p;
+      p += (*p == '%') ? 1 : 0;
+      continue;
+    }
+
+    char spec[32] = "%";
+    size_t spec_length = 1;
+    for (p++; *p != '\0' && strchr(ConversionChars, *p) == nullptr; p++) {
+      if (*p == '*') {
+        int value = (arg < entry.arg_count) ? static_cast<int>(entry.values[arg++]) : 0;
+        spec_length += snprintf(spec + spec_length, sizeof(spec) - spec_length, "%d", value);
+      } else if (strchr(LengthModifiers, *p) == nullptr && spec_length < sizeof(spec) - 4) {
+        spec[spec_length++] = *p;
+      }
+    }
+    if (*p == '\0') {
+      break;
+    }
+    if (arg >= entry.arg_count) {
+      out[used++] = '?';
+      continue;
+    }
+
+    char conversion = *p;
+    uint64_t value = entry.values[arg];
+    ArgType type = entry.types[arg++];
+    int length = 0;
+    switch (type) {
+      case ArgType::INT:
+      case ArgType::INT64: {
+        if (strchr("diouxXc", conversion) == nullptr) {
+          conversion = 'd';
+        }
+        bool is_signed = (conversion == 'd' || conversion == 'i');
+        if (type == ArgType::INT64) {
+          spec[spec_length++] = 'l';
+          spec[spec_length++] = 'l';
+        }
+        spec[spec_length++] = conversion;
+        spec[spec_length] = '\0';
+        if (type == ArgType::INT64) {
+          length = is_signed ? snprintf(out + used, size - used, spec, static_cast<long long>(value))
+                             : snprintf(out + used, size - used, spec, static_cast<unsigned long long>(value));
+        } else {
+          length = is_signed ? snprintf(out + used, size - used, spec, static_cast<int>(value))
+                             : snprintf(out + used, size - used, spec, static_cast<unsigned>(value));
+        }
+        break;
+      }
+      case ArgType::DOUBLE: {
+        double number;
+        memcpy(&number, &value, sizeof(number));
+        spec[spec_length++] = (strchr("fFeEgGaA", conversion) == nullptr) ? 'f' : conversion;
+        spec[spec_length] = '\0';
+        length = snprintf(out + used, size - used, spec, number);
+        break;
+      }
+      case ArgType::TEXT:
+        spec[spec_length++] = 's';
+        spec[spec_length] = '\0';
+        length = snprintf(out + used, size - used, spec, entry.text + value);
+        break;
+      case ArgType::POINTER:
+        length = snprintf(out + used, size - used, "%p", reinterpret_cast<void*>(static_cast<uintptr_t>(value)));
+        break;
+    }
+    if (length > 0) {
+      used += (static_cast<size_t>(length) < size - used) ? length : size - used - 1;
+    }
+  }
+  return used;
+}
+
+void Logger::taskFunction(void* parameter) {
+  Logger* logger = static_cast<Logger*>(parameter);
+  char line[LineSize];
+  while (true) {
+    uint32_t dropped = logger->dropped_.exchange(0, std::memory_order_relaxed);
+    if (dropped > 0) {
+      int length = snprintf(line, sizeof(line), "[LOG] %u messages dropped\n", static_cast<unsigned>(dropped));
+      Serial.write(reinterpret_cast<const uint8_t*>(line), length);
+    }
+    if (logger->drain(line, sizeof(line)) == false) {
+      vTaskDelay(pdMS_TO_TICKS(DrainIntervalMs));
+    }
+  }
+}
@@ -0,0 +1,112 @@
+#ifndef LOGGER_H
+#define LOGGER_H
+
+#include <Arduino.h>
+#include <atomic>
+#include <type_traits>
+
+// Deferred logger: the caller only stores the format string pointer and the raw arguments in a lock-free ring,
+// formatting and the UART output happen in a low priority task. String arguments are copied, because the
+// buffers they point to are usually gone by the time the message is printed.
+class Logger {
+ public:
+  constexpr static size_t Capacity = 64;  // Messages in the ring, must be a power of two
+  static_assert((Capacity & (Capacity - 1)) == 0, "Capacity must be a power of two");
+  constexpr static size_t MaxArgs = 8;     // Maximum number of arguments of a single message
+  constexpr static size_t TextSize = 96;  // Storage for copied string arguments of a single message
+
+  Logger(const Logger&) = delete;
+  Logger& operator=(const Logger&) = delete;
+
+  static Logger& getInstance() {
+    static Logger instance;
+    return instance;
+  }
+
+  void initialize();
+
+  template <typename... Args>
+  void write(const char* prefix, const char* fmt, Args... args) {
+    static_assert(sizeof...(Args) <= MaxArgs, "Too many arguments for a single log message");
+    uint32_t position = 0;
+    Entry* entry = acquire(position);
+    if (entry == nullptr) {
+      return;
+    }
+    entry->ms = millis();
+    entry->prefix = prefix;
+    entry->fmt = fmt;
+    entry->arg_count = 0;
+    (store(*entry, args), ...);
+    copyStrings(*entry);
+    publish(*entry, position);
+  }
+
+ private:
+  constexpr static uint32_t TaskStackSize = 4096;  // Stack size of the drain task in bytes
+  constexpr static UBaseType_t TaskPriority = 1;   // Below the Arduino loop task, output is never urgent
+  constexpr static BaseType_t TaskCore = 0;        // Keep the render loop core (1) free
+  constexpr static uint32_t DrainIntervalMs = 10;  // Poll interval of the drain task while the ring is empty
+  constexpr static size_t LineSize = 256;          // Longest printed line, longer messages are truncated
+
+  enum class ArgType : uint8_t {
+    INT = 0,
+    INT64,
+    DOUBLE,
+    POINTER,
+    TEXT,  // POINTER consumed by a '%s' conversion, the value is the offset into Entry::text
+  };
+
+  struct Entry {
+    std::atomic<uint32_t> sequence;  // Ring position the slot is free (position) or published (position + 1) for
+    uint32_t ms;
+    const char* prefix;
+    const char* fmt;
+    uint8_t arg_count;
+    ArgType types[MaxArgs];
+    uint64_t values[MaxArgs];
+    char text[TextSize];
+  };
+
+  Logger();
+  static void taskFunction(void* parameter);
+
+  Entry* acquire(uint32_t& position);
+  void publish(Entry& entry, uint32_t position);
+  void copyStrings(Entry& entry);
+  bool drain(char line[], size_t size);
+  size_t format(const Entry& entry, char out[], size_t size) const;
+
+  template <typename T>
+  void store(Entry& entry, T value) {
+    uint8_t index = entry.arg_count++;
+    if constexpr (std::is_floating_point<T>::value) {
+      double number = value;
+      memcpy(&entry.values[index], &number, sizeof(number));
+      entry.types[index] = ArgType::DOUBLE;
+    } else if constexpr (std::is_pointer<T>::value) {
+      entry.values[index] = reinterpret_cast<uintptr_t>(value);
+      entry.types[index] = ArgType::POINTER;
+    } else if constexpr (sizeof(T) > sizeof(uint32_t)) {
+      entry.values[index] = static_cast<uint64_t>(value);
+      entry.types[index] = ArgType::INT64;
+    } else {
+      entry.values[index] = static_cast<uint32_t>(value);
+      entry.types[index] = ArgType::INT;
+    }
+  }
+
+  Entry ring_[Capacity];
+  std::atomic<uint32_t> head_{ 0 };     // Next ring position to be written
+  uint32_t tail_ = 0;                   // Next ring position to be printed, only used by the drain task
+  std::atomic<uint32_t> dropped_{ 0 };  // Messages lost because the ring was full
+  TaskHandle_t task_ = nullptr;
+};
+
+// Replaces the former synchronous Serial.printf() based implementation, called by the per-module DEBUG_X macros
+template <typename... Args>
+inline void debugPrint(const char* prefix, const char* fmt, Args... args) {
+  Logger::getInstance().write(prefix, fmt, args...);
+}
+
+#endif  // LOGGER_H
@@ -0,0 +1,52 @@
+#include "Lzss.h"
+
+void LzssDecoder::begin(uint8_t output[], size_t capacity) {
+  output_ = output;
+  capacity_ = capacity;
+  length_ = 0;
+  flags_ = 0;
+  flag_count_ = 0;
+  match_pending_ = false;
+}
+
+size_t LzssDecoder::getLength() const {
+  return length_;
+}
+
+bool LzssDecoder::decode(const uint8_t data[], size_t length) {
+  for (size_t i = 0; i < length; i++) {
+    uint8_t byte = data[i];
+
+    if (flag_count_ == 0) {
+      flags_ = byte;
+      flag_count_ = 8;
+      continue;
+    }
+
+    if ((flags_ & 0x01) != 0) {
+      if (length_ == capacity_) {
+        return false;
+      }
+      output_[length_++] = byte;
+    } else if (match_pending_ == false) {
+      match_low_ = byte;
+      match_pending_ = true;
+      continue;  // The item is complete with the next byte
+    } else {
+      match_pending_ = false;
+      size_t distance = (match_low_ | ((byte & 0xF0) << 4)) + 1;
+      size_t count = (byte & 0x0F) + MatchLengthMin;
+      if (distance > length_ || count > capacity_ - length_) {
+        return false;
+      }
+      // Byte by byte, a match may overlap the bytes it produces (e.g. runs)
+      for (size_t n = 0; n < count; n++) {
+        output_[length_] = output_[length_ - distance];
+        length_++;
+      }
+    }
+    flags_ >>= 1;
+    flag_count_--;
+  }
+  return true;
+}
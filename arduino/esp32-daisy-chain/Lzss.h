@@ -0,0 +1,30 @@
+#ifndef LZSS_H
+#define LZSS_H
+
+#include "common.h"
+
+// Streaming decoder of the LZSS format the ConfigTool packs large requests with (see tools/ConfigTool/Lzss.py).
+// A flag byte announces the next 8 items, LSB first: 1 is a literal byte, 0 a match of two bytes referring back into
+// the output ((distance - 1) in 12 bits, (length - 3) in 4 bits). The output is the window, so no extra RAM is needed.
+class LzssDecoder {
+ public:
+  constexpr static size_t WindowSize = 4096;  // Farthest distance of a match
+  constexpr static size_t MatchLengthMin = 3;
+  constexpr static size_t MatchLengthMax = 18;
+
+  void begin(uint8_t output[], size_t capacity);
+  bool decode(const uint8_t data[], size_t length);  // Input may be split anywhere, false on corrupt data or overflow
+  size_t getLength() const;  // Decoded bytes so far
+
+ private:
+  uint8_t* output_ = nullptr;
+  size_t capacity_ = 0;
+  size_t length_ = 0;
+
+  uint8_t flags_ = 0;
+  uint8_t flag_count_ = 0;  // Items left of the current flag byte
+  uint8_t match_low_ = 0;   // First byte of a match split between two chunks
+  bool match_pending_ = false;
+};
+
+#endif  // LZSS_H
@@ -0,0 +1,134 @@
+#include "Metrics.h"
+
+static const char* const CounterNames[] = {
+  "rx_bytes", "rx_requests", "rx_timeouts", "tx_bytes", "tx_timeouts", "chain_flushes", "rx_duplicates",
+};
+static_assert(sizeof(CounterNames) / sizeof(CounterNames[0]) == static_cast<size_t>(Metrics::Counter::COUNT),
+              "Counter name missing");
+
+static const char* const HistogramNames[] = {
+  "loop_period", "spi_transfer", "json_parse", "ble_tx_chunk_rtt", "flush_chain_0", "flush_chain_1",
+  "flush_chain_2", "flush_chain_3", "flush_chain_4", "flush_chain_5", "flush_chain_6", "flush_chain_7",
+};
+static_assert(sizeof(HistogramNames) / sizeof(HistogramNames[0]) == static_cast<size_t>(Metrics::Histogram::COUNT),
+              "Histogram name missing");
+
+static const char* const BootStageNames[] = {
+  "first_frame_us",
+  "ble_ready_us",
+};
+static_assert(sizeof(BootStageNames) / sizeof(BootStageNames[0]) == static_cast<size_t>(Metrics::BootStage::COUNT),
+              "Boot stage name missing");
+
+void Metrics::reset() {
+  portENTER_CRITICAL(&mux_);
+  memset(counters_, 0, sizeof(counters_));
+  memset(histograms_, 0, sizeof(histograms_));
+  reset_ms_ = millis();
+  rx_window_start_ms_ = reset_ms_;
+  rx_window_bytes_ = 0;
+  rx_peak_bytes_per_s_ = 0;
+  portEXIT_CRITICAL(&mux_);
+}
+
+void Metrics::count(Counter id, uint32_t value) {
+  portENTER_CRITICAL(&mux_);
+  counters_[static_cast<size_t>(id)] += value;
+  portEXIT_CRITICAL(&mux_);
+}
+
+void Metrics::record(Histogram id, uint32_t duration_us) {
+  // Index of the highest set bit selects the bucket, no division or loop on the hot path
+  size_t bucket = 0;
+  if (duration_us >= BucketMinUs) {
+    bucket = (31 - __builtin_clz(duration_us)) - 3;
+    if (bucket >= BucketCount) {
+      bucket = BucketCount - 1;
+    }
+  }
+
+  portENTER_CRITICAL(&mux_);
+  HistogramData& histogram = histograms_[static_cast<size_t>(id)];
+  histogram.count++;
+  histogram.sum_us += duration_us;
+  if (duration_us > histogram.max_us) {
+    histogram.max_us = duration_us;
+  }
+  histogram.buckets[bucket]++;
+  portEXIT_CRITICAL(&mux_);
+}
+
+void Metrics::recordChainFlush(size_t chain, uint32_t duration_us) {
+  if (chain >= CHAIN_COUNT_MAX) {
+    return;
+  }
+  record(static_cast<Histogram>(static_cast<size_t>(Histogram::FLUSH_CHAIN_0) + chain), duration_us);
+  count(Counter::CHAIN_FLUSHES);
+}
+
+void Metrics::recordRx(size_t bytes) {
+  uint32_t now_ms = millis();
+
+  portENTER_CRITICAL(&mux_);
+  counters_[static_cast<size_t>(Counter::RX_BYTES)] += bytes;
+  if (now_ms - rx_window_start_ms_ >= RateWindowMs) {
+    uint32_t rate = (rx_window_bytes_ * 1000ULL) / (now_ms - rx_window_start_ms_);
+    if (rate > rx_peak_bytes_per_s_) {
+      rx_peak_bytes_per_s_ = rate;
+    }
+    rx_window_start_ms_ = now_ms;
+    rx_window_bytes_ = 0;
+  }
+  rx_window_bytes_ += bytes;
+  portEXIT_CRITICAL(&mux_);
+}
+
+void Metrics::recordBootStage(BootStage stage) {
+  // Only the first occurrence counts
+  size_t index = static_cast<size_t>(stage);
+  if (boot_stages_us_[index] == 0) {
+    boot_stages_us_[index] = micros();
+  }
+}
+
+uint32_t Metrics::getCounter(Counter id) const {
+  return counters_[static_cast<size_t>(id)];
+}
+
+void Metrics::getHistogram(Histogram id, HistogramData& data) const {
+  portENTER_CRITICAL(&mux_);
+  data = histograms_[static_cast<size_t>(id)];
+  portEXIT_CRITICAL(&mux_);
+}
+
+uint32_t Metrics::getRxBytesPerSecond() const {
+  uint32_t elapsed_ms = getElapsedMs();
+  if (elapsed_ms == 0) {
+    return 0;
+  }
+  return (getCounter(Counter::RX_BYTES) * 1000ULL) / elapsed_ms;
+}
+
+uint32_t Metrics::getRxPeakBytesPerSecond() const {
+  return rx_peak_bytes_per_s_;
+}
+
+uint32_t Metrics::getElapsedMs() const {
+  return millis() - reset_ms_;
+}
+
+uint32_t Metrics::getBootStageUs(BootStage stage) const {
+  return boot_stages_us_[static_cast<size_t>(stage)];
+}
+
+const char* Metrics::getCounterName(Counter id) {
+  return CounterNames[static_cast<size_t>(id)];
+}
+
+const char* Metrics::getHistogramName(Histogram id) {
+  return HistogramNames[static_cast<size_t>(id)];
+}
+
+const char* Metrics::getBootStageName(BootStage stage) {
+  return BootStageNames[static_cast<size_t>(stage)];
+}
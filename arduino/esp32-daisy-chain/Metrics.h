@@ -0,0 +1,87 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include "common.h"
+
+class Metrics {
+ public:
+  // Bucket i counts durations in [2^(i+3), 2^(i+4)) us, the first bucket also takes shorter and the last longer ones
+  constexpr static size_t BucketCount = 16;
+  constexpr static uint32_t BucketMinUs = 16;
+
+  enum class Counter : uint8_t {
+    RX_BYTES = 0,
+    RX_REQUESTS,
+    RX_TIMEOUTS,
+    TX_BYTES,
+    TX_TIMEOUTS,
+    CHAIN_FLUSHES,
+    RX_DUPLICATES,
+    COUNT,
+  };
+
+  enum class Histogram : uint8_t {
+    LOOP_PERIOD = 0,
+    SPI_TRANSFER,
+    JSON_PARSE,
+    BLE_TX_CHUNK_RTT,
+    FLUSH_CHAIN_0,  // One histogram per chain follows
+    COUNT = FLUSH_CHAIN_0 + CHAIN_COUNT_MAX,
+  };
+
+  // One-shot timestamps since app start, not affected by reset()
+  enum class BootStage : uint8_t {
+    FIRST_FRAME = 0,  // Calibrated idle frame flushed to all chains
+    BLE_READY,        // BLE stack initialized and advertising
+    COUNT,
+  };
+
+  struct HistogramData {
+    uint32_t count;
+    uint64_t sum_us;
+    uint32_t max_us;
+    uint32_t buckets[BucketCount];
+  };
+
+  Metrics(const Metrics&) = delete;
+  Metrics& operator=(const Metrics&) = delete;
+
+  static Metrics& getInstance() {
+    static Metrics instance;
+    return instance;
+  }
+
+  void reset();
+  void count(Counter id, uint32_t value = 1);
+  void record(Histogram id, uint32_t duration_us);
+  void recordChainFlush(size_t chain, uint32_t duration_us);
+  void recordRx(size_t bytes);
+  void recordBootStage(BootStage stage);
+
+  uint32_t getCounter(Counter id) const;
+  void getHistogram(Histogram id, HistogramData& data) const;
+  uint32_t getRxBytesPerSecond() const;
+  uint32_t getRxPeakBytesPerSecond() const;
+  uint32_t getElapsedMs() const;
+  uint32_t getBootStageUs(BootStage stage) const;
+  static const char* getCounterName(Counter id);
+  static const char* getHistogramName(Histogram id);
+  static const char* getBootStageName(BootStage stage);
+
+ private:
+  constexpr static uint32_t RateWindowMs = 1000;  // Window for the RX peak rate
+
+  Metrics() = default;
+
+  mutable portMUX_TYPE mux_ = portMUX_INITIALIZER_UNLOCKED;  // Counters are also updated from the BLE host task
+  uint32_t counters_[static_cast<size_t>(Counter::COUNT)] = {};
+  HistogramData histograms_[static_cast<size_t>(Histogram::COUNT)] = {};
+  volatile uint32_t boot_stages_us_[static_cast<size_t>(BootStage::COUNT)] = {};
+
+  uint32_t reset_ms_ = 0;
+  uint32_t rx_window_start_ms_ = 0;
+  uint32_t rx_window_bytes_ = 0;
+  uint32_t rx_peak_bytes_per_s_ = 0;
+};
+
+#endif  // METRICS_H
@@ -1,14 +1,20 @@
 #include "Player.h"
 #include "DaisyChain.h"
+#include "EventLoop.h"
+#include "Trace.h"
+#include "esp_timer.h"
 
-#define DEBUG_ENABLE_PLAYER 1
-#if ((DEBUG_ENABLE_PLAYER == 1) && (ENABLE_DEBUG_OUTPUT == 1))
-#define DEBUG_INFO(f, ...) debugPrint("[INF][Player]", f, ##__VA_ARGS__)
+#define LOG_LEVEL_PLAYER LOG_LEVEL_INFO
+#if ((LOG_LEVEL_PLAYER >= LOG_LEVEL_ERROR) && (ENABLE_DEBUG_OUTPUT == 1))
 #define DEBUG_ERROR(f, ...) debugPrint("[ERR][Player]", f, ##__VA_ARGS__)
 #else
-#define DEBUG_INFO(...)
 #define DEBUG_ERROR(...)
 #endif
+#if ((LOG_LEVEL_PLAYER >= LOG_LEVEL_INFO) && (ENABLE_DEBUG_OUTPUT == 1))
+#define DEBUG_INFO(f, ...) debugPrint("[INF][Player]", f, ##__VA_ARGS__)
+#else
+#define DEBUG_INFO(...)
+#endif
 
 void Player::initialize() {
   DEBUG_INFO("Initialize Player [...]");
@@ -17,6 +23,22 @@ void Player::initialize() {
   digitalWrite(RunTogglePin, LOW);
 #endif
   last_run_ms_ = millis();
+  resetOverrides();
+#if (ENABLE_FRAME_CACHE == 1)
+  if (psramFound() == true) {
+    frame_cache_ = static_cast<uint8_t*>(ps_malloc(FrameCacheSizePsram));
+    frame_cache_size_ = FrameCacheSizePsram;
+  } else {
+    frame_cache_ = static_cast<uint8_t*>(malloc(FrameCacheSizeInternal));
+    frame_cache_size_ = FrameCacheSizeInternal;
+  }
+  if (frame_cache_ == nullptr) {
+    DEBUG_ERROR("Failed to allocate frame cache, repetitions are evaluated live");
+    frame_cache_size_ = 0;
+  } else {
+    DEBUG_INFO("Frame cache: %zu bytes", frame_cache_size_);
+  }
+#endif
   DEBUG_INFO("Initialize Player [OK]");
 }
 
@@ -24,28 +46,23 @@ bool Player::isIdle() const {
   return state_ == State::IDLE;
 }
 
+const SequenceStep* Player::getSequence() const {
+  return sequence_;
+}
+
+size_t Player::getStepCount() const {
+  return step_count_;
+}
+
 void Player::abort() {
+  clearQueue();
+  resume();
   DaisyChain::getInstance().applyIdleValues();
   state_ = State::IDLE;
 }
 
-void Player::playSequence(const SequenceStep sequence[], size_t count) {
-  if (count == 0 || sequence == nullptr) {
-    DEBUG_ERROR("Invalid sequence or count!");
-    return;
-  }
-
-  bool invalid_step = false;
-  for (size_t i = 0; i < count; i++) {
-    if (isStepValid(sequence[i]) == false) {
-      DEBUG_ERROR("Invalid sequence step at index %zu!", i);
-      invalid_step = true;
-      continue;
-    }
-  }
-
-  if (invalid_step == true) {
-    DEBUG_ERROR("One or more sequence steps are invalid, aborting sequence!");
+void Player::playSequence(const SequenceStep sequence[], size_t count, int64_t start_at_us) {
+  if (isSequenceValid(sequence, count) == false) {
     return;
   }
 
@@ -57,12 +74,179 @@ void Player::playSequence(const SequenceStep sequence[], size_t count) {
   DEBUG_INFO("Play sequence with %zu steps [...]", count);
 
   sequence_ = const_cast<SequenceStep*>(sequence);
+  resetOverrides();
   step_count_ = count;
   step_index_ = 0;
+  start_at_us_ = start_at_us;
+
+  if (start_at_us_ > esp_timer_get_time()) {
+    DEBUG_INFO("Wait for synchronized start in %lld us", start_at_us_ - esp_timer_get_time());
+    state_ = State::WAIT_START;
+    return;
+  }
+  last_run_ms_ = millis();  // The loop may have been waiting for events, don't report that as run delay
+  playStep(sequence_[step_index_]);
+}
+
+bool Player::queueSequence(const SequenceStep sequence[], size_t count, uint32_t fade_ms) {
+  if (isSequenceValid(sequence, count) == false) {
+    return false;
+  }
+  if (state_ == State::IDLE) {
+    DEBUG_INFO("Nothing playing, start queued sequence now");
+    last_run_ms_ = millis();
+    playSequence(sequence, count);
+    return true;
+  }
+
+  DEBUG_INFO("Queue sequence with %zu steps, crossfade: %u ms", count, fade_ms);
+  queued_sequence_ = sequence;
+  queued_count_ = count;
+  queued_fade_ms_ = fade_ms;
+  return true;
+}
+
+void Player::clearQueue() {
+  queued_sequence_ = nullptr;
+  queued_count_ = 0;
+}
+
+void Player::pause() {
+  if (paused_ == false) {
+    clock_show_ms_ = showTime();
+    paused_ = true;
+  }
+}
+
+void Player::resume() {
+  if (paused_ == true) {
+    clock_real_ms_ = millis();
+    paused_ = false;
+  }
+}
+
+bool Player::isPaused() const {
+  return paused_;
+}
+
+bool Player::setTempo(uint32_t tempo_percent) {
+  if (tempo_percent < TempoMinPercent || tempo_percent > TempoMaxPercent) {
+    DEBUG_ERROR("Invalid tempo: %u %%", tempo_percent);
+    return false;
+  }
+  // Continue from the current show time, only the rate of the clock changes
+  clock_show_ms_ = showTime();
+  clock_real_ms_ = millis();
+  tempo_percent_ = tempo_percent;
+  return true;
+}
+
+bool Player::seek(uint32_t position_ms) {
+  if (state_ == State::IDLE) {
+    DEBUG_ERROR("No sequence to seek in!");
+    return false;
+  }
+
+  // Find the step at the position, all steps before it are done and their LEDs hold their final values
+  DaisyChain::getInstance().applyIdleValues();
+  size_t index = 0;
+  for (; index < step_count_; index++) {
+    uint32_t step_ms = getStepDuration(sequence_[index]);
+    if (position_ms < step_ms) {
+      break;
+    }
+    position_ms -= step_ms;
+    applyFinalValues(sequence_[index]);
+  }
+  if (index == step_count_) {
+    DEBUG_ERROR("Seek position beyond the end of the sequence!");
+    return false;
+  }
+
+  // Evaluate the step as a function of time from the position on, the same way a staggered step runs
+  DEBUG_INFO("Seek to step %zu, %u ms into it", index + 1, position_ms);
+  step_index_ = index;
   playStep(sequence_[step_index_]);
+  stagger_start_ms_ = showTime() - position_ms;
+  stagger_tick_ms_ = millis() - RampTickTimeMinMs;
+  state_ = State::STAGGERED;
+  runStaggered();
+  return true;
+}
+
+bool Player::setGroupGain(uint8_t group, uint8_t gain_percent) {
+  if (group >= MaxGroups || gain_percent > GainMaxPercent) {
+    DEBUG_ERROR("Invalid gain %u %% for group %u!", gain_percent, group);
+    return false;
+  }
+  group_gain_[group] = gain_percent;
+  if (state_ != State::IDLE && group == group_) {
+    gain_changed_ = true;
+    cache_valid_ = false;  // The baked frames have the old levels, the next repetition runs live
+  }
+  return true;
+}
+
+bool Player::setStepDurations(size_t index, uint32_t ramp_down_ms, uint32_t pause_ms, uint32_t ramp_up_ms,
+                              uint32_t pulse_ms) {
+  if (state_ == State::IDLE || index >= step_count_) {
+    DEBUG_ERROR("Invalid step index: %zu", index);
+    return false;
+  }
+
+  // Kept in the sequence for later repetitions of the show, the running step picks the new durations up with its
+  // next phase (timed phases and staggered steps right away)
+  SequenceStep& step = sequence_[index];
+  step.ramp_down_duration_ms = ramp_down_ms;
+  step.pause_duration_ms = pause_ms;
+  step.ramp_up_duration_ms = ramp_up_ms;
+  step.pulse_duration_ms = pulse_ms;
+  if (index == step_index_ && state_ != State::WAIT_START) {
+    ramp_down_.duration_ms = ramp_down_ms;
+    pause_.duration_ms = pause_ms;
+    ramp_up_.duration_ms = ramp_up_ms;
+    pulse_.duration_ms = pulse_ms;
+    cache_valid_ = false;
+  }
+  return true;
+}
+
+void Player::resetOverrides() {
+  for (size_t i = 0; i < MaxGroups; i++) {
+    group_gain_[i] = GainMaxPercent;
+  }
+}
+
+uint32_t Player::getStepDuration(const SequenceStep& step) const {
+  uint32_t cycle_ms =
+      step.ramp_down_duration_ms + step.pause_duration_ms + step.ramp_up_duration_ms + step.pulse_duration_ms;
+  return (step.size > 0 ? (step.size - 1) * step.stagger_ms : 0) + step.repetitions * cycle_ms;
+}
+
+void Player::applyFinalValues(const SequenceStep& step) {
+  // End of the last repetition: on (or idle) after a ramp up or pulse, off after a ramp down or pause
+  bool lit = step.ramp_up_duration_ms > 0 || step.pulse_duration_ms > 0;
+  if (lit == false && step.ramp_down_duration_ms == 0 && step.pause_duration_ms == 0) {
+    return;
+  }
+  if (lit == true && step.idle_return == true) {
+    DaisyChain::getInstance().getIdleLeds(step.leds, step.size);
+  } else {
+    BrgNumber brightness = (lit == true) ? applyGain(static_cast<uint32_t>(BrgName::MAX), step.group)
+                                         : static_cast<BrgNumber>(BrgName::OFF);
+    for (size_t i = 0; i < step.size; i++) {
+      step.leds[i].brightness = brightness;
+    }
+  }
+  DaisyChain::getInstance().setActiveLeds(step.leds, step.size);
+}
+
+bool Player::isSequenceInUse(const SequenceStep sequence[]) const {
+  return (state_ != State::IDLE && sequence_ == sequence) || (queued_count_ > 0 && queued_sequence_ == sequence);
 }
 
 void Player::playStep(const SequenceStep& step) {
+  TRACE(PLAYER_STEP, step_index_);
   leds_ = step.leds;
   size_ = step.size;
 
@@ -84,29 +268,101 @@ void Player::playStep(const SequenceStep& step) {
 
   repetitions_ = step.repetitions;
   return_to_idle_ = step.idle_return;
+  stagger_ms_ = step.stagger_ms;
+  group_ = step.group;
+  gain_changed_ = false;
 
   DEBUG_INFO(
       "Play step (%zu/%zu) with %zu LEDs, ramp down: %u ms, pause: %u ms, ramp up: %u ms, pulse: %u ms, "
       "repetitions: %u",
       step_index_ + 1, step_count_, size_, ramp_down_.duration_ms, pause_.duration_ms, ramp_up_.duration_ms,
       pulse_.duration_ms, repetitions_);
+  if (stagger_ms_ > 0) {
+    DEBUG_INFO("  Staggered by %u ms per LED", stagger_ms_);
+    stagger_start_ms_ = showTime();
+    stagger_tick_ms_ = millis();
+    state_ = State::STAGGERED;
+    return;
+  }
+
+  // The first repetition starts from whatever is shown and runs live, all others start from the same values and
+  // can be replayed from the cache
+  cache_valid_ = false;
+  if (frame_cache_ != nullptr && repetitions_ >= FrameCacheMinRepetitions) {
+    uint32_t bake_start_us = micros();
+    cache_valid_ = bakeCycle();
+    if (cache_valid_ == true) {
+      DEBUG_INFO("  Baked %u frames (%zu bytes) in %u us", cache_frames_, cache_used_, micros() - bake_start_us);
+    } else {
+      DEBUG_INFO("  Repetition does not fit into the frame cache, evaluate live");
+    }
+  }
   state_ = State::RAMP_DOWN;
 }
 
+void Player::nextStep() {
+  state_ = State::IDLE;
+
+  if (step_index_ < step_count_ - 1) {
+    step_index_++;
+    playStep(sequence_[step_index_]);
+  } else if (queued_count_ > 0) {
+    // Take over within the same tick, the LEDs keep their last values instead of passing through idle
+    DEBUG_INFO("All steps of sequence played, continue with queued sequence [OK]");
+    sequence_ = const_cast<SequenceStep*>(queued_sequence_);
+    resetOverrides();
+    step_count_ = queued_count_;
+    step_index_ = 0;
+    start_at_us_ = 0;
+    clearQueue();
+    if (queued_fade_ms_ > 0) {
+      DaisyChain::getInstance().startCrossfade(queued_fade_ms_);
+    }
+    playStep(sequence_[step_index_]);
+  } else {
+    DEBUG_INFO("All steps of sequence played, returning to IDLE state [OK]");
+  }
+}
+
+bool Player::isSequenceValid(const SequenceStep sequence[], size_t count) const {
+  if (count == 0 || sequence == nullptr) {
+    DEBUG_ERROR("Invalid sequence or count!");
+    return false;
+  }
+
+  bool invalid_step = false;
+  for (size_t i = 0; i < count; i++) {
+    if (isStepValid(sequence[i]) == false) {
+      DEBUG_ERROR("Invalid sequence step at index %zu!", i);
+      invalid_step = true;
+      continue;
+    }
+  }
+
+  if (invalid_step == true) {
+    DEBUG_ERROR("One or more sequence steps are invalid, aborting sequence!");
+    return false;
+  }
+  return true;
+}
+
 bool Player::isStepValid(const SequenceStep& step) const {
   if (step.leds == nullptr) {
     DEBUG_ERROR("Invalid leds pointer!");
     return false;
-  } else if (step.size > LED_COUNT_TOTAL) {
+  } else if (step.size > getTopology().ledCount()) {
     DEBUG_ERROR("Invalid leds size: %d", step.size);
     return false;
   } else if (step.repetitions == 0) {
     DEBUG_ERROR("Repetitions must be greater than 0!");
     return false;
+  } else if (step.stagger_ms > StaggerMaxMs) {
+    DEBUG_ERROR("Invalid stagger: %u ms", step.stagger_ms);
+    return false;
   }
 
   for (size_t i = 0; i < step.size; i++) {
-    if (static_cast<uint8_t>(step.leds[i].chain_idx) >= static_cast<uint8_t>(ChainIdx::CHAIN_COUNT)) {
+    if (static_cast<uint8_t>(step.leds[i].chain_idx) >= getTopology().chain_count) {
       DEBUG_ERROR("Invalid chain index: %u", step.leds[i].chain_idx);
       return false;
     } else if (step.leds[i].led_idx >= LED_COUNT) {
@@ -121,6 +377,16 @@ bool Player::isStepValid(const SequenceStep& step) const {
   return true;
 }
 
+int64_t Player::getWakeUpUs() const {
+  if (state_ == State::IDLE || paused_ == true) {
+    return EventLoop::WakeUpOnEvent;
+  }
+  if (state_ == State::WAIT_START) {
+    return start_at_us_;
+  }
+  return EventLoop::WakeUpFrameTick;
+}
+
 void Player::run() {
   uint32_t run_delay_ms = millis() - last_run_ms_;
   last_run_ms_ = millis();
@@ -128,14 +394,44 @@ void Player::run() {
   digitalWrite(RunTogglePin, !digitalRead(RunTogglePin));
 #endif
 
-  if (state_ == State::IDLE) {
+  if (state_ == State::IDLE || paused_ == true) {
     return;
   }
 
-  if (run_delay_ms >= RampTickTimeMinMs) {
+  if (state_ == State::WAIT_START) {
+    int64_t now_us = esp_timer_get_time();
+    if (now_us < start_at_us_) {
+      return;
+    }
+    DEBUG_INFO("Synchronized start (%lld us late)", now_us - start_at_us_);
+    playStep(sequence_[step_index_]);
+  } else if (run_delay_ms >= RampTickTimeMinMs) {
     DEBUG_ERROR("Player run delay too long: %u ms", run_delay_ms);
   }
 
+  if (state_ == State::STAGGERED) {
+    if (runStaggered() == true) {
+      nextStep();
+    }
+    return;
+  }
+
+  if (state_ == State::CACHED) {
+    if (runCached() == true) {
+      repetitions_--;
+      if (repetitions_ == 0) {
+        nextStep();
+      } else if (repetitions_ == 1 && return_to_idle_ == true) {
+        state_ = State::RAMP_DOWN;  // The return to idle depends on the idle values, keep it live
+      } else if (cache_valid_ == false) {
+        state_ = State::RAMP_DOWN;  // Gain or durations changed, the baked frames are outdated
+      } else {
+        startCachedCycle(cache_start_ms_ + cache_cycle_ms_);  // Back to back, no drift between repetitions
+      }
+    }
+    return;
+  }
+
   if (state_ == State::RAMP_DOWN) {
     if (runRampDown() == true) {
       state_ = State::PAUSE;
@@ -165,17 +461,12 @@ void Player::run() {
   if (state_ == State::PULSE) {
     if (runPulse(return_to_idle) == true) {
       repetitions_--;
-      if (repetitions_ > 0) {
+      if (repetitions_ > 0 && cache_valid_ == true && (repetitions_ > 1 || return_to_idle_ == false)) {
+        startCachedCycle(showTime());
+      } else if (repetitions_ > 0) {
         state_ = State::RAMP_DOWN;
       } else {
-        state_ = State::IDLE;
-
-        if (step_index_ < step_count_ - 1) {
-          step_index_++;
-          playStep(sequence_[step_index_]);
-        } else {
-          DEBUG_INFO("All steps of sequence played, returning to IDLE state [OK]");
-        }
+        nextStep();
       }
     } else {
       return;
@@ -184,11 +475,19 @@ void Player::run() {
 }
 
 uint32_t Player::elapsedTime(uint32_t start_ms) const {
-  uint32_t now_ms = millis();
+  uint32_t now_ms = showTime();
   if (now_ms < start_ms) {
     return UINT32_MAX - start_ms + now_ms;
   }
-  return millis() - start_ms;
+  return now_ms - start_ms;
+}
+
+uint32_t Player::showTime() const {
+  if (paused_ == true) {
+    return clock_show_ms_;
+  }
+  uint64_t real_ms = millis() - clock_real_ms_;
+  return clock_show_ms_ + static_cast<uint32_t>(real_ms * tempo_percent_ / TempoDefaultPercent);
 }
 
 bool Player::runRampDown() {
@@ -216,13 +515,16 @@ bool Player::runRampDown() {
     }
     remaining_ramp_ticks_ = total_ramp_ticks_;
 
-    ramp_down_.start_ms = millis();
+    ramp_down_.start_ms = showTime();
     ramp_down_.started = true;
 
   } else if (elapsedTime(ramp_down_.start_ms) >= ramp_tick_time_ms_) {
-    remaining_ramp_ticks_--;
+    // All ticks that are due, several per run at a high tempo
+    uint32_t ticks = elapsedTime(ramp_down_.start_ms) / ramp_tick_time_ms_;
+    remaining_ramp_ticks_ -= (ticks < remaining_ramp_ticks_) ? ticks : remaining_ramp_ticks_;
+    TRACE(RAMP_TICK, remaining_ramp_ticks_);
 
-    BrgNumber new_brightness = remaining_ramp_ticks_ * ramp_step_size_;
+    BrgNumber new_brightness = applyGain(remaining_ramp_ticks_ * ramp_step_size_, group_);
     for (size_t i = 0; i < size_; i++) {
       if (leds_[i].brightness > new_brightness) {
         leds_[i].brightness = new_brightness;
@@ -230,7 +532,7 @@ bool Player::runRampDown() {
     }
     DaisyChain::getInstance().setActiveLeds(leds_, size_);
 
-    ramp_down_.start_ms = millis();
+    ramp_down_.start_ms += ticks * ramp_tick_time_ms_;
 
     if (remaining_ramp_ticks_ == 0) {
       ramp_down_.started = false;
@@ -258,7 +560,7 @@ bool Player::runPause() {
     }
     DaisyChain::getInstance().setActiveLeds(leds_, size_);
 
-    pause_.start_ms = millis();
+    pause_.start_ms = showTime();
     pause_.started = true;
 
   } else if (elapsedTime(pause_.start_ms) >= pause_.duration_ms) {
@@ -295,13 +597,16 @@ bool Player::runRampUp(bool return_to_idle) {
     }
     remaining_ramp_ticks_ = total_ramp_ticks_;
 
-    ramp_up_.start_ms = millis();
+    ramp_up_.start_ms = showTime();
     ramp_up_.started = true;
 
   } else if (elapsedTime(ramp_up_.start_ms) >= ramp_tick_time_ms_) {
-    remaining_ramp_ticks_--;
+    // All ticks that are due, several per run at a high tempo
+    uint32_t ticks = elapsedTime(ramp_up_.start_ms) / ramp_tick_time_ms_;
+    remaining_ramp_ticks_ -= (ticks < remaining_ramp_ticks_) ? ticks : remaining_ramp_ticks_;
+    TRACE(RAMP_TICK, remaining_ramp_ticks_);
 
-    BrgNumber new_brightness = (total_ramp_ticks_ - remaining_ramp_ticks_) * ramp_step_size_;
+    BrgNumber new_brightness = applyGain((total_ramp_ticks_ - remaining_ramp_ticks_) * ramp_step_size_, group_);
     for (size_t i = 0; i < size_; i++) {
       if (return_to_idle == true) {
         DaisyChain::getInstance().getIdleLeds(leds_ + i, 1);
@@ -315,7 +620,7 @@ bool Player::runRampUp(bool return_to_idle) {
     }
     DaisyChain::getInstance().setActiveLeds(leds_, size_);
 
-    ramp_up_.start_ms = millis();
+    ramp_up_.start_ms += ticks * ramp_tick_time_ms_;
 
     if (remaining_ramp_ticks_ == 0) {
       ramp_up_.started = false;
@@ -344,19 +649,230 @@ bool Player::runPulse(bool return_to_idle) {
     } else {
       // Set all LEDs to maximum brightness
       for (size_t i = 0; i < size_; i++) {
-        leds_[i].brightness = static_cast<BrgNumber>(BrgName::MAX);
+        leds_[i].brightness = applyGain(static_cast<uint32_t>(BrgName::MAX), group_);
       }
     }
     DaisyChain::getInstance().setActiveLeds(leds_, size_);
 
-    pulse_.start_ms = millis();
+    pulse_.start_ms = showTime();
     pulse_.started = true;
 
   } else if (elapsedTime(pulse_.start_ms) >= pulse_.duration_ms) {
     pulse_.started = false;
     pulse_.start_ms = 0;
     complete = true;
+
+  } else if (gain_changed_ == true && return_to_idle == false) {
+    // Follow a gain change while the pulse holds
+    for (size_t i = 0; i < size_; i++) {
+      leds_[i].brightness = applyGain(static_cast<uint32_t>(BrgName::MAX), group_);
+    }
+    DaisyChain::getInstance().setActiveLeds(leds_, size_);
+    gain_changed_ = false;
   }
 
   return complete;
 }
+
+bool Player::runStaggered() {
+  // One pass over the group per ramp tick: every LED runs the same envelope, shifted by its index times the
+  // stagger. The envelope is a function of time and the current value, so no state per LED is needed.
+  uint32_t now_ms = millis();
+  uint32_t elapsed_ms = showTime() - stagger_start_ms_;
+  uint32_t cycle_ms = ramp_down_.duration_ms + pause_.duration_ms + ramp_up_.duration_ms + pulse_.duration_ms;
+  uint32_t total_ms = (size_ > 0 ? (size_ - 1) * stagger_ms_ : 0) + repetitions_ * cycle_ms;
+  bool complete = elapsed_ms >= total_ms;
+  if (complete == false && now_ms - stagger_tick_ms_ < RampTickTimeMinMs) {
+    return false;
+  }
+  stagger_tick_ms_ = now_ms;
+  TRACE(RAMP_TICK, elapsed_ms);
+
+  DaisyChain::getInstance().getActiveLeds(leds_, size_);
+  for (size_t i = 0; i < size_; i++) {
+    uint32_t offset_ms = i * stagger_ms_;
+    if (elapsed_ms < offset_ms) {
+      break;  // This and all following LEDs have not started yet
+    }
+    leds_[i].brightness = evaluateEnvelope(elapsed_ms - offset_ms, leds_[i]);
+  }
+  DaisyChain::getInstance().setActiveLeds(leds_, size_);
+
+  return complete;
+}
+
+bool Player::bakeCycle() {
+  // Evaluate one repetition at every ramp tick and store only the LEDs that change. Runs of neighbours that change
+  // to the same value, as in a ramp over the whole group, collapse into a single run.
+  constexpr size_t GroupSizeMax = UINT8_MAX + 1;  // Run indices are stored in a byte
+  uint32_t cycle_ms = ramp_down_.duration_ms + pause_.duration_ms + ramp_up_.duration_ms + pulse_.duration_ms;
+  if (cycle_ms == 0 || size_ == 0 || size_ > GroupSizeMax || frame_cache_size_ < 4) {
+    return false;
+  }
+
+  // A repetition that follows a complete one starts from the end of the ramp up or pulse, or from the pause
+  BrgNumber values[GroupSizeMax];
+  BrgNumber start = (ramp_up_.duration_ms > 0 || pulse_.duration_ms > 0)
+                        ? applyGain(static_cast<uint32_t>(BrgName::MAX), group_)
+                        : static_cast<BrgNumber>(BrgName::OFF);
+  for (size_t i = 0; i < size_; i++) {
+    values[i] = start;
+  }
+  size_t used = 0;
+  frame_cache_[used++] = 1;
+  frame_cache_[used++] = 0;
+  frame_cache_[used++] = static_cast<uint8_t>(size_ - 1);
+  frame_cache_[used++] = start;
+
+  uint32_t last_frame = (cycle_ms + RampTickTimeMinMs - 1) / RampTickTimeMinMs;
+  for (uint32_t frame = 1; frame <= last_frame; frame++) {
+    uint32_t position_ms = frame * RampTickTimeMinMs;
+    if (position_ms > cycle_ms) {
+      position_ms = cycle_ms;
+    }
+    if (used == frame_cache_size_) {
+      return false;
+    }
+    size_t run_count_offset = used++;
+    uint32_t run_count = 0;
+    size_t i = 0;
+    while (i < size_) {
+      LedObj led = leds_[i];
+      led.brightness = values[i];
+      BrgNumber value = evaluateCycle(position_ms, false, led);
+      if (value == values[i]) {
+        i++;
+        continue;
+      }
+      size_t first = i;
+      values[i++] = value;
+      while (i < size_) {
+        led = leds_[i];
+        led.brightness = values[i];
+        if (values[i] == value || evaluateCycle(position_ms, false, led) != value) {
+          break;
+        }
+        values[i++] = value;
+      }
+      if (run_count == UINT8_MAX || frame_cache_size_ - used < 3) {
+        return false;
+      }
+      frame_cache_[used++] = static_cast<uint8_t>(first);
+      frame_cache_[used++] = static_cast<uint8_t>(i - first - 1);
+      frame_cache_[used++] = value;
+      run_count++;
+    }
+    frame_cache_[run_count_offset] = static_cast<uint8_t>(run_count);
+  }
+
+  cache_used_ = used;
+  cache_frames_ = last_frame + 1;
+  cache_cycle_ms_ = cycle_ms;
+  return true;
+}
+
+void Player::startCachedCycle(uint32_t start_ms) {
+  cache_start_ms_ = start_ms;
+  cache_offset_ = 0;
+  cache_frame_ = 0;
+  state_ = State::CACHED;
+}
+
+bool Player::runCached() {
+  // Apply all frames that are due, usually one per ramp tick. Nothing is evaluated here while the cache is valid, the
+  // values come from the cache and every repetition shows exactly the same frames at the same offsets.
+  uint32_t elapsed_ms = showTime() - cache_start_ms_;
+  uint32_t due_frame = elapsed_ms / RampTickTimeMinMs;
+  if (cache_valid_ == false) {
+    // Gain or durations changed during this repetition, the rest of it is evaluated live at the same ticks
+    uint32_t cycle_ms = ramp_down_.duration_ms + pause_.duration_ms + ramp_up_.duration_ms + pulse_.duration_ms;
+    if (cache_frame_ <= due_frame || elapsed_ms >= cycle_ms) {
+      TRACE(RAMP_TICK, due_frame);
+      uint32_t position_ms = (elapsed_ms < cycle_ms) ? elapsed_ms : cycle_ms;
+      for (size_t i = 0; i < size_; i++) {
+        leds_[i].brightness = evaluateCycle(position_ms, false, leds_[i]);
+      }
+      DaisyChain::getInstance().setActiveLeds(leds_, size_);
+      cache_frame_ = due_frame + 1;
+    }
+    return elapsed_ms >= cycle_ms;
+  }
+  if (due_frame >= cache_frames_) {
+    due_frame = cache_frames_ - 1;
+  }
+  if (cache_frame_ <= due_frame) {
+    TRACE(RAMP_TICK, due_frame);
+    for (; cache_frame_ <= due_frame; cache_frame_++) {
+      uint8_t run_count = frame_cache_[cache_offset_++];
+      for (uint8_t run = 0; run < run_count; run++) {
+        size_t first = frame_cache_[cache_offset_];
+        size_t last = first + frame_cache_[cache_offset_ + 1];
+        BrgNumber value = frame_cache_[cache_offset_ + 2];
+        cache_offset_ += 3;
+        for (size_t i = first; i <= last; i++) {
+          leds_[i].brightness = value;
+        }
+      }
+    }
+    DaisyChain::getInstance().setActiveLeds(leds_, size_);
+  }
+  return cache_frame_ == cache_frames_ && elapsed_ms >= cache_cycle_ms_;
+}
+
+BrgNumber Player::applyGain(uint32_t level, uint8_t group) const {
+  return static_cast<BrgNumber>(level * group_gain_[group] / GainMaxPercent);
+}
+
+BrgNumber Player::evaluateEnvelope(uint32_t time_ms, const LedObj& led) const {
+  uint32_t cycle_ms = ramp_down_.duration_ms + pause_.duration_ms + ramp_up_.duration_ms + pulse_.duration_ms;
+  uint32_t repetition = repetitions_ - 1;
+  uint32_t position_ms = cycle_ms;  // End of the envelope, the LED keeps its final value
+  if (cycle_ms > 0 && time_ms < repetitions_ * cycle_ms) {
+    repetition = time_ms / cycle_ms;
+    position_ms = time_ms % cycle_ms;
+  }
+  bool return_to_idle = (repetition == repetitions_ - 1) && (return_to_idle_ == true);
+  return evaluateCycle(position_ms, return_to_idle, led);
+}
+
+BrgNumber Player::evaluateCycle(uint32_t position_ms, bool return_to_idle, const LedObj& led) const {
+  // Same shape as the ramp down/pause/ramp up/pulse states, but continuous in time. A ramp never brightens
+  // (ramp down) or darkens (ramp up) an LED, so the current value keeps the starting point of the ramp.
+  constexpr uint32_t Max = static_cast<uint32_t>(BrgName::MAX);
+  BrgNumber brightness = led.brightness;
+  if (ramp_down_.duration_ms > 0) {
+    if (position_ms < ramp_down_.duration_ms) {
+      BrgNumber level = applyGain(Max * (ramp_down_.duration_ms - position_ms) / ramp_down_.duration_ms, group_);
+      return (level < brightness) ? level : brightness;
+    }
+    brightness = static_cast<BrgNumber>(BrgName::OFF);
+    position_ms -= ramp_down_.duration_ms;
+  }
+  if (pause_.duration_ms > 0) {
+    if (position_ms < pause_.duration_ms) {
+      return static_cast<BrgNumber>(BrgName::OFF);
+    }
+    brightness = static_cast<BrgNumber>(BrgName::OFF);
+    position_ms -= pause_.duration_ms;
+  }
+
+  LedObj idle = led;
+  if (return_to_idle == true && (ramp_up_.duration_ms > 0 || pulse_.duration_ms > 0)) {
+    DaisyChain::getInstance().getIdleLeds(&idle, 1);
+  }
+  BrgNumber top = (return_to_idle == true) ? idle.brightness : applyGain(Max, group_);
+  if (ramp_up_.duration_ms > 0) {
+    if (position_ms < ramp_up_.duration_ms) {
+      BrgNumber level = applyGain(Max * position_ms / ramp_up_.duration_ms, group_);
+      if (return_to_idle == true) {
+        return (level < top) ? level : top;
+      }
+      return (level > brightness) ? level : brightness;
+    }
+    brightness = top;
+  }
+  if (pulse_.duration_ms > 0) {
+    brightness = top;
+  }
+  return brightness;
+}
@@ -4,10 +4,24 @@
 #include "common.h"
 
 class Player {
+ public:
+  constexpr static size_t MaxGroups = 16;         // Groups of a show with a live gain
+  constexpr static uint8_t GainMaxPercent = 100;  // Envelope as programmed
+
+  constexpr static uint32_t TempoDefaultPercent = 100;  // Programmed speed
+  constexpr static uint32_t TempoMinPercent = 10;       // Tenth of the programmed speed
+  constexpr static uint32_t TempoMaxPercent = 1000;     // Ten times the programmed speed
+
+ private:
   constexpr static uint32_t RampStepSizeMin = 1;
   constexpr static uint32_t RampTickTimeMinMs = 5;
   constexpr static uint32_t RampTickCountMax = static_cast<uint32_t>(BrgName::MAX) / RampStepSizeMin;
-  constexpr static int RunTogglePin = 38;  // TP1 on pcb
+  constexpr static uint32_t StaggerMaxMs = 10000;  // Longest start offset between two LEDs of a staggered step
+  constexpr static int RunTogglePin = 38;          // TP1 on pcb
+
+  constexpr static uint32_t FrameCacheMinRepetitions = 3;      // Fewer repetitions are not worth baking
+  constexpr static size_t FrameCacheSizePsram = 512 * 1024;    // Cache size if the module has PSRAM
+  constexpr static size_t FrameCacheSizeInternal = 32 * 1024;  // Cache size in internal RAM otherwise
 
  public:
   Player(const Player&) = delete;
@@ -21,16 +35,35 @@ class Player {
   void initialize();
   bool isIdle() const;
   void abort();
-  void playSequence(const SequenceStep sequence[], size_t count);
+  void playSequence(const SequenceStep sequence[], size_t count, int64_t start_at_us = 0);
+  bool queueSequence(const SequenceStep sequence[], size_t count, uint32_t fade_ms);
+  void clearQueue();
+  bool isSequenceInUse(const SequenceStep sequence[]) const;  // Played or queued, the steps must stay untouched
+  bool isSequenceValid(const SequenceStep sequence[], size_t count) const;
+  const SequenceStep* getSequence() const;  // Running sequence, only meaningful if not idle
+  size_t getStepCount() const;
+  uint32_t getStepDuration(const SequenceStep& step) const;
+  void pause();
+  void resume();
+  bool isPaused() const;
+  bool setTempo(uint32_t tempo_percent);  // Playback speed in percent of the programmed one, kept for later shows
+  bool seek(uint32_t position_ms);        // Jumps to a time offset from the start of the running sequence
+  bool setGroupGain(uint8_t group, uint8_t gain_percent);
+  bool setStepDurations(size_t index, uint32_t ramp_down_ms, uint32_t pause_ms, uint32_t ramp_up_ms,
+                        uint32_t pulse_ms);
   void run();
+  int64_t getWakeUpUs() const;  // Next time run() has work to do (see EventLoop::wait)
 
  private:
   enum class State {
     IDLE = 0,
+    WAIT_START,
     RAMP_DOWN,
     PAUSE,
     RAMP_UP,
     PULSE,
+    STAGGERED,  // All phases of a step with a per LED start offset, see runStaggered()
+    CACHED,     // Repetition replayed from the frame cache, see bakeCycle()
   };
 
   struct Step {
@@ -41,19 +74,42 @@ class Player {
 
   Player() = default;
   void playStep(const SequenceStep& step);
+  void nextStep();
   bool isStepValid(const SequenceStep& step) const;
   uint32_t elapsedTime(uint32_t start_ms) const;
+  uint32_t showTime() const;
+  void applyFinalValues(const SequenceStep& step);
+  void resetOverrides();
   bool runRampDown();
   bool runPause();
   bool runRampUp(bool return_to_idle);
   bool runPulse(bool return_to_idle);
+  bool runStaggered();
+  bool bakeCycle();
+  void startCachedCycle(uint32_t start_ms);
+  bool runCached();
+  BrgNumber applyGain(uint32_t level, uint8_t group) const;
+  BrgNumber evaluateEnvelope(uint32_t time_ms, const LedObj& led) const;
+  BrgNumber evaluateCycle(uint32_t position_ms, bool return_to_idle, const LedObj& led) const;
 
   State state_ = State::IDLE;
   uint32_t last_run_ms_ = 0;
 
-  const SequenceStep* sequence_ = nullptr;
+  // Virtual show clock all step timing is based on, it stands still while paused and runs at the tempo otherwise
+  uint32_t clock_show_ms_ = 0;  // Show time at clock_real_ms_
+  uint32_t clock_real_ms_ = 0;
+  uint32_t tempo_percent_ = TempoDefaultPercent;
+  bool paused_ = false;
+
+  SequenceStep* sequence_ = nullptr;
   size_t step_count_ = 0;
   size_t step_index_ = 0;
+  int64_t start_at_us_ = 0;  // Device time (esp_timer) the sequence starts at
+
+  // Sequence that starts with the tick the current one ends on, optionally crossfading into it
+  const SequenceStep* queued_sequence_ = nullptr;
+  size_t queued_count_ = 0;  // 0 if nothing is queued
+  uint32_t queued_fade_ms_ = 0;
 
   LedObj* leds_ = nullptr;
   size_t size_ = 0;
@@ -70,6 +126,28 @@ class Player {
 
   uint32_t repetitions_ = 0;
   bool return_to_idle_ = false;
+  uint8_t group_ = 0;
+
+  // Live overrides of the running show, the envelope levels of every group are scaled by its gain
+  uint8_t group_gain_[MaxGroups] = {};
+  bool gain_changed_ = false;  // Gain of the current group changed, a running pulse follows it
+
+  uint32_t stagger_ms_ = 0;
+  uint32_t stagger_start_ms_ = 0;  // Start of the first LED
+  uint32_t stagger_tick_ms_ = 0;   // Last evaluation
+
+  // One repetition of the current step baked into delta frames, one frame per ramp tick. A frame is a run count
+  // (uint8_t) followed by runs of consecutive group LEDs changing to the same value (first, length - 1, value).
+  // Frame 0 sets the whole group to the value the repetition starts from.
+  uint8_t* frame_cache_ = nullptr;
+  size_t frame_cache_size_ = 0;
+  size_t cache_used_ = 0;        // Bytes of the baked repetition
+  uint32_t cache_frames_ = 0;    // Frames of the baked repetition
+  uint32_t cache_cycle_ms_ = 0;  // Duration of the baked repetition
+  bool cache_valid_ = false;     // The cache holds the repetition of the current step
+  uint32_t cache_start_ms_ = 0;  // Start of the cached repetition being played
+  size_t cache_offset_ = 0;      // Next frame to apply
+  uint32_t cache_frame_ = 0;     // Index of that frame
 };
 
 #endif  // PLAYER_H
\ No newline at end of file
@@ -0,0 +1,75 @@
+#include "StorageWorker.h"
+#include "EventLoop.h"
+
+#define LOG_LEVEL_STORAGEWORKER LOG_LEVEL_INFO
+#if ((LOG_LEVEL_STORAGEWORKER >= LOG_LEVEL_ERROR) && (ENABLE_DEBUG_OUTPUT == 1))
+#define DEBUG_ERROR(f, ...) debugPrint("[ERR][Storage]", f, ##__VA_ARGS__)
+#else
+#define DEBUG_ERROR(...)
+#endif
+#if ((LOG_LEVEL_STORAGEWORKER >= LOG_LEVEL_INFO) && (ENABLE_DEBUG_OUTPUT == 1))
+#define DEBUG_INFO(f, ...) debugPrint("[INF][Storage]", f, ##__VA_ARGS__)
+#else
+#define DEBUG_INFO(...)
+#endif
+
+void StorageWorker::initialize() {
+  DEBUG_INFO("Initialize StorageWorker [...]");
+
+  job_queue_ = xQueueCreate(QueueLength, sizeof(Job));
+  result_queue_ = xQueueCreate(QueueLength, sizeof(Job));
+  ASSERT(job_queue_ != nullptr && result_queue_ != nullptr);
+
+  BaseType_t created = xTaskCreatePinnedToCore(taskFunction, "storage", TaskStackSize, this,  //
+                                               TaskPriority, &task_, TaskCore);
+  ASSERT(created == pdPASS);
+
+  DEBUG_INFO("Initialize StorageWorker [OK]");
+}
+
+bool StorageWorker::submit(JobFunction job, CompletionCallback callback, int32_t tag) {
+  if (job == nullptr || job_queue_ == nullptr) {
+    return false;
+  }
+
+  Job entry = { job, callback, tag, false };
+  if (xQueueSend(job_queue_, &entry, 0) != pdTRUE) {
+    DEBUG_ERROR("Job queue full, rejecting job!");
+    return false;
+  }
+  pending_jobs_++;
+  return true;
+}
+
+bool StorageWorker::isBusy() const {
+  return pending_jobs_ > 0;
+}
+
+void StorageWorker::run() {
+  // Completion callbacks are dispatched from the loop, so they can safely use the BLE response path
+  Job entry;
+  while (result_queue_ != nullptr && xQueueReceive(result_queue_, &entry, 0) == pdTRUE) {
+    pending_jobs_--;
+    if (entry.callback != nullptr) {
+      entry.callback(entry.success, entry.tag);
+    }
+  }
+}
+
+void StorageWorker::taskFunction(void* parameter) {
+  StorageWorker* worker = static_cast<StorageWorker*>(parameter);
+  Job entry;
+
+  while (true) {
+    if (xQueueReceive(worker->job_queue_, &entry, portMAX_DELAY) != pdTRUE) {
+      continue;
+    }
+
+    uint32_t start_ms = millis();
+    entry.success = entry.function();
+    DEBUG_INFO("Job (tag: %d) finished in %u ms: %s", entry.tag, millis() - start_ms, entry.success ? "OK" : "FAILED");
+
+    xQueueSend(worker->result_queue_, &entry, portMAX_DELAY);
+    EventLoop::getInstance().notify(EventLoop::EVENT_STORAGE);
+  }
+}
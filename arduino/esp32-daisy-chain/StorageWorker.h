@@ -0,0 +1,46 @@
+#ifndef STORAGE_WORKER_H
+#define STORAGE_WORKER_H
+
+#include "common.h"
+
+class StorageWorker {
+  constexpr static uint32_t TaskStackSize = 4096;  // Stack size of the worker task in bytes
+  constexpr static UBaseType_t TaskPriority = 1;   // Below the Arduino loop task, NVS access is never urgent
+  constexpr static BaseType_t TaskCore = 0;        // Keep the render loop core (1) free
+  constexpr static size_t QueueLength = 4;         // Maximum number of pending jobs
+
+ public:
+  typedef bool (*JobFunction)();
+  typedef void (*CompletionCallback)(bool success, int32_t tag);
+
+  StorageWorker(const StorageWorker&) = delete;
+  StorageWorker& operator=(const StorageWorker&) = delete;
+
+  static StorageWorker& getInstance() {
+    static StorageWorker instance;
+    return instance;
+  }
+
+  void initialize();
+  bool submit(JobFunction job, CompletionCallback callback, int32_t tag);
+  bool isBusy() const;
+  void run();
+
+ private:
+  struct Job {
+    JobFunction function;
+    CompletionCallback callback;
+    int32_t tag;
+    bool success;
+  };
+
+  StorageWorker() = default;
+  static void taskFunction(void* parameter);
+
+  TaskHandle_t task_ = nullptr;
+  QueueHandle_t job_queue_ = nullptr;     // Jobs waiting for the worker task
+  QueueHandle_t result_queue_ = nullptr;  // Finished jobs waiting for their completion callback
+  volatile uint32_t pending_jobs_ = 0;    // Submitted jobs whose callback has not been invoked yet
+};
+
+#endif  // STORAGE_WORKER_H
@@ -0,0 +1,61 @@
+#include "Trace.h"
+#include "EventLoop.h"
+
+#define LOG_LEVEL_TRACE LOG_LEVEL_INFO
+#if ((LOG_LEVEL_TRACE >= LOG_LEVEL_INFO) && (ENABLE_DEBUG_OUTPUT == 1))
+#define DEBUG_INFO(f, ...) debugPrint("[INF][Trace]", f, ##__VA_ARGS__)
+#else
+#define DEBUG_INFO(...)
+#endif
+
+void Trace::freeze() {
+  // Called for every page of a dump, only the first one takes the snapshot
+  if (frozen_ == false) {
+    frozen_head_ = head_.load();
+    frozen_ = true;
+    DEBUG_INFO("Trace frozen (%zu records)", getSize());
+  }
+  freeze_start_ms_ = millis();
+}
+
+void Trace::resume() {
+  frozen_ = false;
+}
+
+void Trace::run() {
+  if (frozen_ == true && millis() - freeze_start_ms_ >= FreezeTimeoutMs) {
+    DEBUG_INFO("Trace dump abandoned, resume recording");
+    resume();
+  }
+}
+
+int64_t Trace::getWakeUpUs() const {
+  if (frozen_ == false) {
+    return EventLoop::WakeUpOnEvent;
+  }
+  uint32_t elapsed_ms = millis() - freeze_start_ms_;
+  return esp_timer_get_time() + ((elapsed_ms < FreezeTimeoutMs) ? (FreezeTimeoutMs - elapsed_ms) * 1000LL : 0);
+}
+
+size_t Trace::getSize() const {
+  uint32_t head = (frozen_ == true) ? frozen_head_ : head_.load();
+  return (head < Capacity) ? head : Capacity;
+}
+
+size_t Trace::getRecords(Record records[], size_t offset, size_t count) const {
+  // Offset 0 is the oldest record still in the ring
+  uint32_t head = (frozen_ == true) ? frozen_head_ : head_.load();
+  size_t size = getSize();
+  if (offset >= size) {
+    return 0;
+  }
+  if (count > size - offset) {
+    count = size - offset;
+  }
+
+  uint32_t first = head - size;
+  for (size_t i = 0; i < count; i++) {
+    records[i] = ring_[(first + offset + i) & (Capacity - 1)];
+  }
+  return count;
+}
@@ -0,0 +1,84 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <atomic>
+#include "common.h"
+#include "esp_timer.h"
+
+// Event ids, keep in sync with TRACE_EVENTS in tools/ConfigTool/TraceConverter.py
+enum class TraceEvent : uint16_t {
+  BLE_RX_CHUNK = 0,  // arg: chunk length
+  BLE_TX_CHUNK,      // arg: chunk length
+  BLE_TX_CONFIRM,    // arg: -
+  CMD_BEGIN,         // arg: request length
+  CMD_END,           // arg: request id
+  CMD_SCHEDULED,     // arg: request id
+  FRAME_COMMIT,      // arg: -
+  FLUSH_BEGIN,       // arg: chain index
+  FLUSH_END,         // arg: chain index
+  SPI_BEGIN,         // arg: transfer length
+  SPI_END,           // arg: transfer length
+  PLAYER_STEP,       // arg: step index
+  RAMP_TICK,         // arg: remaining ramp ticks
+};
+
+#if (ENABLE_TRACE == 1)
+#define TRACE(event, arg) Trace::getInstance().record(TraceEvent::event, static_cast<uint32_t>(arg))
+#else
+#define TRACE(event, arg)
+#endif
+
+class Trace {
+ public:
+  constexpr static size_t Capacity = 1024;  // Records in the ring, must be a power of two
+  static_assert((Capacity & (Capacity - 1)) == 0, "Capacity must be a power of two");
+
+  struct Record {
+    uint32_t time_us;  // Low 32 bits of esp_timer, unlike the cycle counter it runs on with power management
+    uint16_t event;    // TraceEvent
+    uint8_t core;
+    uint8_t reserved;
+    uint32_t arg;
+  };
+  static_assert(sizeof(Record) == 12, "Record layout is part of the dump format");
+
+  Trace(const Trace&) = delete;
+  Trace& operator=(const Trace&) = delete;
+
+  static Trace& getInstance() {
+    static Trace instance;
+    return instance;
+  }
+
+  inline void record(TraceEvent event, uint32_t arg) {
+    if (frozen_ == true) {
+      return;
+    }
+    uint32_t index = head_.fetch_add(1, std::memory_order_relaxed) & (Capacity - 1);
+    Record& record = ring_[index];
+    record.time_us = static_cast<uint32_t>(esp_timer_get_time());
+    record.event = static_cast<uint16_t>(event);
+    record.core = static_cast<uint8_t>(xPortGetCoreID());
+    record.arg = arg;
+  }
+
+  void freeze();
+  void resume();
+  void run();
+  int64_t getWakeUpUs() const;  // Freeze timeout while a dump is read (see EventLoop::wait)
+  size_t getSize() const;
+  size_t getRecords(Record records[], size_t offset, size_t count) const;
+
+ private:
+  constexpr static uint32_t FreezeTimeoutMs = 5000;  // Resume recording if a dump is abandoned
+
+  Trace() = default;
+
+  Record ring_[Capacity] = {};
+  std::atomic<uint32_t> head_{ 0 };  // Total number of records written, the ring holds the last Capacity
+  volatile bool frozen_ = false;     // Recording paused while a dump is read
+  uint32_t freeze_start_ms_ = 0;
+  uint32_t frozen_head_ = 0;
+};
+
+#endif  // TRACE_H
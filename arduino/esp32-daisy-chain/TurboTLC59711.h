@@ -4,13 +4,16 @@
 #include <Arduino.h>
 #include <cstring>
 
+// N is the capacity, the number of devices actually driven is set with init()
 template <size_t N>
 class TurboTLC59711 {
  public:
+  constexpr static size_t BcMaxValue = 127;  // Maximum brightness value for BC (7 bits)
+
   TurboTLC59711() = default;
   ~TurboTLC59711() = default;
 
-  void init();
+  void init(size_t device_count = N);
   void setBrightness(uint8_t bcr, uint8_t bcg, uint8_t bcb);
   bool setLed(uint8_t chip_idx, uint8_t led_idx, uint16_t r, uint16_t g, uint16_t b);
 
@@ -20,7 +23,6 @@ class TurboTLC59711 {
  private:
   constexpr static size_t BytesPerDevice = 224 / 8;  // 224 bits / 8 bits per byte
   constexpr static size_t LedsPerDevice = 4;         // 4 RGB LEDs per device
-  constexpr static size_t BcMaxValue = 127;          // Maximum brightness value for BC (7 bits)
   constexpr static size_t HeaderSize = 4;            // Size of the header in bytes
 
   constexpr static size_t OffsetGsr0 = 26;  // Offset for GR0
@@ -99,10 +101,12 @@ class TurboTLC59711 {
   };
 
   uint8_t chain_buffer_[N * BytesPerDevice];
+  size_t device_count_ = N;
 };
 
 template <size_t N>
-void TurboTLC59711<N>::init() {
+void TurboTLC59711<N>::init(size_t device_count) {
+  device_count_ = (device_count <= N) ? device_count : N;
   std::memset(chain_buffer_, 0, sizeof(chain_buffer_));
 
   Header header;
@@ -117,7 +121,7 @@ void TurboTLC59711<N>::init() {
   header.bcr = BcMaxValue;
 
   uint32_t serialized_header = header.serialize();
-  for (size_t i = 0; i < N; ++i) {
+  for (size_t i = 0; i < device_count_; ++i) {
     size_t chip_offset = i * BytesPerDevice;
     // Each device has a 4-byte header at the start
     chain_buffer_[chip_offset] = static_cast<uint8_t>((serialized_header >> 24) & 0xFF);
@@ -150,7 +154,7 @@ void TurboTLC59711<N>::setBrightness(uint8_t bcr, uint8_t bcg, uint8_t bcb) {
   header.bcb = bcb;
   serialized_header = header.serialize();
 
-  for (size_t i = 0; i < N; ++i) {
+  for (size_t i = 0; i < device_count_; ++i) {
     size_t chip_offset = i * BytesPerDevice;
     chain_buffer_[chip_offset] = static_cast<uint8_t>((serialized_header >> 24) & 0xFF);
     chain_buffer_[chip_offset + 1] = static_cast<uint8_t>((serialized_header >> 16) & 0xFF);
@@ -161,7 +165,7 @@ void TurboTLC59711<N>::setBrightness(uint8_t bcr, uint8_t bcg, uint8_t bcb) {
 
 template <size_t N>
 bool TurboTLC59711<N>::setLed(uint8_t chip_idx, uint8_t led_idx, uint16_t r, uint16_t g, uint16_t b) {
-  if (chip_idx >= N || led_idx >= LedsPerDevice) {
+  if (chip_idx >= device_count_ || led_idx >= LedsPerDevice) {
     return false;  // Invalid chip or LED index
   }
 
@@ -188,7 +192,7 @@ const uint8_t* TurboTLC59711<N>::getChainBuffer() const {
 
 template <size_t N>
 size_t TurboTLC59711<N>::getChainBufferSize() const {
-  return sizeof(chain_buffer_);
+  return device_count_ * BytesPerDevice;
 }
 
 #endif  // TURBOTLC59711_H_
@@ -1,30 +1,47 @@
 #include "common.h"
 #include <Preferences.h>
+#include "DaisyChain.h"
 
-#define DEBUG_ENABLE_COMMON 1
-#if ((DEBUG_ENABLE_COMMON == 1) && (ENABLE_DEBUG_OUTPUT == 1))
-#define DEBUG_INFO(f, ...) debugPrint("[INF][common]", f, ##__VA_ARGS__)
+#define LOG_LEVEL_COMMON LOG_LEVEL_INFO
+#if ((LOG_LEVEL_COMMON >= LOG_LEVEL_ERROR) && (ENABLE_DEBUG_OUTPUT == 1))
 #define DEBUG_ERROR(f, ...) debugPrint("[ERR][common]", f, ##__VA_ARGS__)
 #else
-#define DEBUG_INFO(...)
 #define DEBUG_ERROR(...)
 #endif
+#if ((LOG_LEVEL_COMMON >= LOG_LEVEL_INFO) && (ENABLE_DEBUG_OUTPUT == 1))
+#define DEBUG_INFO(f, ...) debugPrint("[INF][common]", f, ##__VA_ARGS__)
+#else
+#define DEBUG_INFO(...)
+#endif
 
 static char system_id_[SystemIdMaxLength] = "";
 
-void debugPrint(const char* prefix, const char* fmt, ...) {
-  uint32_t ms = (uint32_t)millis();
-  uint32_t sec = (ms / 1000) & 0x0F;  // wrap seconds 0..15
-  uint16_t msec = ms % 1000;
+// Original installation: six chains of ten boards
+constexpr Topology DefaultTopology = { 6, 10, { 48, 47, 21, 10, 9, 3 } };
+// Output capable pins a select line must not be put on, they are driven at every boot and a wrong one can't be undone
+// over BLE once the device no longer boots
+constexpr uint8_t ReservedPins[] = {
+  0, 45, 46,                                        // Strapping pins
+  DaisyChain::SpiDataPin, DaisyChain::SpiClockPin,  // LED chain SPI
+  19, 20,                                           // USB
+  26, 27, 28, 29, 30, 31, 32,                       // SPI flash / PSRAM
+  33, 34, 35, 36, 37,                               // Octal PSRAM
+  38,                                               // Player run toggle (TP1)
+  43, 44,                                           // UART0 (console)
+};
+static Topology topology_ = {};
+static uint32_t refresh_interval_ms_ = UINT32_MAX;  // Not loaded yet
 
-  Serial.printf("[%u.%03u] %s: ", sec, msec, prefix);
-
-  va_list ap;
-  va_start(ap, fmt);
-  Serial.vprintf(fmt, ap);
-  va_end(ap);
-
-  Serial.print("\n");
+uint32_t crc32(const uint8_t data[], size_t length, uint32_t crc) {
+  // CRC-32 (IEEE 802.3, reflected), compatible with zlib.crc32() on the host side
+  crc = ~crc;
+  for (size_t i = 0; i < length; i++) {
+    crc ^= data[i];
+    for (uint8_t bit = 0; bit < 8; bit++) {
+      crc = (crc >> 1) ^ (0xEDB88320 & (0 - (crc & 1)));
+    }
+  }
+  return ~crc;
 }
 
 const char* getSystemId() {
@@ -58,3 +75,81 @@ void setSystemId(const char* identifier) {
   strncpy(system_id_, identifier, SystemIdMaxLength);
   system_id_[SystemIdMaxLength - 1] = '\0';  // Ensure null-termination
 }
+
+const Topology& getTopology() {
+  if (topology_.chain_count == 0) {
+    Preferences preferences;
+    preferences.begin("system", true);
+    size_t length = preferences.getBytes("topology", &topology_, sizeof(topology_));
+    preferences.end();
+    if (length != sizeof(topology_) || isTopologyValid(topology_) == false) {
+      topology_ = DefaultTopology;
+    }
+    DEBUG_INFO("Topology: %u chains x %u boards", topology_.chain_count, topology_.chain_size);
+  }
+  return topology_;
+}
+
+bool isTopologyValid(const Topology& topology) {
+  if (topology.chain_count == 0 || topology.chain_count > CHAIN_COUNT_MAX ||  //
+      topology.chain_size == 0 || topology.chain_size > CHAIN_SIZE_MAX) {
+    return false;
+  }
+  for (size_t i = 0; i < topology.chain_count; i++) {
+    if (GPIO_IS_VALID_OUTPUT_GPIO(topology.select_pins[i]) == false) {
+      return false;
+    }
+    for (size_t j = 0; j < sizeof(ReservedPins); j++) {
+      if (topology.select_pins[i] == ReservedPins[j]) {
+        return false;
+      }
+    }
+    for (size_t j = 0; j < i; j++) {
+      if (topology.select_pins[i] == topology.select_pins[j]) {
+        return false;  // Chains must not share a select pin
+      }
+    }
+  }
+  return true;
+}
+
+bool setTopology(const Topology& topology) {
+  if (isTopologyValid(topology) == false) {
+    DEBUG_ERROR("Invalid topology!");
+    return false;
+  }
+
+  Preferences preferences;
+  preferences.begin("system", false);
+  size_t length = preferences.putBytes("topology", &topology, sizeof(topology));
+  preferences.end();
+  return length == sizeof(topology);
+}
+
+uint32_t getRefreshInterval() {
+  if (refresh_interval_ms_ == UINT32_MAX) {
+    Preferences preferences;
+    preferences.begin("system", true);
+    refresh_interval_ms_ = preferences.getUInt("refresh_ms", RefreshIntervalDefaultMs);
+    preferences.end();
+    if (refresh_interval_ms_ > RefreshIntervalMaxMs) {
+      refresh_interval_ms_ = RefreshIntervalDefaultMs;
+    }
+    DEBUG_INFO("Refresh interval: %u ms", refresh_interval_ms_);
+  }
+  return refresh_interval_ms_;
+}
+
+bool setRefreshInterval(uint32_t interval_ms) {
+  if (interval_ms > RefreshIntervalMaxMs) {
+    DEBUG_ERROR("Invalid refresh interval!");
+    return false;
+  }
+
+  Preferences preferences;
+  preferences.begin("system", false);
+  size_t length = preferences.putUInt("refresh_ms", interval_ms);
+  preferences.end();
+  refresh_interval_ms_ = interval_ms;
+  return length == sizeof(interval_ms);
+}
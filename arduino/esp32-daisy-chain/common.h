@@ -6,12 +6,21 @@
 #define ENABLE_DEBUG_OUTPUT 1
 constexpr char FIRMWARE_VERSION[] = "V0.0.5";
 constexpr char DIVIDER[] = "<=====================================>";
-#define DISABLE_HARDWARE 0  // Set to 1 to disable hardware specific code for BLE testing
+#define DISABLE_HARDWARE 0         // Set to 1 to disable hardware specific code for BLE testing
+#define ENABLE_TRACE 1             // Set to 0 to remove all trace points (see Trace.h)
+#define ENABLE_POWER_MANAGEMENT 1  // Set to 0 to keep the CPU at full speed while idle (see EventLoop.h)
+#define ENABLE_FRAME_CACHE 1       // Set to 0 to evaluate repeated steps live on every cycle (see Player.h)
 static_assert((ENABLE_DEBUG_OUTPUT == 0 && DISABLE_HARDWARE == 0) || (ENABLE_DEBUG_OUTPUT == 1),  //
               "ENABLE_DEBUG_OUTPUT must be 1 if DISABLE_HARDWARE is 0");
 
+// Per-module log levels (LOG_LEVEL_<MODULE> in each source file), messages above the level are compiled out
+#define LOG_LEVEL_NONE 0
+#define LOG_LEVEL_ERROR 1
+#define LOG_LEVEL_INFO 2
+#define LOG_LEVEL_VERBOSE 3  // Per LED and per BLE chunk messages
+
 #if ENABLE_DEBUG_OUTPUT == 1
-void debugPrint(const char* prefix, const char* fmt, ...);
+#include "Logger.h"
 #endif
 
 #if ENABLE_DEBUG_OUTPUT == 1
@@ -33,11 +42,11 @@ void debugPrint(const char* prefix, const char* fmt, ...);
 #define ASSERT(condition)
 #endif
 
-// Number of chained boards
-constexpr size_t CHAIN_COUNT = 6;
-constexpr size_t CHAIN_SIZE = 10;
+// Topology limits, the actual topology (see Topology) is read from NVS at boot
+constexpr size_t CHAIN_COUNT_MAX = 8;
+constexpr size_t CHAIN_SIZE_MAX = 30;  // Global pcb indices must fit into uint8_t (8 * 30 < 255)
 constexpr size_t LED_COUNT = 12;
-constexpr size_t LED_COUNT_TOTAL = CHAIN_COUNT * CHAIN_SIZE * LED_COUNT;
+constexpr size_t LED_COUNT_TOTAL_MAX = CHAIN_COUNT_MAX * CHAIN_SIZE_MAX * LED_COUNT;
 
 enum class ChainIdx : uint8_t {
   CHAIN_0 = 0,
@@ -46,7 +55,18 @@ enum class ChainIdx : uint8_t {
   CHAIN_3 = 3,
   CHAIN_4 = 4,
   CHAIN_5 = 5,
-  CHAIN_COUNT = CHAIN_COUNT,
+  CHAIN_6 = 6,
+  CHAIN_7 = 7,
+};
+
+struct Topology {
+  uint8_t chain_count;                   // Number of chains (1..CHAIN_COUNT_MAX)
+  uint8_t chain_size;                    // Boards per chain (1..CHAIN_SIZE_MAX)
+  uint8_t select_pins[CHAIN_COUNT_MAX];  // Chip select pin of each chain
+
+  size_t ledCount() const {
+    return static_cast<size_t>(chain_count) * chain_size * LED_COUNT;
+  }
 };
 
 typedef uint8_t BrgNumber;
@@ -66,6 +86,8 @@ struct SequenceStep {
   uint32_t ramp_up_duration_ms;
   uint32_t pulse_duration_ms;
   uint32_t repetitions;  // Actually repetitions + 1
+  uint32_t stagger_ms;   // Start offset between consecutive LEDs of the group, 0 plays all LEDs together
+  uint8_t group;         // Index of the group in the show, selects the live gain (see Player::setGroupGain)
   // BrgNumber pause_brightness;
   // BrgNumber pulse_brightness;
   // bool pause_brightness_to_default;
@@ -78,8 +100,19 @@ enum class BrgName : BrgNumber {
   MAX = 100,
 };
 
+uint32_t crc32(const uint8_t data[], size_t length, uint32_t crc = 0);
+
 constexpr size_t SystemIdMaxLength = 64;
 const char* getSystemId();
 void setSystemId(const char* identifier);
 
+const Topology& getTopology();
+bool isTopologyValid(const Topology& topology);
+bool setTopology(const Topology& topology);  // Persisted only, takes effect after a reboot
+
+constexpr uint32_t RefreshIntervalDefaultMs = 3000;
+constexpr uint32_t RefreshIntervalMaxMs = 10 * 60 * 1000;
+uint32_t getRefreshInterval();                  // Time to rewrite all chains once, 0 if the refresh is disabled
+bool setRefreshInterval(uint32_t interval_ms);  // Persisted and applied immediately
+
 #endif  // CHAIN_CONFIG_H
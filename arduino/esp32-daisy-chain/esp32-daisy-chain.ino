@@ -1,63 +1,101 @@
 #include "BleManager.h"
 #include "Controller.h"
 #include "DaisyChain.h"
+#include "Effects.h"
+#include "EventLoop.h"
+#include "Keyframes.h"
+#include "Metrics.h"
 #include "Player.h"
+#include "StorageWorker.h"
+#include "Trace.h"
 #include "common.h"
 
-#define DEBUG_ENABLE_MAIN 1
-#if ((DEBUG_ENABLE_MAIN == 1) && (ENABLE_DEBUG_OUTPUT == 1))
-#define DEBUG_INFO(f, ...) debugPrint("[INF][Main]", f, ##__VA_ARGS__)
+#define LOG_LEVEL_MAIN LOG_LEVEL_INFO
+#if ((LOG_LEVEL_MAIN >= LOG_LEVEL_ERROR) && (ENABLE_DEBUG_OUTPUT == 1))
 #define DEBUG_ERROR(f, ...) debugPrint("[ERR][Main]", f, ##__VA_ARGS__)
 #else
-#define DEBUG_INFO(...)
 #define DEBUG_ERROR(...)
 #endif
+#if ((LOG_LEVEL_MAIN >= LOG_LEVEL_INFO) && (ENABLE_DEBUG_OUTPUT == 1))
+#define DEBUG_INFO(f, ...) debugPrint("[INF][Main]", f, ##__VA_ARGS__)
+#else
+#define DEBUG_INFO(...)
+#endif
 
-constexpr uint32_t RefreshIntervalMs = 3000;
-uint32_t last_refresh_ms = 0;
-bool force_refresh = false;
+uint32_t last_loop_us = 0;
+
+// Earliest time any module has work to do
+int64_t getWakeUpUs() {
+  const int64_t module_wake_ups_us[] = {
+    BleManager::getInstance().getWakeUpUs(),
+    Controller::getInstance().getWakeUpUs(),
+    Player::getInstance().getWakeUpUs(),
+    Keyframes::getInstance().getWakeUpUs(),
+    DaisyChain::getInstance().getWakeUpUs(),
+    Effects::getInstance().getWakeUpUs(),
+    Trace::getInstance().getWakeUpUs(),
+  };
+  int64_t wake_up_us = EventLoop::WakeUpOnEvent;
+  for (int64_t module_wake_up_us : module_wake_ups_us) {
+    if (module_wake_up_us < wake_up_us) {
+      wake_up_us = module_wake_up_us;
+    }
+  }
+  return wake_up_us;
+}
 
 void setup() {
   setCpuFrequencyMhz(240);
 
 #if (ENABLE_DEBUG_OUTPUT == 1)
   Serial.begin(921600);
+  Logger::getInstance().initialize();
 #endif
   DEBUG_INFO(DIVIDER);
   DEBUG_INFO("Setup ESP32-daisy-chain [...]");
   DEBUG_INFO("Firmware version: %s", FIRMWARE_VERSION);
-  DEBUG_INFO("System id: '%s'", getSystemId());
-  DEBUG_INFO("Free heap: %u bytes", ESP.getFreeHeap());
-  DEBUG_INFO("CPU frequency: %d MHz", getCpuFrequencyMhz());
 #if (DISABLE_HARDWARE == 1)
   DEBUG_INFO(DIVIDER);
   DEBUG_INFO("Hardware specific code is DISABLED!");
   DEBUG_INFO(DIVIDER);
 #endif
-  sleep(0.25);
 
+  // Calibrated idle frame first, everything else is only needed once a client connects
+  Metrics::getInstance().reset();
   DaisyChain::getInstance().initialize();
+  Metrics::getInstance().recordBootStage(Metrics::BootStage::FIRST_FRAME);
+
+  EventLoop::getInstance().initialize();
+  StorageWorker::getInstance().initialize();
   Player::getInstance().initialize();
   Controller::getInstance().initialize();
-  BleManager::getInstance().initialize();
+  BleManager::getInstance().initializeAsync();
 
+  DEBUG_INFO("First frame after %u us", Metrics::getInstance().getBootStageUs(Metrics::BootStage::FIRST_FRAME));
+  DEBUG_INFO("System id: '%s'", getSystemId());
+  DEBUG_INFO("Free heap: %u bytes", ESP.getFreeHeap());
+  DEBUG_INFO("CPU frequency: %d MHz", getCpuFrequencyMhz());
+  last_loop_us = micros();
   DEBUG_INFO("Setup ESP32-daisy-chain [OK]");
   DEBUG_INFO(DIVIDER);
 }
 
 void loop() {
+  uint32_t loop_start_us = micros();
+  Metrics::getInstance().record(Metrics::Histogram::LOOP_PERIOD, loop_start_us - last_loop_us);
+  last_loop_us = loop_start_us;
+
   BleManager::getInstance().run();
+  StorageWorker::getInstance().run();
   Controller::getInstance().run();
   Player::getInstance().run();
+  Keyframes::getInstance().run();
 
-  if (Player::getInstance().isIdle() == true && (millis() - last_refresh_ms) >= RefreshIntervalMs) {
-#if (DISABLE_HARDWARE == 0)  // Only print if hardware is enabled to avoid spamming the output
-    DEBUG_INFO("Periodic refresh of all chains ...");
-#endif
-    last_refresh_ms = millis();
-    force_refresh = true;
-  }
+  // Publish everything changed during this iteration as one frame before flushing
+  DaisyChain::getInstance().commitFrame();
+  DaisyChain::getInstance().flushAll();
+  DaisyChain::getInstance().runRefresh();
 
-  DaisyChain::getInstance().flushAll(force_refresh);
-  force_refresh = false;
+  // Sleep until an event arrives or a module has work to do, instead of spinning
+  EventLoop::getInstance().wait(getWakeUpUs());
 }
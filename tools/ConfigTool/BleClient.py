@@ -2,6 +2,7 @@ import asyncio
 from bleak import BleakScanner
 from bleak import BleakClient
 from helper import format_log_message
+import Lzss
 
 
 # Name of ESP32 BLE device
@@ -21,6 +22,9 @@ class BleClient:
         self.client: BleakClient | None = None
         self.response_buffer = bytearray()
         self.print_cb = None
+        self.retries = 0  # Resends of a request without response, the device replays the response of a known rid
+        self.pack_min_length = 0  # Longer requests are sent packed if that makes them shorter (0: never)
+        self.request_length_max = 0  # Longest request the device accepts, decoded length if packed (0: unknown)
 
     def log(self, message):
         message = format_log_message(message, "[BleClient]")
@@ -78,6 +82,24 @@ class BleClient:
         if not self.client or not self.client.is_connected:
             raise RuntimeError("Not connected to BLE device!")
 
+        if self.request_length_max > 0 and len(command) > self.request_length_max:
+            raise ValueError(f"Request ({len(command)} bytes) exceeds the device limit ({self.request_length_max})")
+        if self.pack_min_length > 0 and len(command) >= self.pack_min_length:
+            packed = Lzss.pack(command)
+            if len(packed) < len(command):
+                self.log(f"Packed request ({len(command)} -> {len(packed)} bytes)")
+                command = packed
+
+        # A retry sends the same bytes, the device recognizes the rid and does not execute the request twice
+        for attempt in range(self.retries + 1):
+            if attempt > 0:
+                self.log(f"No response, retry {attempt} of {self.retries} ...")
+            if await self._send_once(command, timeout):
+                return self.response_buffer
+
+        raise TimeoutError("Timeout waiting for response from BLE device!")
+
+    async def _send_once(self, command: bytearray, timeout) -> bool:
         self.response_buffer.clear()
         self.log(f"Sending({len(command)} bytes): {command}")
 
@@ -91,6 +113,6 @@ class BleClient:
             await asyncio.sleep(0.1)
             timeout -= 0.1
             if timeout <= 0:
-                raise TimeoutError("Timeout waiting for response from BLE device!")
+                return False
 
-        return self.response_buffer
+        return True
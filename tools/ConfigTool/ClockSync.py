@@ -0,0 +1,75 @@
+MIN_SAMPLES = 4  # Samples needed before a drift estimate is trusted
+BEST_SAMPLE_RATIO = 0.5  # Fraction of samples (lowest round trip delay) used for the fit
+MIN_DRIFT_SPAN_US = 10_000_000  # Shorter sample spans give a drift estimate dominated by latency jitter
+
+
+class ClockSync:
+    """Estimates the device clock from NTP-style 'sync_time' exchanges.
+
+    Each exchange yields four timestamps in microseconds:
+        t1: host time the request was sent
+        t2: device time the request arrived (rx_us)
+        t3: device time the response was sent (tx_us)
+        t4: host time the response arrived
+
+    Samples with a short round trip carry the least asymmetric BLE latency, so only the best ones are
+    used to fit device_time = host_time + offset + drift * (host_time - reference).
+    """
+
+    def __init__(self):
+        self.samples = []  # (host midpoint, offset, round trip delay)
+        self.reference = 0.0
+        self.offset = 0.0
+        self.drift = 0.0
+
+    def reset(self):
+        self.samples.clear()
+        self.reference = 0.0
+        self.offset = 0.0
+        self.drift = 0.0
+
+    def add_sample(self, t1: int, t2: int, t3: int, t4: int):
+        if t4 < t1 or t3 < t2:
+            raise ValueError(f"Invalid timestamps: t1={t1}, t2={t2}, t3={t3}, t4={t4}")
+        delay = (t4 - t1) - (t3 - t2)
+        offset = ((t2 - t1) + (t3 - t4)) / 2
+        self.samples.append(((t1 + t4) / 2, offset, delay))
+        self._fit()
+
+    def _fit(self):
+        count = max(1, int(len(self.samples) * BEST_SAMPLE_RATIO))
+        best = sorted(self.samples, key=lambda sample: sample[2])[:count]
+        best.sort(key=lambda sample: sample[0])
+
+        self.reference = sum(sample[0] for sample in best) / len(best)
+        self.offset = sum(sample[1] for sample in best) / len(best)
+        self.drift = 0.0
+        if len(best) < MIN_SAMPLES or best[-1][0] - best[0][0] < MIN_DRIFT_SPAN_US:
+            return
+
+        # Least squares line through (host time, offset), centered at the reference time
+        variance = sum((sample[0] - self.reference) ** 2 for sample in best)
+        if variance > 0:
+            covariance = sum((sample[0] - self.reference) * (sample[1] - self.offset) for sample in best)
+            self.drift = covariance / variance
+
+    def is_synced(self) -> bool:
+        return len(self.samples) > 0
+
+    def round_trip_us(self) -> int | None:
+        if not self.samples:
+            return None
+        return min(sample[2] for sample in self.samples)
+
+    def to_device_time(self, host_time_us: int) -> int:
+        if not self.is_synced():
+            raise RuntimeError("No clock samples available. Call 'add_sample' first!")
+        offset = self.offset + self.drift * (host_time_us - self.reference)
+        return round(host_time_us + offset)
+
+    def to_host_time(self, device_time_us: int) -> int:
+        if not self.is_synced():
+            raise RuntimeError("No clock samples available. Call 'add_sample' first!")
+        # device = host + offset + drift * (host - reference) solved for host
+        host_time_us = (device_time_us - self.offset + self.drift * self.reference) / (1 + self.drift)
+        return round(host_time_us)
@@ -1,4 +1,6 @@
+import base64
 import json
+import zlib
 import DaisyChain as dc
 
 
@@ -57,6 +59,81 @@ class CmdBuilder:
         _, version = CmdBuilder._evaluate_response(response, rid=rid, status=0, version=str)
         return version
 
+    @staticmethod
+    def sync_time(rid: int):
+        doc = {
+            "rid": rid,
+            "cmd": "sync_time",
+        }
+        json_bytes = bytearray(json.dumps(doc, separators=(",", ":")) + "\0", "utf-8")
+        return json_bytes
+
+    @staticmethod
+    def evaluate_sync_time_response(response: bytearray, rid: int) -> tuple[int, int] | None:
+        success, tx_us = CmdBuilder._evaluate_response(response, rid=rid, status=0, rx_us=int, tx_us=int)
+        if not success:
+            return None
+        _, rx_us = CmdBuilder._evaluate_response(response, rx_us=int)
+        return rx_us, tx_us
+
+    @staticmethod
+    def get_stats(rid: int):
+        doc = {
+            "rid": rid,
+            "cmd": "get_stats",
+        }
+        json_bytes = bytearray(json.dumps(doc, separators=(",", ":")) + "\0", "utf-8")
+        return json_bytes
+
+    @staticmethod
+    def evaluate_get_stats_response(response: bytearray, rid: int) -> dict | None:
+        success, _ = CmdBuilder._evaluate_response(response, rid=rid, status=0, counters=dict, histograms=dict)
+        if not success:
+            return None
+        doc = json.loads(response.decode("utf-8").rstrip("\0"))
+        del doc["rid"], doc["status"]
+        return doc
+
+    @staticmethod
+    def reset_stats(rid: int):
+        doc = {
+            "rid": rid,
+            "cmd": "reset_stats",
+        }
+        json_bytes = bytearray(json.dumps(doc, separators=(",", ":")) + "\0", "utf-8")
+        return json_bytes
+
+    @staticmethod
+    def evaluate_reset_stats_response(response: bytearray, rid: int) -> bool:
+        success, _ = CmdBuilder._evaluate_response(response, rid=rid, status=0)
+        return success
+
+    @staticmethod
+    def get_trace(rid: int, offset: int, length: int):
+        if offset < 0 or length <= 0:
+            raise ValueError(f"Invalid trace range (offset: {offset}, length: {length})")
+        doc = {
+            "rid": rid,
+            "cmd": "get_trace",
+            "offset": offset,
+            "length": length,
+        }
+        json_bytes = bytearray(json.dumps(doc, separators=(",", ":")) + "\0", "utf-8")
+        return json_bytes
+
+    @staticmethod
+    def evaluate_get_trace_response(response: bytearray, rid: int) -> tuple[int, bytes] | None:
+        success, data = CmdBuilder._evaluate_response(response, rid=rid, status=0, size=int, data=str)
+        if not success:
+            return None
+
+        doc = json.loads(response.decode("utf-8").rstrip("\0"))
+        try:
+            records = base64.b64decode(data, validate=True)
+        except ValueError:
+            return None
+        return (doc["size"], records)
+
     @staticmethod
     def get_system_id(rid: int):
         doc = {
@@ -86,6 +163,85 @@ class CmdBuilder:
         success, _ = CmdBuilder._evaluate_response(response, rid=rid, status=0)
         return success
 
+    @staticmethod
+    def get_topology(rid: int):
+        doc = {
+            "rid": rid,
+            "cmd": "get_topology",
+        }
+        json_bytes = bytearray(json.dumps(doc, separators=(",", ":")) + "\0", "utf-8")
+        return json_bytes
+
+    @staticmethod
+    def evaluate_get_topology_response(response: bytearray, rid: int) -> tuple[int, int, list[int]] | None:
+        success, pins = CmdBuilder._evaluate_response(
+            response, rid=rid, status=0, chains=int, chain_size=int, pins=list
+        )
+        if not success:
+            return None
+        _, chains = CmdBuilder._evaluate_response(response, chains=int)
+        _, chain_size = CmdBuilder._evaluate_response(response, chain_size=int)
+        return chains, chain_size, pins
+
+    @staticmethod
+    def set_topology(rid: int, chains: int, chain_size: int, pins: list[int]):
+        if not (0 < chains <= dc.CHAIN_COUNT_MAX):
+            raise ValueError(f"chains ({chains}) out of range [1, {dc.CHAIN_COUNT_MAX}]")
+        if not (0 < chain_size <= dc.CHAIN_SIZE_MAX):
+            raise ValueError(f"chain_size ({chain_size}) out of range [1, {dc.CHAIN_SIZE_MAX}]")
+        if len(pins) != chains:
+            raise ValueError(f"Number of pins ({len(pins)}) does not match number of chains ({chains})")
+        for pin in pins:
+            if pin in dc.RESERVED_PINS:
+                raise ValueError(f"Pin ({pin}) is reserved")
+        if len(set(pins)) != len(pins):
+            raise ValueError(f"Pins ({pins}) must be unique")
+        doc = {
+            "rid": rid,
+            "cmd": "set_topology",
+            "chains": chains,
+            "chain_size": chain_size,
+            "pins": pins,
+        }
+        json_bytes = bytearray(json.dumps(doc, separators=(",", ":")) + "\0", "utf-8")
+        return json_bytes
+
+    @staticmethod
+    def evaluate_set_topology_response(response: bytearray, rid: int) -> bool:
+        success, _ = CmdBuilder._evaluate_response(response, rid=rid, status=0)
+        return success
+
+    @staticmethod
+    def get_refresh_interval(rid: int):
+        doc = {
+            "rid": rid,
+            "cmd": "get_refresh_interval",
+        }
+        json_bytes = bytearray(json.dumps(doc, separators=(",", ":")) + "\0", "utf-8")
+        return json_bytes
+
+    @staticmethod
+    def evaluate_get_refresh_interval_response(response: bytearray, rid: int) -> int | None:
+        success, interval_ms = CmdBuilder._evaluate_response(response, rid=rid, status=0, interval_ms=int)
+        return interval_ms if success else None
+
+    @staticmethod
+    def set_refresh_interval(rid: int, interval_ms: int):
+        if not (0 <= interval_ms <= dc.REFRESH_INTERVAL_MAX_MS):
+            raise ValueError(f"interval_ms ({interval_ms}) out of range [0, {dc.REFRESH_INTERVAL_MAX_MS}]")
+        doc = {
+            "rid": rid,
+            "cmd": "set_refresh_interval",
+            "interval_ms": interval_ms,
+        }
+        json_bytes = bytearray(json.dumps(doc, separators=(",", ":")) + "\0", "utf-8")
+        return json_bytes
+
+    @staticmethod
+    def evaluate_set_refresh_interval_response(response: bytearray, rid: int) -> bool:
+        success, _ = CmdBuilder._evaluate_response(response, rid=rid, status=0)
+        return success
+
     @staticmethod
     def get_calibration_name(rid: int):
         doc = {
@@ -129,6 +285,72 @@ class CmdBuilder:
         success, _ = CmdBuilder._evaluate_response(response, rid=rid, status=0)
         return success
 
+    @staticmethod
+    def list_profiles(rid: int):
+        doc = {
+            "rid": rid,
+            "cmd": "list_profiles",
+        }
+        json_bytes = bytearray(json.dumps(doc, separators=(",", ":")) + "\0", "utf-8")
+        return json_bytes
+
+    @staticmethod
+    def evaluate_list_profiles_response(response: bytearray, rid: int) -> tuple[str, list[str]] | None:
+        success, profiles = CmdBuilder._evaluate_response(response, rid=rid, status=0, name=str, profiles=list)
+        if not success or not all(isinstance(name, str) for name in profiles):
+            return None
+        _, active = CmdBuilder._evaluate_response(response, name=str)
+        return active, profiles
+
+    @staticmethod
+    def save_profile(rid: int, name: str):
+        doc = {
+            "rid": rid,
+            "cmd": "save_profile",
+            "name": name,
+        }
+        json_bytes = bytearray(json.dumps(doc, separators=(",", ":")) + "\0", "utf-8")
+        return json_bytes
+
+    @staticmethod
+    def evaluate_save_profile_response(response: bytearray, rid: int) -> bool:
+        success, _ = CmdBuilder._evaluate_response(response, rid=rid, status=0)
+        return success
+
+    @staticmethod
+    def select_profile(rid: int, name: str, fade_ms: int = 0):
+        if not (0 <= fade_ms <= dc.FADE_MAX_MS):
+            raise ValueError(f"fade_ms ({fade_ms}) out of range [0, {dc.FADE_MAX_MS}]")
+        doc = {
+            "rid": rid,
+            "cmd": "select_profile",
+            "name": name,
+        }
+        if fade_ms > 0:
+            doc["fade_ms"] = fade_ms
+        json_bytes = bytearray(json.dumps(doc, separators=(",", ":")) + "\0", "utf-8")
+        return json_bytes
+
+    @staticmethod
+    def evaluate_select_profile_response(response: bytearray, rid: int) -> bool:
+        success, _ = CmdBuilder._evaluate_response(response, rid=rid, status=0)
+        return success
+
+    @staticmethod
+    def delete_profile(rid: int, name: str):
+        doc = {
+            "rid": rid,
+            "cmd": "delete_profile",
+            "name": name,
+        }
+        json_bytes = bytearray(json.dumps(doc, separators=(",", ":")) + "\0", "utf-8")
+        return json_bytes
+
+    @staticmethod
+    def evaluate_delete_profile_response(response: bytearray, rid: int) -> bool:
+        success, _ = CmdBuilder._evaluate_response(response, rid=rid, status=0)
+        return success
+
     @staticmethod
     def _unpack_leds(leds: list[dc.Led], index_only: bool) -> list[list[int]]:
         if len(leds) == 0 or len(leds) > dc.LED_TOTAL:
@@ -141,13 +363,15 @@ class CmdBuilder:
             return [[led.pcb_index, led.led_index, led.brightness] for led in leds]
 
     @staticmethod
-    def set_brightness(rid: int, leds: list[dc.Led]):
+    def set_brightness(rid: int, leds: list[dc.Led], at: int | None = None):
         leds = CmdBuilder._unpack_leds(leds, index_only=False)
         doc = {
             "rid": rid,
             "cmd": "set_brightness",
             "leds": leds,
         }
+        if at is not None:
+            doc["at"] = at  # Device time in microseconds, see ClockSync
         json_bytes = bytearray(json.dumps(doc, separators=(",", ":")) + "\0", "utf-8")
         return json_bytes
 
@@ -156,6 +380,136 @@ class CmdBuilder:
         success, _ = CmdBuilder._evaluate_response(response, rid=rid, status=0)
         return success
 
+    @staticmethod
+    def set_master(rid: int, level: int, at: int | None = None):
+        if not (0 <= level <= dc.MAX_BRIGHTNESS):
+            raise ValueError(f"level ({level}) out of range [0, {dc.MAX_BRIGHTNESS}]")
+        doc = {
+            "rid": rid,
+            "cmd": "set_master",
+            "level": level,
+        }
+        if at is not None:
+            doc["at"] = at  # Device time in microseconds, see ClockSync
+        json_bytes = bytearray(json.dumps(doc, separators=(",", ":")) + "\0", "utf-8")
+        return json_bytes
+
+    @staticmethod
+    def evaluate_set_master_response(response: bytearray, rid: int) -> bool:
+        success, _ = CmdBuilder._evaluate_response(response, rid=rid, status=0)
+        return success
+
+    @staticmethod
+    def set_twinkle(rid: int, depth: int, period_ms: int = 3000, density: int = 30):
+        if not (0 <= depth <= 100):
+            raise ValueError(f"depth ({depth}) out of range [0, 100]")
+        if not (dc.TWINKLE_PERIOD_MIN_MS <= period_ms <= dc.TWINKLE_PERIOD_MAX_MS):
+            raise ValueError(
+                f"period_ms ({period_ms}) out of range [{dc.TWINKLE_PERIOD_MIN_MS}, {dc.TWINKLE_PERIOD_MAX_MS}]"
+            )
+        if not (0 <= density <= 100):
+            raise ValueError(f"density ({density}) out of range [0, 100]")
+        doc = {
+            "rid": rid,
+            "cmd": "set_twinkle",
+            "depth": depth,
+            "period_ms": period_ms,
+            "density": density,
+        }
+        json_bytes = bytearray(json.dumps(doc, separators=(",", ":")) + "\0", "utf-8")
+        return json_bytes
+
+    @staticmethod
+    def evaluate_set_twinkle_response(response: bytearray, rid: int) -> bool:
+        success, _ = CmdBuilder._evaluate_response(response, rid=rid, status=0)
+        return success
+
+    @staticmethod
+    def write_layout(rid: int, offset: int, data: bytes):
+        layout_size = dc.LED_TOTAL * dc.LAYOUT_BYTES_PER_LED
+        if offset < 0 or len(data) == 0 or offset + len(data) > layout_size:
+            raise ValueError(f"layout chunk [{offset}, {offset + len(data)}) out of range [0, {layout_size}]")
+        doc = {
+            "rid": rid,
+            "cmd": "write_layout",
+            "offset": offset,
+            "data": base64.b64encode(data).decode("ascii"),
+            "crc": zlib.crc32(data),
+        }
+        json_bytes = bytearray(json.dumps(doc, separators=(",", ":")) + "\0", "utf-8")
+        return json_bytes
+
+    @staticmethod
+    def evaluate_write_layout_response(response: bytearray, rid: int) -> bool:
+        success, _ = CmdBuilder._evaluate_response(response, rid=rid, status=0)
+        return success
+
+    @staticmethod
+    def commit_layout(rid: int, crc: int):
+        doc = {
+            "rid": rid,
+            "cmd": "commit_layout",
+            "crc": crc,
+        }
+        json_bytes = bytearray(json.dumps(doc, separators=(",", ":")) + "\0", "utf-8")
+        return json_bytes
+
+    @staticmethod
+    def evaluate_commit_layout_response(response: bytearray, rid: int) -> bool:
+        success, _ = CmdBuilder._evaluate_response(response, rid=rid, status=0)
+        return success
+
+    @staticmethod
+    def set_pattern(
+        rid: int,
+        pattern: str,
+        x: int = 128,
+        y: int = 128,
+        angle: int = 0,
+        period_ms: int = 3000,
+        width: int = 64,
+        level: int = dc.MAX_BRIGHTNESS,
+        duration_ms: int = 0,
+    ):
+        if pattern not in dc.PATTERNS:
+            raise ValueError(f"pattern ('{pattern}') not one of {dc.PATTERNS}")
+        for name, value in (("x", x), ("y", y)):
+            if not (0 <= value <= 255):
+                raise ValueError(f"{name} ({value}) out of range [0, 255]")
+        if not (0 <= angle < 360):
+            raise ValueError(f"angle ({angle}) out of range [0, 360)")
+        if not (dc.TWINKLE_PERIOD_MIN_MS <= period_ms <= dc.TWINKLE_PERIOD_MAX_MS):
+            raise ValueError(
+                f"period_ms ({period_ms}) out of range [{dc.TWINKLE_PERIOD_MIN_MS}, {dc.TWINKLE_PERIOD_MAX_MS}]"
+            )
+        if not (1 <= width <= 255):
+            raise ValueError(f"width ({width}) out of range [1, 255]")
+        if pattern == "noise" and not (dc.NOISE_CELL_MIN <= width <= dc.NOISE_CELL_MAX):
+            raise ValueError(f"width ({width}) out of noise cell range [{dc.NOISE_CELL_MIN}, {dc.NOISE_CELL_MAX}]")
+        if not (0 <= level <= dc.MAX_BRIGHTNESS):
+            raise ValueError(f"level ({level}) out of range [0, {dc.MAX_BRIGHTNESS}]")
+        if duration_ms < 0:
+            raise ValueError(f"duration_ms ({duration_ms}) must not be negative")
+        doc = {
+            "rid": rid,
+            "cmd": "set_pattern",
+            "pattern": pattern,
+            "x": x,
+            "y": y,
+            "angle": angle,
+            "period_ms": period_ms,
+            "width": width,
+            "level": level,
+            "duration_ms": duration_ms,
+        }
+        json_bytes = bytearray(json.dumps(doc, separators=(",", ":")) + "\0", "utf-8")
+        return json_bytes
+
+    @staticmethod
+    def evaluate_set_pattern_response(response: bytearray, rid: int) -> bool:
+        success, _ = CmdBuilder._evaluate_response(response, rid=rid, status=0)
+        return success
+
     @staticmethod
     def get_brightness(rid: int, leds: list[dc.Led]):
         leds = CmdBuilder._unpack_leds(leds, index_only=True)
@@ -180,17 +534,80 @@ class CmdBuilder:
             leds.append(dc.Led(pcb_index=item[0], led_index=item[1], brightness=item[2]))
         return leds
 
+    @staticmethod
+    def write_calibration(rid: int, offset: int, data: bytes):
+        if offset < 0 or len(data) == 0 or offset + len(data) > dc.LED_TOTAL:
+            raise ValueError(f"calibration chunk [{offset}, {offset + len(data)}) out of range [0, {dc.LED_TOTAL}]")
+        doc = {
+            "rid": rid,
+            "cmd": "write_calibration",
+            "offset": offset,
+            "data": base64.b64encode(data).decode("ascii"),
+            "crc": zlib.crc32(data),
+        }
+        json_bytes = bytearray(json.dumps(doc, separators=(",", ":")) + "\0", "utf-8")
+        return json_bytes
+
+    @staticmethod
+    def evaluate_write_calibration_response(response: bytearray, rid: int) -> bool:
+        success, _ = CmdBuilder._evaluate_response(response, rid=rid, status=0)
+        return success
+
+    @staticmethod
+    def commit_calibration(rid: int, crc: int):
+        doc = {
+            "rid": rid,
+            "cmd": "commit_calibration",
+            "crc": crc,
+        }
+        json_bytes = bytearray(json.dumps(doc, separators=(",", ":")) + "\0", "utf-8")
+        return json_bytes
+
+    @staticmethod
+    def evaluate_commit_calibration_response(response: bytearray, rid: int) -> bool:
+        success, _ = CmdBuilder._evaluate_response(response, rid=rid, status=0)
+        return success
+
+    @staticmethod
+    def read_calibration(rid: int, offset: int, length: int):
+        if offset < 0 or length <= 0 or offset + length > dc.LED_TOTAL:
+            raise ValueError(f"calibration range [{offset}, {offset + length}) out of range [0, {dc.LED_TOTAL}]")
+        doc = {
+            "rid": rid,
+            "cmd": "read_calibration",
+            "offset": offset,
+            "length": length,
+        }
+        json_bytes = bytearray(json.dumps(doc, separators=(",", ":")) + "\0", "utf-8")
+        return json_bytes
+
+    @staticmethod
+    def evaluate_read_calibration_response(response: bytearray, rid: int) -> bytes | None:
+        success, crc = CmdBuilder._evaluate_response(response, rid=rid, status=0, data=str, crc=int)
+        if not success:
+            return None
+
+        doc = json.loads(response.decode("utf-8").rstrip("\0"))
+        try:
+            data = base64.b64decode(doc["data"], validate=True)
+        except ValueError:
+            return None
+        if zlib.crc32(data) != crc:
+            return None
+        return data
+
     @staticmethod
     def _unpack_sequence(sequence: list[tuple[int, dc.Step]]) -> list[dict]:
         seq = []
         for group_idx, step in sequence:
-            seq.append(
-                [group_idx, step.down_ms, step.pause_ms, step.up_ms, step.pulse_ms, step.reps, int(step.idle_return)]
-            )
+            item = [group_idx, step.down_ms, step.pause_ms, step.up_ms, step.pulse_ms, step.reps, int(step.idle_return)]
+            if step.stagger_ms > 0:
+                item.append(step.stagger_ms)  # Optional, keeps plain steps compatible with older firmware
+            seq.append(item)
         return seq
 
     @staticmethod
-    def play_show(rid: int, show: dc.Show, force: bool = False):
+    def play_show(rid: int, show: dc.Show, force: bool = False, start_at: int | None = None, at: int | None = None):
         groups = [CmdBuilder._unpack_leds(leds, index_only=True) for leds in show.get_groups()]
         sequence = CmdBuilder._unpack_sequence(show.get_sequence())
         doc = {
@@ -200,6 +617,10 @@ class CmdBuilder:
             "groups": groups,
             "sequence": sequence,
         }
+        if start_at is not None:
+            doc["start_at"] = start_at  # Device time in microseconds, see ClockSync
+        if at is not None:
+            doc["at"] = at
         json_bytes = bytearray(json.dumps(doc, separators=(",", ":")) + "\0", "utf-8")
         return json_bytes
 
@@ -209,11 +630,181 @@ class CmdBuilder:
         return success
 
     @staticmethod
-    def stop_show(rid: int):
+    def queue_show(rid: int, show: dc.Show, fade_ms: int = 0):
+        if not (0 <= fade_ms <= dc.FADE_MAX_MS):
+            raise ValueError(f"fade_ms ({fade_ms}) out of range [0, {dc.FADE_MAX_MS}]")
+        groups = [CmdBuilder._unpack_leds(leds, index_only=True) for leds in show.get_groups()]
+        sequence = CmdBuilder._unpack_sequence(show.get_sequence())
+        doc = {
+            "rid": rid,
+            "cmd": "queue_show",
+            "groups": groups,
+            "sequence": sequence,
+        }
+        if fade_ms > 0:
+            doc["fade_ms"] = fade_ms  # Crossfade from the end of the current show
+        json_bytes = bytearray(json.dumps(doc, separators=(",", ":")) + "\0", "utf-8")
+        return json_bytes
+
+    @staticmethod
+    def evaluate_queue_show_response(response: bytearray, rid: int) -> bool:
+        success, _ = CmdBuilder._evaluate_response(response, rid=rid, status=0)
+        return success
+
+    @staticmethod
+    def pause_show(rid: int):
+        doc = {
+            "rid": rid,
+            "cmd": "pause_show",
+        }
+        json_bytes = bytearray(json.dumps(doc, separators=(",", ":")) + "\0", "utf-8")
+        return json_bytes
+
+    @staticmethod
+    def evaluate_pause_show_response(response: bytearray, rid: int) -> bool:
+        success, _ = CmdBuilder._evaluate_response(response, rid=rid, status=0)
+        return success
+
+    @staticmethod
+    def resume_show(rid: int):
+        doc = {
+            "rid": rid,
+            "cmd": "resume_show",
+        }
+        json_bytes = bytearray(json.dumps(doc, separators=(",", ":")) + "\0", "utf-8")
+        return json_bytes
+
+    @staticmethod
+    def evaluate_resume_show_response(response: bytearray, rid: int) -> bool:
+        success, _ = CmdBuilder._evaluate_response(response, rid=rid, status=0)
+        return success
+
+    @staticmethod
+    def set_tempo(rid: int, tempo: int):
+        if not (dc.TEMPO_MIN_PERCENT <= tempo <= dc.TEMPO_MAX_PERCENT):
+            raise ValueError(f"tempo ({tempo}) out of range [{dc.TEMPO_MIN_PERCENT}, {dc.TEMPO_MAX_PERCENT}]")
+        doc = {
+            "rid": rid,
+            "cmd": "set_tempo",
+            "tempo": tempo,  # Percent of the programmed speed
+        }
+        json_bytes = bytearray(json.dumps(doc, separators=(",", ":")) + "\0", "utf-8")
+        return json_bytes
+
+    @staticmethod
+    def evaluate_set_tempo_response(response: bytearray, rid: int) -> bool:
+        success, _ = CmdBuilder._evaluate_response(response, rid=rid, status=0)
+        return success
+
+    @staticmethod
+    def seek_show(rid: int, position_ms: int):
+        if position_ms < 0:
+            raise ValueError(f"position_ms ({position_ms}) must be non-negative!")
+        doc = {
+            "rid": rid,
+            "cmd": "seek_show",
+            "position_ms": position_ms,
+        }
+        json_bytes = bytearray(json.dumps(doc, separators=(",", ":")) + "\0", "utf-8")
+        return json_bytes
+
+    @staticmethod
+    def evaluate_seek_show_response(response: bytearray, rid: int) -> bool:
+        success, _ = CmdBuilder._evaluate_response(response, rid=rid, status=0)
+        return success
+
+    @staticmethod
+    def set_gain(rid: int, group: int, gain: int):
+        if not (0 <= group < dc.SHOW_GROUP_COUNT_MAX):
+            raise ValueError(f"group ({group}) out of range [0, {dc.SHOW_GROUP_COUNT_MAX - 1}]")
+        if not (0 <= gain <= 100):
+            raise ValueError(f"gain ({gain}) out of range [0, 100]")
+        doc = {
+            "rid": rid,
+            "cmd": "set_gain",
+            "group": group,
+            "gain": gain,
+        }
+        json_bytes = bytearray(json.dumps(doc, separators=(",", ":")) + "\0", "utf-8")
+        return json_bytes
+
+    @staticmethod
+    def evaluate_set_gain_response(response: bytearray, rid: int) -> bool:
+        success, _ = CmdBuilder._evaluate_response(response, rid=rid, status=0)
+        return success
+
+    @staticmethod
+    def set_step(rid: int, step: int, down_ms: int, pause_ms: int, up_ms: int, pulse_ms: int):
+        durations = [down_ms, pause_ms, up_ms, pulse_ms]
+        if any(duration < 0 for duration in durations):
+            raise ValueError(f"durations ({durations}) must be non-negative!")
+        doc = {
+            "rid": rid,
+            "cmd": "set_step",
+            "step": step,  # Index in the sequence of the running show
+            "durations": durations,
+        }
+        json_bytes = bytearray(json.dumps(doc, separators=(",", ":")) + "\0", "utf-8")
+        return json_bytes
+
+    @staticmethod
+    def evaluate_set_step_response(response: bytearray, rid: int) -> bool:
+        success, _ = CmdBuilder._evaluate_response(response, rid=rid, status=0)
+        return success
+
+    @staticmethod
+    def batch(rid: int, commands: list[bytearray], at: int | None = None):
+        """Combines commands built with the other methods into one request, their rids are dropped."""
+        if not (1 <= len(commands) <= dc.BATCH_COMMANDS_MAX):
+            raise ValueError(f"commands length {len(commands)} out of range [1, {dc.BATCH_COMMANDS_MAX}]")
+        cmds = []
+        for command in commands:
+            sub = json.loads(command.decode("utf-8").rstrip("\0"))
+            sub.pop("rid", None)
+            cmds.append(sub)
+        doc = {
+            "rid": rid,
+            "cmd": "batch",
+            "cmds": cmds,
+        }
+        if at is not None:
+            doc["at"] = at  # Device time in microseconds, see ClockSync
+        json_bytes = bytearray(json.dumps(doc, separators=(",", ":")) + "\0", "utf-8")
+        return json_bytes
+
+    @staticmethod
+    def evaluate_batch_response(response: bytearray, rid: int) -> list[int] | None:
+        success, results = CmdBuilder._evaluate_response(response, rid=rid, status=0, results=list)
+        return results if success else None
+
+    @staticmethod
+    def keyframe(rid: int, time: int, leds: list[dc.Led], curve: str = "linear"):
+        if curve not in dc.KEYFRAME_CURVES:
+            raise ValueError(f"curve ('{curve}') not one of {dc.KEYFRAME_CURVES}")
+        leds = CmdBuilder._unpack_leds(leds, index_only=False)
+        doc = {
+            "rid": rid,
+            "cmd": "keyframe",
+            "time": time,  # Device time in microseconds, see ClockSync
+            "curve": curve,
+            "leds": leds,
+        }
+        json_bytes = bytearray(json.dumps(doc, separators=(",", ":")) + "\0", "utf-8")
+        return json_bytes
+
+    @staticmethod
+    def evaluate_keyframe_response(response: bytearray, rid: int) -> int | None:
+        success, free = CmdBuilder._evaluate_response(response, rid=rid, status=0, free=int)
+        return free if success else None
+
+    @staticmethod
+    def stop_show(rid: int, at: int | None = None):
         doc = {
             "rid": rid,
             "cmd": "stop_show",
         }
+        if at is not None:
+            doc["at"] = at  # Device time in microseconds, see ClockSync
         json_bytes = bytearray(json.dumps(doc, separators=(",", ":")) + "\0", "utf-8")
         return json_bytes
 
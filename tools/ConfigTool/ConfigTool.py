@@ -1,6 +1,9 @@
 import asyncio
+import base64
+import ClockSync as cs
 import CmdBuilder as cb
 import DaisyChain as dc
+import TraceConverter as tc
 import BleClient as bc
 import BleOta as bo
 from helper import format_log_message, print_pretty_json
@@ -8,20 +11,36 @@ from typing import Callable
 import datetime
 import copy
 import json
+import random
+import time
+import zlib
+
+
+CALIBRATION_CHUNK_SIZE = 240  # Idle map bytes per write/read_calibration command
+LAYOUT_CHUNK_SIZE = 480  # Layout bytes per write_layout command
+CLOCK_SYNC_SAMPLES = 16  # 'sync_time' exchanges per clock synchronization
+TRACE_CHUNK_SIZE = 60  # Trace records per get_trace command
+KEYFRAME_LOOKAHEAD_MS = 1000  # Keyframes are sent this long before they are due, rides out link gaps
+STATS_BUCKET_MIN_US = 16  # Upper bound of the first histogram bucket, each following bucket doubles it
+COMMAND_RETRIES = 2  # Resends of a request whose response got lost, see BleClient.send_command
+PACK_MIN_LENGTH = 512  # Requests from this length on are sent LZSS packed (shows, calibration uploads)
 
 
 class ConfigTool:
     def __init__(self):
         self.client = bc.BleClient()
+        self.client.retries = COMMAND_RETRIES
+        self.client.pack_min_length = PACK_MIN_LENGTH
         self.chain = dc.DaisyChain()
         self.ble_ota = bo.BleOta()
         self.print_cb = None
 
-        self.rid_counter = 0
+        # Responses are cached by rid on the device, a new session must not reuse the rids of the last one
+        self.rid_counter = random.randrange(1 << 24)
         self.verified = False
         self.device_leds = []  # uploaded or downloaded LEDs from device
         self.cmd_file_data = bytearray()
-        self.cmd_file_rid = 0
+        self.clock_sync = cs.ClockSync()
 
     def log(self, message):
         message = format_log_message(message, "[ConfigTool]")
@@ -54,7 +73,6 @@ class ConfigTool:
             raise ValueError("Invalid cmd file: 'cmd' key missing or not a string")
 
         self.log(print_pretty_json(doc))
-        self.cmd_file_rid = doc["rid"]
 
         self.cmd_file_data = bytearray(json.dumps(doc, separators=(",", ":")) + "\0", "utf-8")
         self.log(f"Loaded command file: '{cmd_file_path}' and null-terminated it for BLE transmission.")
@@ -62,6 +80,9 @@ class ConfigTool:
 
     async def connect(self) -> bool:
         success = await self.client.connect()
+        if success:
+            # Idle map and layout transfers are sized from the topology of the device
+            await self.get_topology()
         return success
 
     async def disconnect(self) -> bool:
@@ -117,20 +138,362 @@ class ConfigTool:
             self.log("Failed to set System ID on device!")
         return status
 
-    async def send_cmd(self) -> bool:
+    async def get_topology(self) -> tuple[int, int, list[int]] | None:
+        if not self.client:
+            raise RuntimeError("ConfigTool not properly initialized. Call 'connect' first!")
+
+        self.rid_counter += 1
+        cmd = cb.CmdBuilder.get_topology(rid=self.rid_counter)
+        response = await self.client.send_command(cmd, timeout=2.0)
+        topology = cb.CmdBuilder.evaluate_get_topology_response(response, rid=self.rid_counter)
+        if topology is None:
+            self.log("Failed to get topology!")
+            return None
+
+        chains, chain_size, pins = topology
+        dc.apply_topology(chains, chain_size)
+        self.log(f"Topology: {chains} chains x {chain_size} PCBs (select pins: {pins})")
+        return topology
+
+    async def set_topology(self, chains: int, chain_size: int, pins: list[int]) -> bool:
+        if not self.client:
+            raise RuntimeError("ConfigTool not properly initialized. Call 'connect' first!")
+
+        self.rid_counter += 1
+        cmd = cb.CmdBuilder.set_topology(rid=self.rid_counter, chains=chains, chain_size=chain_size, pins=pins)
+        response = await self.client.send_command(cmd, timeout=2.0)
+        status = cb.CmdBuilder.evaluate_set_topology_response(response, rid=self.rid_counter)
+        if status:
+            self.log("Topology stored, reboot the device to apply it.")
+        else:
+            self.log("Failed to set topology on device!")
+        return status
+
+    async def get_refresh_interval(self) -> int | None:
+        if not self.client:
+            raise RuntimeError("ConfigTool not properly initialized. Call 'connect' first!")
+
+        self.rid_counter += 1
+        cmd = cb.CmdBuilder.get_refresh_interval(rid=self.rid_counter)
+        response = await self.client.send_command(cmd, timeout=2.0)
+        interval_ms = cb.CmdBuilder.evaluate_get_refresh_interval_response(response, rid=self.rid_counter)
+        if interval_ms is None:
+            self.log("Failed to get refresh interval!")
+            return None
+
+        self.log(f"Refresh interval: {interval_ms} ms" if interval_ms > 0 else "Refresh disabled")
+        return interval_ms
+
+    async def set_refresh_interval(self, interval_ms: int) -> bool:
+        if not self.client:
+            raise RuntimeError("ConfigTool not properly initialized. Call 'connect' first!")
+
+        self.rid_counter += 1
+        cmd = cb.CmdBuilder.set_refresh_interval(rid=self.rid_counter, interval_ms=interval_ms)
+        response = await self.client.send_command(cmd, timeout=2.0)
+        status = cb.CmdBuilder.evaluate_set_refresh_interval_response(response, rid=self.rid_counter)
+        if not status:
+            self.log("Failed to set refresh interval on device!")
+        return status
+
+    async def get_stats(self, reset: bool = False) -> dict | None:
+        if not self.client:
+            raise RuntimeError("ConfigTool not properly initialized. Call 'connect' first!")
+
+        self.rid_counter += 1
+        cmd = cb.CmdBuilder.get_stats(rid=self.rid_counter)
+        response = await self.client.send_command(cmd, timeout=3.0)
+        stats = cb.CmdBuilder.evaluate_get_stats_response(response, rid=self.rid_counter)
+        if stats is None:
+            self.log("Failed to get stats!")
+            return None
+
+        self.log(f"Stats of the last {stats['elapsed_ms'] / 1000:.1f} s:")
+        for name, value in stats["counters"].items():
+            self.log(f"\t{name}: {value}")
+        self.log(f"\tRX rate: {stats['rx_bytes_per_s']} B/s (peak: {stats['rx_peak_bytes_per_s']} B/s)")
+        self.log(f"\tRequest limit: {stats['rx_limit']} bytes, {stats['show_led_limit']} LEDs per show")
+        self.client.request_length_max = stats["rx_limit"]
+        boot = stats["boot"]
+        self.log(
+            f"\tBoot: first frame after {boot['first_frame_us'] / 1000:.1f} ms, "
+            f"BLE ready after {boot['ble_ready_us'] / 1000:.1f} ms"
+        )
+        for name, histogram in stats["histograms"].items():
+            buckets = histogram["buckets"]
+            # Upper bound of the bucket holding the 99th percentile
+            target = histogram["count"] * 0.99
+            p99_index = next(i for i in range(len(buckets)) if sum(buckets[: i + 1]) >= target)
+            self.log(
+                f"\t{name}: n={histogram['count']}, avg={histogram['sum_us'] / histogram['count']:.0f} us, "
+                f"p99<{STATS_BUCKET_MIN_US << p99_index} us, max={histogram['max_us']} us"
+            )
+
+        if reset:
+            self.rid_counter += 1
+            cmd = cb.CmdBuilder.reset_stats(rid=self.rid_counter)
+            response = await self.client.send_command(cmd, timeout=2.0)
+            if not cb.CmdBuilder.evaluate_reset_stats_response(response, rid=self.rid_counter):
+                self.log("Failed to reset stats!")
+        return stats
+
+    async def download_trace(self, file_path: str) -> bool:
+        if not self.client:
+            raise RuntimeError("ConfigTool not properly initialized. Call 'connect' first!")
+
+        # The first request freezes the trace ring, it resumes recording once the last page is read
+        data = bytearray()
+        size = None
+        while size is None or len(data) // tc.RECORD_SIZE < size:
+            self.rid_counter += 1
+            offset = len(data) // tc.RECORD_SIZE
+            cmd = cb.CmdBuilder.get_trace(rid=self.rid_counter, offset=offset, length=TRACE_CHUNK_SIZE)
+            response = await self.client.send_command(cmd, timeout=2.0)
+            result = cb.CmdBuilder.evaluate_get_trace_response(response, rid=self.rid_counter)
+            if result is None or (size is not None and result[1] == b""):
+                self.log(f"Failed to read trace at record {offset}!")
+                return False
+            size, records = result
+            data += records
+
+        with open(file_path, "w", encoding="utf-8") as f:
+            json.dump(tc.to_chrome_trace(bytes(data)), f)
+        self.log(f"Trace with {size} records written to '{file_path}'.")
+        return True
+
+    async def list_profiles(self) -> tuple[str, list[str]] | None:
+        if not self.client:
+            raise RuntimeError("ConfigTool not properly initialized. Call 'connect' first!")
+
+        self.rid_counter += 1
+        cmd = cb.CmdBuilder.list_profiles(rid=self.rid_counter)
+        response = await self.client.send_command(cmd, timeout=2.0)
+        result = cb.CmdBuilder.evaluate_list_profiles_response(response, rid=self.rid_counter)
+        if result is None:
+            self.log("Failed to list calibration profiles!")
+            return None
+
+        active, profiles = result
+        self.log("Calibration profiles:")
+        for name in profiles:
+            self.log(f"\t{'*' if name == active else ' '} '{name}'")
+        return result
+
+    async def select_profile(self, name: str, fade_ms: int = 0) -> bool:
+        if not self.client:
+            raise RuntimeError("ConfigTool not properly initialized. Call 'connect' first!")
+
+        self.rid_counter += 1
+        cmd = cb.CmdBuilder.select_profile(rid=self.rid_counter, name=name, fade_ms=fade_ms)
+        response = await self.client.send_command(cmd, timeout=3.0)
+        status = cb.CmdBuilder.evaluate_select_profile_response(response, rid=self.rid_counter)
+        if status:
+            self.log(f"Calibration profile '{name}' selected (fade: {fade_ms} ms).")
+        else:
+            self.log(f"Failed to select calibration profile '{name}'!")
+        return status
+
+    async def sync_clock(self, samples: int = CLOCK_SYNC_SAMPLES) -> bool:
+        if not self.client:
+            raise RuntimeError("ConfigTool not properly initialized. Call 'connect' first!")
+
+        self.clock_sync.reset()
+        for _ in range(samples):
+            self.rid_counter += 1
+            cmd = cb.CmdBuilder.sync_time(rid=self.rid_counter)
+            t1 = time.monotonic_ns() // 1000
+            response = await self.client.send_command(cmd, timeout=2.0)
+            t4 = time.monotonic_ns() // 1000
+            result = cb.CmdBuilder.evaluate_sync_time_response(response, rid=self.rid_counter)
+            if result is None:
+                self.log("Failed to synchronize clock!")
+                return False
+            t2, t3 = result
+            self.clock_sync.add_sample(t1, t2, t3, t4)
+
+        self.log(
+            f"Clock synchronized (best round trip: {self.clock_sync.round_trip_us() / 1000:.1f} ms, "
+            f"drift: {self.clock_sync.drift * 1e6:.1f} ppm)"
+        )
+        return True
+
+    async def send_cmd(self, start_at: int | None = None) -> bool:
+        """Sends the loaded command, a 'play_show' can be started at a host time (time.monotonic_ns() // 1000)."""
         if not self.client:
             raise RuntimeError("ConfigTool not properly initialized. Call 'connect' first!")
         if len(self.cmd_file_data) == 0:
             raise RuntimeError("No command loaded. Call 'load_cmd' first!")
 
-        response = await self.client.send_command(self.cmd_file_data, timeout=2.0)
-        success, _ = cb.CmdBuilder._evaluate_response(response, rid=self.cmd_file_rid, status=0)
+        # The rid of the file is replaced, the device would answer a resend with the same rid from its response cache
+        doc = json.loads(self.cmd_file_data.decode("utf-8").rstrip("\0"))
+        self.rid_counter += 1
+        doc["rid"] = self.rid_counter
+        if start_at is not None:
+            if not self.clock_sync.is_synced():
+                raise RuntimeError("Clock not synchronized. Call 'sync_clock' first!")
+            if doc["cmd"] != "play_show":
+                raise ValueError(f"Start time not supported by command '{doc['cmd']}'")
+            doc["start_at"] = self.clock_sync.to_device_time(start_at)
+        cmd = bytearray(json.dumps(doc, separators=(",", ":")) + "\0", "utf-8")
+
+        response = await self.client.send_command(cmd, timeout=2.0)
+        success, _ = cb.CmdBuilder._evaluate_response(response, rid=self.rid_counter, status=0)
         if success:
             self.log("Command executed successfully on device")
         else:
             self.log("Command execution failed!")
         return success
 
+    async def stream_keyframes(
+        self,
+        keyframes: list[tuple[int, list[dc.Led]]],
+        curve: str = "linear",
+        lookahead_ms: int = KEYFRAME_LOOKAHEAD_MS,
+    ) -> bool:
+        """Streams (time_ms, leds) keyframes, times relative to the start of the stream. The device interpolates
+        between them, so a few keyframes per second give a smooth output."""
+        if not self.client:
+            raise RuntimeError("ConfigTool not properly initialized. Call 'connect' first!")
+        if not self.clock_sync.is_synced():
+            raise RuntimeError("Clock not synchronized. Call 'sync_clock' first!")
+
+        start_us = time.monotonic_ns() // 1000 + lookahead_ms * 1000
+        for time_ms, leds in keyframes:
+            host_us = start_us + time_ms * 1000
+            wait_us = host_us - lookahead_ms * 1000 - time.monotonic_ns() // 1000
+            if wait_us > 0:
+                await asyncio.sleep(wait_us / 1_000_000)
+
+            self.rid_counter += 1
+            device_us = self.clock_sync.to_device_time(host_us)
+            cmd = cb.CmdBuilder.keyframe(rid=self.rid_counter, time=device_us, leds=leds, curve=curve)
+            response = await self.client.send_command(cmd, timeout=2.0)
+            free = cb.CmdBuilder.evaluate_keyframe_response(response, rid=self.rid_counter)
+            if free is None:
+                self.log(f"Failed to send keyframe at {time_ms} ms!")
+                return False
+        self.log(f"{len(keyframes)} keyframes streamed.")
+        return True
+
+    async def queue_show(self, show: dc.Show, fade_ms: int = 0) -> bool:
+        """Queues a show that starts seamlessly when the current one ends (or right away if nothing plays)."""
+        if not self.client:
+            raise RuntimeError("ConfigTool not properly initialized. Call 'connect' first!")
+
+        self.rid_counter += 1
+        cmd = cb.CmdBuilder.queue_show(rid=self.rid_counter, show=show, fade_ms=fade_ms)
+        response = await self.client.send_command(cmd, timeout=2.0)
+        status = cb.CmdBuilder.evaluate_queue_show_response(response, rid=self.rid_counter)
+        if status:
+            self.log(f"Show '{show.name}' queued.")
+        else:
+            self.log("Failed to queue show on device!")
+        return status
+
+    async def pause_show(self) -> bool:
+        if not self.client:
+            raise RuntimeError("ConfigTool not properly initialized. Call 'connect' first!")
+
+        self.rid_counter += 1
+        cmd = cb.CmdBuilder.pause_show(rid=self.rid_counter)
+        response = await self.client.send_command(cmd, timeout=2.0)
+        status = cb.CmdBuilder.evaluate_pause_show_response(response, rid=self.rid_counter)
+        if not status:
+            self.log("Failed to pause show on device!")
+        return status
+
+    async def resume_show(self) -> bool:
+        if not self.client:
+            raise RuntimeError("ConfigTool not properly initialized. Call 'connect' first!")
+
+        self.rid_counter += 1
+        cmd = cb.CmdBuilder.resume_show(rid=self.rid_counter)
+        response = await self.client.send_command(cmd, timeout=2.0)
+        status = cb.CmdBuilder.evaluate_resume_show_response(response, rid=self.rid_counter)
+        if not status:
+            self.log("Failed to resume show on device!")
+        return status
+
+    async def set_tempo(self, tempo: int) -> bool:
+        """Sets the playback speed in percent of the programmed one, it also applies to later shows."""
+        if not self.client:
+            raise RuntimeError("ConfigTool not properly initialized. Call 'connect' first!")
+
+        self.rid_counter += 1
+        cmd = cb.CmdBuilder.set_tempo(rid=self.rid_counter, tempo=tempo)
+        response = await self.client.send_command(cmd, timeout=2.0)
+        status = cb.CmdBuilder.evaluate_set_tempo_response(response, rid=self.rid_counter)
+        if not status:
+            self.log("Failed to set tempo on device!")
+        return status
+
+    async def seek_show(self, position_ms: int) -> bool:
+        """Jumps to a time offset from the start of the running show."""
+        if not self.client:
+            raise RuntimeError("ConfigTool not properly initialized. Call 'connect' first!")
+
+        self.rid_counter += 1
+        cmd = cb.CmdBuilder.seek_show(rid=self.rid_counter, position_ms=position_ms)
+        response = await self.client.send_command(cmd, timeout=2.0)
+        status = cb.CmdBuilder.evaluate_seek_show_response(response, rid=self.rid_counter)
+        if status:
+            self.log(f"Show position set to {position_ms} ms.")
+        else:
+            self.log("Failed to seek in show on device!")
+        return status
+
+    async def set_gain(self, group: int, gain: int) -> bool:
+        """Scales the envelope of a group of the running show (0..100 %), playback continues."""
+        if not self.client:
+            raise RuntimeError("ConfigTool not properly initialized. Call 'connect' first!")
+
+        self.rid_counter += 1
+        cmd = cb.CmdBuilder.set_gain(rid=self.rid_counter, group=group, gain=gain)
+        response = await self.client.send_command(cmd, timeout=2.0)
+        status = cb.CmdBuilder.evaluate_set_gain_response(response, rid=self.rid_counter)
+        if not status:
+            self.log("Failed to set group gain on device!")
+        return status
+
+    async def set_step(self, step: int, down_ms: int, pause_ms: int, up_ms: int, pulse_ms: int) -> bool:
+        """Changes the durations of a step of the running show, playback continues."""
+        if not self.client:
+            raise RuntimeError("ConfigTool not properly initialized. Call 'connect' first!")
+
+        self.rid_counter += 1
+        cmd = cb.CmdBuilder.set_step(
+            rid=self.rid_counter, step=step, down_ms=down_ms, pause_ms=pause_ms, up_ms=up_ms, pulse_ms=pulse_ms
+        )
+        response = await self.client.send_command(cmd, timeout=2.0)
+        status = cb.CmdBuilder.evaluate_set_step_response(response, rid=self.rid_counter)
+        if not status:
+            self.log("Failed to set step durations on device!")
+        return status
+
+    async def send_batch(self, commands: list[bytearray], at: int | None = None) -> bool:
+        """Sends commands built with CmdBuilder as one batch, the device applies them together in one frame.
+        All commands are validated first, if one of them fails none is applied.
+        The batch can be executed at a host time (time.monotonic_ns() // 1000)."""
+        if not self.client:
+            raise RuntimeError("ConfigTool not properly initialized. Call 'connect' first!")
+        if at is not None:
+            if not self.clock_sync.is_synced():
+                raise RuntimeError("Clock not synchronized. Call 'sync_clock' first!")
+            at = self.clock_sync.to_device_time(at)
+
+        self.rid_counter += 1
+        cmd = cb.CmdBuilder.batch(rid=self.rid_counter, commands=commands, at=at)
+        response = await self.client.send_command(cmd, timeout=5.0)
+        if at is not None:
+            status = cb.CmdBuilder._evaluate_response(response, rid=self.rid_counter, status=0)[0]
+        else:
+            status = cb.CmdBuilder.evaluate_batch_response(response, rid=self.rid_counter) is not None
+        if status:
+            self.log(f"Batch of {len(commands)} commands {'scheduled' if at is not None else 'executed'}.")
+        else:
+            self.log("Failed to execute batch on device!")
+        return status
+
     async def stop_show(self) -> bool:
         if not self.client:
             raise RuntimeError("ConfigTool not properly initialized. Call 'connect' first!")
@@ -145,6 +508,83 @@ class ConfigTool:
             self.log("Failed to stop show on device!")
         return status
 
+    async def set_master(self, level: int, at: int | None = None) -> bool:
+        """Sets the master dimmer, optionally at a host time (time.monotonic_ns() // 1000)."""
+        if not self.client:
+            raise RuntimeError("ConfigTool not properly initialized. Call 'connect' first!")
+        if at is not None:
+            if not self.clock_sync.is_synced():
+                raise RuntimeError("Clock not synchronized. Call 'sync_clock' first!")
+            at = self.clock_sync.to_device_time(at)
+
+        self.rid_counter += 1
+        cmd = cb.CmdBuilder.set_master(rid=self.rid_counter, level=level, at=at)
+        response = await self.client.send_command(cmd, timeout=2.0)
+        status = cb.CmdBuilder.evaluate_set_master_response(response, rid=self.rid_counter)
+        if status:
+            self.log(f"Master level {'scheduled' if at is not None else 'set'} to {level}.")
+        else:
+            self.log("Failed to set master level on device!")
+        return status
+
+    async def set_twinkle(self, depth: int, period_ms: int = 3000, density: int = 30) -> bool:
+        """Twinkles the LEDs at their idle value, a depth of 0 turns the effect off (not persisted)."""
+        if not self.client:
+            raise RuntimeError("ConfigTool not properly initialized. Call 'connect' first!")
+
+        self.rid_counter += 1
+        cmd = cb.CmdBuilder.set_twinkle(rid=self.rid_counter, depth=depth, period_ms=period_ms, density=density)
+        response = await self.client.send_command(cmd, timeout=2.0)
+        status = cb.CmdBuilder.evaluate_set_twinkle_response(response, rid=self.rid_counter)
+        if not status:
+            self.log("Failed to set twinkle effect on device!")
+        return status
+
+    async def upload_layout(self, file_path: str) -> bool:
+        """Uploads the (x, y) position of every LED, a JSON list of [x, y] pairs (0..255) in idle map order."""
+        if not self.client:
+            raise RuntimeError("ConfigTool not properly initialized. Call 'connect' first!")
+
+        with open(file_path, "r", encoding="utf-8") as f:
+            positions = json.load(f)
+        if len(positions) != dc.LED_TOTAL:
+            raise ValueError(f"Layout has {len(positions)} LEDs, expected {dc.LED_TOTAL}")
+        layout = bytes(coordinate for position in positions for coordinate in position)
+        if len(layout) != dc.LED_TOTAL * dc.LAYOUT_BYTES_PER_LED:
+            raise ValueError("Invalid layout: every LED needs exactly one [x, y] pair")
+
+        self.log(f"Uploading LED layout from '{file_path}' ...")
+        for offset in range(0, len(layout), LAYOUT_CHUNK_SIZE):
+            chunk = layout[offset : offset + LAYOUT_CHUNK_SIZE]
+            self.rid_counter += 1
+            cmd = cb.CmdBuilder.write_layout(rid=self.rid_counter, offset=offset, data=chunk)
+            response = await self.client.send_command(cmd, timeout=3.0)
+            if not cb.CmdBuilder.evaluate_write_layout_response(response, rid=self.rid_counter):
+                self.log(f"Failed to upload layout chunk at offset {offset}!")
+                return False
+
+        self.rid_counter += 1
+        cmd = cb.CmdBuilder.commit_layout(rid=self.rid_counter, crc=zlib.crc32(layout))
+        response = await self.client.send_command(cmd, timeout=3.0)
+        if not cb.CmdBuilder.evaluate_commit_layout_response(response, rid=self.rid_counter):
+            self.log("Failed to commit layout!")
+            return False
+        self.log("LED layout uploaded successfully.")
+        return True
+
+    async def set_pattern(self, pattern: str, **params) -> bool:
+        """Starts a spatial pattern (see CmdBuilder.set_pattern for the parameters), 'off' stops it."""
+        if not self.client:
+            raise RuntimeError("ConfigTool not properly initialized. Call 'connect' first!")
+
+        self.rid_counter += 1
+        cmd = cb.CmdBuilder.set_pattern(rid=self.rid_counter, pattern=pattern, **params)
+        response = await self.client.send_command(cmd, timeout=2.0)
+        status = cb.CmdBuilder.evaluate_set_pattern_response(response, rid=self.rid_counter)
+        if not status:
+            self.log(f"Failed to set pattern '{pattern}' on device!")
+        return status
+
     def _get_changed_leds(self) -> list[dc.Led]:
         if not self.chain:
             raise RuntimeError("ConfigTool not properly initialized. Call 'load' first!")
@@ -177,30 +617,52 @@ class ConfigTool:
             self.log("No LED changes detected, skipping upload.")
             return True
 
-        self.log(f"Starting upload of {len(leds)} LEDs ...")
+        self.log(f"Starting upload of {len(leds)} changed LEDs as full idle map ...")
         self.verified = False  # Reset verified flag on changes
 
-        chunk_size = dc.LED_TOTAL // 12
-        leds_list = [leds[i : i + chunk_size] for i in range(0, len(leds), chunk_size)]
-
-        for i, leds in enumerate(leds_list):
-            self.log(f"Uploading chunk {i+1}/{len(leds_list)} with {len(leds)} LEDs ...")
-            success = await self._upload_leds(leds)
-            if not success:
-                self.log("Failed to upload LED chunk!")
-                self.device_leds = []
-                return False
+        idle_map = bytes(led.brightness for led in self.chain.leds)
+        if not await self._upload_idle_map(idle_map):
+            self.device_leds = []
+            return False
 
         self.log("All LEDs uploaded (PC=>ESP32) successfully.")
         self.device_leds = copy.deepcopy(self.chain.leds)  # Store uploaded LEDs for future change detection
         return True
 
-    async def _upload_leds(self, leds: list[dc.Led]) -> bool:
+    async def _upload_idle_map(self, idle_map: bytes) -> bool:
+        if len(idle_map) != dc.LED_TOTAL:
+            raise ValueError(f"Idle map length {len(idle_map)} does not match expected {dc.LED_TOTAL}")
+
+        for offset in range(0, len(idle_map), CALIBRATION_CHUNK_SIZE):
+            chunk = idle_map[offset : offset + CALIBRATION_CHUNK_SIZE]
+            self.rid_counter += 1
+            cmd = cb.CmdBuilder.write_calibration(rid=self.rid_counter, offset=offset, data=chunk)
+            response = await self.client.send_command(cmd, timeout=3.0)
+            if not cb.CmdBuilder.evaluate_write_calibration_response(response, rid=self.rid_counter):
+                self.log(f"Failed to upload idle map chunk at offset {offset}!")
+                return False
+
         self.rid_counter += 1
-        cmd = cb.CmdBuilder.set_brightness(rid=self.rid_counter, leds=leds)
+        cmd = cb.CmdBuilder.commit_calibration(rid=self.rid_counter, crc=zlib.crc32(idle_map))
         response = await self.client.send_command(cmd, timeout=3.0)
-        status = cb.CmdBuilder.evaluate_set_brightness_response(response, rid=self.rid_counter)
-        return status
+        if not cb.CmdBuilder.evaluate_commit_calibration_response(response, rid=self.rid_counter):
+            self.log("Failed to commit idle map (CRC mismatch or invalid values)!")
+            return False
+        return True
+
+    async def _download_idle_map(self) -> bytes | None:
+        idle_map = bytearray()
+        for offset in range(0, dc.LED_TOTAL, CALIBRATION_CHUNK_SIZE):
+            length = min(CALIBRATION_CHUNK_SIZE, dc.LED_TOTAL - offset)
+            self.rid_counter += 1
+            cmd = cb.CmdBuilder.read_calibration(rid=self.rid_counter, offset=offset, length=length)
+            response = await self.client.send_command(cmd, timeout=3.0)
+            chunk = cb.CmdBuilder.evaluate_read_calibration_response(response, rid=self.rid_counter)
+            if chunk is None or len(chunk) != length:
+                self.log(f"Failed to download idle map chunk at offset {offset}!")
+                return None
+            idle_map += chunk
+        return bytes(idle_map)
 
     async def verify_config(self) -> bool:
         if not self.chain or not self.client:
@@ -239,30 +701,64 @@ class ConfigTool:
             raise RuntimeError("ConfigTool not properly initialized. Call 'load' and 'connect' first!")
 
         self.log(f"Starting download of {dc.LED_TOTAL} LEDs ...")
-        config_leds = self.chain.leds  # config file LEDs
-        chunk_size = dc.LED_TOTAL // 12
-        leds_list = [config_leds[i : i + chunk_size] for i in range(0, len(config_leds), chunk_size)]
-        downloaded_leds = []
-
-        for i, leds in enumerate(leds_list):
-            self.log(f"Downloading chunk {i+1}/{len(leds_list)} with {len(leds)} LEDs ...")
-            downloaded_chunk = await self._download_leds(leds)
-            if not downloaded_chunk:
-                self.log("Failed to download LED chunk!")
-                self.device_leds = []
-                return False
-            downloaded_leds += downloaded_chunk
+        idle_map = await self._download_idle_map()
+        if idle_map is None:
+            self.device_leds = []
+            return False
 
+        downloaded_leds = [
+            dc.Led(pcb_index=(idx // dc.LED_COUNT) + 1, led_index=(idx % dc.LED_COUNT) + 1, brightness=brightness)
+            for idx, brightness in enumerate(idle_map)
+        ]
         self.log("All LEDs downloaded (ESP32=>PC) successfully.")
         self.device_leds = downloaded_leds  # Store downloaded LEDs for future change detection
         return True
 
-    async def _download_leds(self, leds: list[dc.Led]) -> list[dc.Led] | None:
-        self.rid_counter += 1
-        cmd = cb.CmdBuilder.get_brightness(rid=self.rid_counter, leds=leds)
-        response = await self.client.send_command(cmd, timeout=3.0)
-        downloaded_leds = cb.CmdBuilder.evaluate_get_brightness_response(response, rid=self.rid_counter)
-        return downloaded_leds
+    async def backup_calibration(self, file_path: str) -> bool:
+        if not self.client:
+            raise RuntimeError("ConfigTool not properly initialized. Call 'connect' first!")
+
+        self.log(f"Backing up device calibration to '{file_path}' ...")
+        info = await self.get_info()
+        idle_map = await self._download_idle_map()
+        if info is None or idle_map is None:
+            self.log("Failed to back up calibration!")
+            return False
+
+        _, system_id, name = info
+        doc = {
+            "system_id": system_id,
+            "name": name,
+            "crc": zlib.crc32(idle_map),
+            "data": base64.b64encode(idle_map).decode("ascii"),
+        }
+        with open(file_path, "w", encoding="utf-8") as f:
+            json.dump(doc, f, indent=2)
+        self.log("Calibration backup written successfully.")
+        return True
+
+    async def restore_calibration(self, file_path: str) -> bool:
+        if not self.client:
+            raise RuntimeError("ConfigTool not properly initialized. Call 'connect' first!")
+
+        with open(file_path, "r", encoding="utf-8") as f:
+            doc = json.load(f)
+        for key in ("name", "crc", "data"):
+            if key not in doc:
+                raise ValueError(f"Invalid calibration backup: '{key}' key missing")
+
+        idle_map = base64.b64decode(doc["data"], validate=True)
+        if zlib.crc32(idle_map) != doc["crc"]:
+            raise ValueError("Invalid calibration backup: CRC mismatch")
+
+        self.log(f"Restoring calibration '{doc['name']}' from '{file_path}' ...")
+        if not await self._upload_idle_map(idle_map):
+            self.log("Failed to restore calibration!")
+            return False
+        self.device_leds = []  # Device state no longer matches the loaded config
+        self.verified = False
+        self.log("Calibration restored successfully (use 'save' to persist it).")
+        return True
 
     async def save_config(self) -> bool:
         if not self.chain or not self.client or not self.verified:
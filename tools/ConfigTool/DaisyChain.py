@@ -2,13 +2,41 @@ import json
 from helper import format_log_message
 
 
+# Original installation (6 chains x 10 PCBs) until the topology of the device is known, see apply_topology()
 PCB_COUNT = 60
 LED_COUNT = 12
 LED_TOTAL = PCB_COUNT * LED_COUNT
 MAX_BRIGHTNESS = 100  # Max brightness percentage/level
 
+# Topology limits of the firmware, the device reports its actual topology with 'get_topology'
+CHAIN_COUNT_MAX = 8
+CHAIN_SIZE_MAX = 30
+# GPIOs no select line may use: strapping, LED SPI, USB, flash/PSRAM, run toggle and console pins
+RESERVED_PINS = [0, 45, 46, 11, 12, 19, 20, 26, 27, 28, 29, 30, 31, 32, 33, 34, 35, 36, 37, 38, 43, 44]
+
+REFRESH_INTERVAL_MAX_MS = 10 * 60 * 1000  # Longest periodic refresh interval, 0 disables the refresh
+
+TWINKLE_PERIOD_MIN_MS = 200  # Range of the average twinkle cycle
+TWINKLE_PERIOD_MAX_MS = 60000
+
+STAGGER_MAX_MS = 10000  # Longest start offset between two LEDs of a staggered step
+TEMPO_MIN_PERCENT = 10  # Range of the playback speed in percent of the programmed one
+TEMPO_MAX_PERCENT = 1000
+SHOW_GROUP_COUNT_MAX = 16  # Groups of a show, each with a live gain (see 'set_gain')
+BATCH_COMMANDS_MAX = 16  # Sub-commands of a 'batch', applied together in one frame
+
+LAYOUT_BYTES_PER_LED = 2  # x, y (0..255) of every LED in the order of the idle map
+PATTERNS = ["off", "wipe", "ripple", "beam", "noise"]  # Spatial patterns computed on the device
+NOISE_CELL_MIN = 4  # Range of the noise cell size (width of the 'noise' pattern) in layout coordinates
+NOISE_CELL_MAX = 128
+
+FADE_MAX_MS = 10 * 60 * 1000  # Longest crossfade of 'select_profile' and 'queue_show'
+
+KEYFRAME_CURVES = ["linear", "ease", "step"]  # Interpolation towards a streamed keyframe
+KEYFRAME_BUFFER_SIZE = 32  # Keyframes the device buffers ahead
+
 # For power calculations
-CHAIN_COUNT = 6  # 60 PCBs / 10 PCBs per chain
+CHAIN_COUNT = 6  # Chains of the device, see apply_topology()
 WEIGHT_FACTOR = 1.3  # Empirical factor to weight brightness (higher PCB indices => more weight)
 
 CURRENT_SAFETY_MARGIN = 1.10  # Safety margin for current calculations
@@ -21,6 +49,16 @@ LINEAR_STEPS = 101  # Number of steps in linearization table (0-100%)
 LINEAR_RANGE = 65535  # Range of linearization table (16-bit)
 
 
+def apply_topology(chains: int, chain_size: int):
+    """Adopts the topology the device reports with 'get_topology', LED ranges and transfer sizes follow it."""
+    global PCB_COUNT, LED_TOTAL, CHAIN_COUNT
+    if not (0 < chains <= CHAIN_COUNT_MAX and 0 < chain_size <= CHAIN_SIZE_MAX):
+        raise ValueError(f"Topology {chains} x {chain_size} out of range [{CHAIN_COUNT_MAX} x {CHAIN_SIZE_MAX}]")
+    PCB_COUNT = chains * chain_size
+    LED_TOTAL = PCB_COUNT * LED_COUNT
+    CHAIN_COUNT = chains
+
+
 class Led:
     def __init__(self, pcb_index: int, led_index: int, brightness: int):
         if not (0 < pcb_index <= PCB_COUNT):
@@ -35,7 +73,16 @@ class Led:
 
 
 class Step:
-    def __init__(self, down_ms: int, pause_ms: int, up_ms: int, pulse_ms: int, reps: int, idle_return: bool = False):
+    def __init__(
+        self,
+        down_ms: int,
+        pause_ms: int,
+        up_ms: int,
+        pulse_ms: int,
+        reps: int,
+        idle_return: bool = False,
+        stagger_ms: int = 0,
+    ):
         if down_ms < 0:
             raise ValueError(f"down_ms ({down_ms}) must be non-negative!")
         if pause_ms < 0:
@@ -46,12 +93,15 @@ class Step:
             raise ValueError(f"pulse_ms ({pulse_ms}) must be non-negative!")
         if reps < 1:
             raise ValueError(f"reps ({reps}) must be larger than zero!")
+        if not (0 <= stagger_ms <= STAGGER_MAX_MS):
+            raise ValueError(f"stagger_ms ({stagger_ms}) out of range [0, {STAGGER_MAX_MS}]!")
         self.down_ms = down_ms
         self.pause_ms = pause_ms
         self.up_ms = up_ms
         self.pulse_ms = pulse_ms
         self.reps = reps
         self.idle_return = idle_return
+        self.stagger_ms = stagger_ms  # Start offset between consecutive LEDs of the group (chase)
 
 
 class Show:
@@ -0,0 +1,110 @@
+WINDOW_SIZE = 4096  # Farthest match distance, the device decodes into the request buffer which serves as window
+MATCH_LENGTH_MIN = 3  # Shorter matches cost more than the literals
+MATCH_LENGTH_MAX = 18
+MAX_CHAIN = 64  # Candidates compared per position, bounds the compression time of large requests
+
+PACKED_MAGIC = 0x1F  # First byte of a packed request, a plain one starts with '{'
+PACKED_LENGTH_MAX = 0xFFFF
+
+
+def compress(data: bytes) -> bytearray:
+    """Compresses data into the LZSS format the firmware decodes (see LzssDecoder).
+
+    A flag byte announces the next 8 items, LSB first: 1 is a literal byte, 0 a match of two bytes
+    referring back into the output, (distance - 1) in 12 bits and (length - 3) in 4 bits:
+        byte 0: (distance - 1) & 0xFF
+        byte 1: ((distance - 1) >> 8) << 4 | (length - 3)
+    """
+    out = bytearray()
+    flags_index = 0
+    flag_count = 8
+    chains = {}  # 3 byte prefix -> positions, most recent last
+    pos = 0
+    while pos < len(data):
+        if flag_count == 8:
+            flags_index = len(out)
+            out.append(0)
+            flag_count = 0
+
+        best_length = 0
+        best_distance = 0
+        key = bytes(data[pos : pos + MATCH_LENGTH_MIN])
+        candidates = chains.get(key, [])
+        limit = min(MATCH_LENGTH_MAX, len(data) - pos)
+        for candidate in reversed(candidates[-MAX_CHAIN:]):
+            distance = pos - candidate
+            if distance > WINDOW_SIZE:
+                break
+            length = 0
+            while length < limit and data[candidate + length] == data[pos + length]:
+                length += 1
+            if length > best_length:
+                best_length = length
+                best_distance = distance
+                if length == limit:
+                    break
+
+        if best_length >= MATCH_LENGTH_MIN:
+            out.append((best_distance - 1) & 0xFF)
+            out.append(((best_distance - 1) >> 8) << 4 | (best_length - MATCH_LENGTH_MIN))
+            step = best_length
+        else:
+            out[flags_index] |= 1 << flag_count
+            out.append(data[pos])
+            step = 1
+        flag_count += 1
+
+        for index in range(pos, pos + step):
+            chains.setdefault(bytes(data[index : index + MATCH_LENGTH_MIN]), []).append(index)
+        pos += step
+    return out
+
+
+def decompress(data: bytes) -> bytearray:
+    out = bytearray()
+    pos = 0
+    while pos < len(data):
+        flags = data[pos]
+        pos += 1
+        for bit in range(8):
+            if pos >= len(data):
+                break
+            if flags & (1 << bit):
+                out.append(data[pos])
+                pos += 1
+            else:
+                if pos + 1 >= len(data):
+                    raise ValueError("Truncated match")
+                distance = (data[pos] | (data[pos + 1] & 0xF0) << 4) + 1
+                length = (data[pos + 1] & 0x0F) + MATCH_LENGTH_MIN
+                if distance > len(out):
+                    raise ValueError(f"Match distance ({distance}) before start of data")
+                for _ in range(length):
+                    out.append(out[-distance])  # Byte by byte, a match may overlap its own output
+                pos += 2
+    return out
+
+
+def pack(request: bytes) -> bytearray:
+    """Wraps a request (including its terminating '\\0') into the packed envelope: magic, packed length and
+    decoded length as uint16 little endian, followed by the compressed request."""
+    packed = compress(request)
+    if len(packed) > PACKED_LENGTH_MAX or len(request) > PACKED_LENGTH_MAX:
+        raise ValueError(f"Request ({len(request)} bytes) too large to pack")
+    header = bytearray([PACKED_MAGIC])
+    header += len(packed).to_bytes(2, "little")
+    header += len(request).to_bytes(2, "little")
+    return header + packed
+
+
+def unpack(envelope: bytes) -> bytearray:
+    if len(envelope) < 5 or envelope[0] != PACKED_MAGIC:
+        raise ValueError("Not a packed request")
+    packed_length = int.from_bytes(envelope[1:3], "little")
+    request_length = int.from_bytes(envelope[3:5], "little")
+    if len(envelope) != 5 + packed_length:
+        raise ValueError(f"Packed length ({packed_length}) does not match ({len(envelope) - 5})")
+    request = decompress(envelope[5:])
+    if len(request) != request_length:
+        raise ValueError(f"Decoded length ({len(request)}) does not match ({request_length})")
+    return request
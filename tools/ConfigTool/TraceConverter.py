@@ -0,0 +1,67 @@
+import struct
+
+# Order matches 'enum class TraceEvent' in arduino/esp32-daisy-chain/Trace.h
+TRACE_EVENTS = [
+    "BLE_RX_CHUNK",
+    "BLE_TX_CHUNK",
+    "BLE_TX_CONFIRM",
+    "CMD_BEGIN",
+    "CMD_END",
+    "CMD_SCHEDULED",
+    "FRAME_COMMIT",
+    "FLUSH_BEGIN",
+    "FLUSH_END",
+    "SPI_BEGIN",
+    "SPI_END",
+    "PLAYER_STEP",
+    "RAMP_TICK",
+]
+
+RECORD_FORMAT = "<IHBxI"  # time_us, event, core, reserved, arg
+RECORD_SIZE = struct.calcsize(RECORD_FORMAT)
+TIME_WRAP = 1 << 32  # The device records the low 32 bits of esp_timer_get_time()
+
+
+def parse_records(data: bytes) -> list[tuple[int, int, int, int]]:
+    if len(data) % RECORD_SIZE != 0:
+        raise ValueError(f"Trace data length ({len(data)}) is not a multiple of {RECORD_SIZE}")
+    return [struct.unpack_from(RECORD_FORMAT, data, offset) for offset in range(0, len(data), RECORD_SIZE)]
+
+
+def to_chrome_trace(data: bytes) -> dict:
+    """Converts a raw trace dump (oldest record first) to the Chrome trace event format.
+
+    Timestamps are microseconds of the esp_timer, which keeps its rate through frequency scaling and light
+    sleep. The 32-bit value wraps after about 71 minutes, so timestamps are accumulated from the signed
+    difference to the previous record. Records of two cores may appear slightly out of order, a gap of more
+    than 2^31 us (about 35 minutes) between consecutive records cannot be recovered.
+    *_BEGIN/*_END pairs become duration events, all other events instants on the thread of their core.
+    """
+    previous = None
+    elapsed = 0
+    events = []
+    for time_us, event, core, arg in parse_records(data):
+        if previous is not None:
+            elapsed += (time_us - previous + TIME_WRAP // 2) % TIME_WRAP - TIME_WRAP // 2
+        previous = time_us
+
+        name = TRACE_EVENTS[event] if event < len(TRACE_EVENTS) else f"EVENT_{event}"
+        phase = "i"
+        if name.endswith("_BEGIN"):
+            name, phase = name[: -len("_BEGIN")], "B"
+        elif name.endswith("_END"):
+            name, phase = name[: -len("_END")], "E"
+
+        trace_event = {
+            "name": name,
+            "ph": phase,
+            "ts": elapsed,
+            "pid": 0,
+            "tid": core,
+            "args": {"arg": arg},
+        }
+        if phase == "i":
+            trace_event["s"] = "t"
+        events.append(trace_event)
+
+    return {"traceEvents": events, "displayTimeUnit": "ns"}
@@ -0,0 +1,89 @@
+import random
+import pytest
+import ClockSync as cs
+
+
+class SimulatedDevice:
+    """Device clock with a fixed offset and a drift (ppm) relative to the host clock."""
+
+    def __init__(self, offset_us: int, drift_ppm: float):
+        self.offset_us = offset_us
+        self.drift_ppm = drift_ppm
+
+    def time_us(self, host_time_us: float) -> int:
+        return int(host_time_us + self.offset_us + host_time_us * self.drift_ppm / 1e6)
+
+
+def exchange(device: SimulatedDevice, host_time_us: float, uplink_us: float, downlink_us: float, processing_us=500):
+    t1 = int(host_time_us)
+    t2 = device.time_us(host_time_us + uplink_us)
+    t3 = device.time_us(host_time_us + uplink_us + processing_us)
+    t4 = int(host_time_us + uplink_us + processing_us + downlink_us)
+    return t1, t2, t3, t4
+
+
+class TestClockSync:
+    def test_symmetric_latency(self):
+        device = SimulatedDevice(offset_us=123_456_789, drift_ppm=0)
+        sync = cs.ClockSync()
+        sync.add_sample(*exchange(device, 1_000_000, uplink_us=15_000, downlink_us=15_000))
+
+        assert sync.round_trip_us() == pytest.approx(30_000, abs=2)
+        assert sync.to_device_time(2_000_000) == pytest.approx(device.time_us(2_000_000), abs=2)
+
+    def test_jitter_is_filtered(self):
+        random.seed(42)
+        device = SimulatedDevice(offset_us=-5_000_000, drift_ppm=0)
+        sync = cs.ClockSync()
+        host_time_us = 10_000_000
+        for _ in range(16):
+            # Typical BLE connection interval jitter, heavily asymmetric on some samples
+            sync.add_sample(
+                *exchange(device, host_time_us, random.uniform(7_500, 60_000), random.uniform(7_500, 60_000))
+            )
+            host_time_us += 200_000
+
+        assert sync.to_device_time(host_time_us) == pytest.approx(device.time_us(host_time_us), abs=5_000)
+
+    def test_drift_is_estimated(self):
+        random.seed(7)
+        device = SimulatedDevice(offset_us=42_000, drift_ppm=80)  # Cheap crystal
+        sync = cs.ClockSync()
+        host_time_us = 0
+        for _ in range(32):
+            sync.add_sample(*exchange(device, host_time_us, random.uniform(7_500, 9_000), random.uniform(7_500, 9_000)))
+            host_time_us += 2_000_000
+
+        assert sync.drift * 1e6 == pytest.approx(80, abs=10)
+        # Predict a show start 30 s after the last sample
+        start_us = host_time_us + 30_000_000
+        assert sync.to_device_time(start_us) == pytest.approx(device.time_us(start_us), abs=1_000)
+
+    def test_two_devices_start_together(self):
+        random.seed(1)
+        devices = [SimulatedDevice(offset_us=3_000_000, drift_ppm=-40), SimulatedDevice(offset_us=9_000, drift_ppm=25)]
+        syncs = [cs.ClockSync(), cs.ClockSync()]
+        host_time_us = 0
+        for _ in range(16):
+            for device, sync in zip(devices, syncs):
+                sync.add_sample(
+                    *exchange(device, host_time_us, random.uniform(7_500, 30_000), random.uniform(7_500, 30_000))
+                )
+            host_time_us += 500_000
+
+        # Each device receives the common host start time converted to its own clock
+        start_us = host_time_us + 5_000_000
+        host_starts = [sync.to_host_time(sync.to_device_time(start_us)) for sync in syncs]
+        actual_starts = [
+            (sync.to_device_time(start_us) - device.offset_us) / (1 + device.drift_ppm / 1e6)
+            for device, sync in zip(devices, syncs)
+        ]
+        assert host_starts[0] == pytest.approx(start_us, abs=1)
+        assert abs(actual_starts[0] - actual_starts[1]) < 10_000
+
+    def test_invalid_timestamps(self):
+        sync = cs.ClockSync()
+        with pytest.raises(ValueError):
+            sync.add_sample(10, 0, 0, 5)
+        with pytest.raises(RuntimeError):
+            sync.to_device_time(0)
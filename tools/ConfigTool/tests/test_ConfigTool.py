@@ -3,9 +3,12 @@ import pytest
 import asyncio
 import json
 import re
+import zlib
 import CmdBuilder as cb
 import DaisyChain as dc
 import BleClient as bc
+import Lzss
+from ConfigTool import CALIBRATION_CHUNK_SIZE, LAYOUT_CHUNK_SIZE
 
 
 @pytest_asyncio.fixture
@@ -13,6 +16,10 @@ async def ble_client():
     client = bc.BleClient()
     await asyncio.sleep(1)
     await client.connect()
+    # Idle map and layout transfers are sized from the topology of the device under test
+    response = await client.send_command(cb.CmdBuilder.get_topology(rid=0), timeout=2.0)
+    chains, chain_size, _ = cb.CmdBuilder.evaluate_get_topology_response(response, rid=0)
+    dc.apply_topology(chains, chain_size)
     yield client
     await client.disconnect()
 
@@ -62,6 +69,49 @@ class TestCmdBuilder:
         version = cb.CmdBuilder.evaluate_get_version_response(response, rid=1)
         assert re.fullmatch(r"V\d+\.\d+\.\d+", version)
 
+    @pytest.mark.asyncio
+    async def test_sync_time(self, ble_client):
+        cmd = cb.CmdBuilder.sync_time(rid=20)
+        assert cmd == bytearray(b'{"rid":20,"cmd":"sync_time"}\0')
+
+        # Send command and evaluate response
+        response = await ble_client.send_command(cmd, timeout=2.0)
+        rx_us, tx_us = cb.CmdBuilder.evaluate_sync_time_response(response, rid=20)
+        assert 0 < rx_us <= tx_us
+
+    @pytest.mark.asyncio
+    async def test_get_stats(self, ble_client):
+        cmd = cb.CmdBuilder.get_stats(rid=24)
+        assert cmd == bytearray(b'{"rid":24,"cmd":"get_stats"}\0')
+
+        # Send command and evaluate response
+        response = await ble_client.send_command(cmd, timeout=3.0)
+        stats = cb.CmdBuilder.evaluate_get_stats_response(response, rid=24)
+        assert stats["counters"]["rx_requests"] > 0
+        assert len(stats["histograms"]["loop_period"]["buckets"]) == 16
+        assert 0 < stats["boot"]["first_frame_us"] < stats["boot"]["ble_ready_us"]
+        assert stats["rx_limit"] >= 10 * 1024 and stats["show_led_limit"] >= 256
+
+    @pytest.mark.asyncio
+    async def test_reset_stats(self, ble_client):
+        cmd = cb.CmdBuilder.reset_stats(rid=25)
+        assert cmd == bytearray(b'{"rid":25,"cmd":"reset_stats"}\0')
+
+        # Send command and evaluate response
+        response = await ble_client.send_command(cmd, timeout=2.0)
+        assert cb.CmdBuilder.evaluate_reset_stats_response(response, rid=25) == True
+
+    @pytest.mark.asyncio
+    async def test_get_trace(self, ble_client):
+        cmd = cb.CmdBuilder.get_trace(rid=26, offset=0, length=60)
+        assert cmd == bytearray(b'{"rid":26,"cmd":"get_trace","offset":0,"length":60}\0')
+
+        # Send command and evaluate response
+        response = await ble_client.send_command(cmd, timeout=2.0)
+        size, records = cb.CmdBuilder.evaluate_get_trace_response(response, rid=26)
+        assert size > 0
+        assert len(records) == min(size, 60) * 12
+
     @pytest.mark.asyncio
     async def test_get_system_id(self, ble_client):
         cmd = cb.CmdBuilder.get_system_id(rid=11)
@@ -81,6 +131,53 @@ class TestCmdBuilder:
         response = await ble_client.send_command(cmd, timeout=2.0)
         assert cb.CmdBuilder.evaluate_set_system_id_response(response, rid=12) == True
 
+    @pytest.mark.asyncio
+    async def test_get_topology(self, ble_client):
+        cmd = cb.CmdBuilder.get_topology(rid=18)
+        assert cmd == bytearray(b'{"rid":18,"cmd":"get_topology"}\0')
+
+        # Send command and evaluate response
+        response = await ble_client.send_command(cmd, timeout=2.0)
+        chains, chain_size, pins = cb.CmdBuilder.evaluate_get_topology_response(response, rid=18)
+        assert 0 < chains <= dc.CHAIN_COUNT_MAX and 0 < chain_size <= dc.CHAIN_SIZE_MAX and len(pins) == chains
+        assert dc.PCB_COUNT == chains * chain_size and dc.LED_TOTAL == dc.PCB_COUNT * dc.LED_COUNT
+
+    @pytest.mark.asyncio
+    async def test_set_topology(self, ble_client):
+        cmd = cb.CmdBuilder.set_topology(rid=19, chains=6, chain_size=10, pins=[48, 47, 21, 10, 9, 3])
+        assert cmd == bytearray(
+            b'{"rid":19,"cmd":"set_topology","chains":6,"chain_size":10,"pins":[48,47,21,10,9,3]}\0'
+        )
+        with pytest.raises(ValueError):
+            cb.CmdBuilder.set_topology(rid=19, chains=2, chain_size=10, pins=[48, 12])  # LED SPI clock
+
+        # Store the topology the device reports, the installation under test keeps its configuration
+        response = await ble_client.send_command(cb.CmdBuilder.get_topology(rid=56), timeout=2.0)
+        chains, chain_size, pins = cb.CmdBuilder.evaluate_get_topology_response(response, rid=56)
+        cmd = cb.CmdBuilder.set_topology(rid=19, chains=chains, chain_size=chain_size, pins=pins)
+
+        # Send command and evaluate response
+        response = await ble_client.send_command(cmd, timeout=2.0)
+        assert cb.CmdBuilder.evaluate_set_topology_response(response, rid=19) == True
+
+    @pytest.mark.asyncio
+    async def test_set_refresh_interval(self, ble_client):
+        cmd = cb.CmdBuilder.set_refresh_interval(rid=27, interval_ms=3000)
+        assert cmd == bytearray(b'{"rid":27,"cmd":"set_refresh_interval","interval_ms":3000}\0')
+
+        # Send command and evaluate response
+        response = await ble_client.send_command(cmd, timeout=2.0)
+        assert cb.CmdBuilder.evaluate_set_refresh_interval_response(response, rid=27) == True
+
+    @pytest.mark.asyncio
+    async def test_get_refresh_interval(self, ble_client):
+        cmd = cb.CmdBuilder.get_refresh_interval(rid=28)
+        assert cmd == bytearray(b'{"rid":28,"cmd":"get_refresh_interval"}\0')
+
+        # Send command and evaluate response
+        response = await ble_client.send_command(cmd, timeout=2.0)
+        assert cb.CmdBuilder.evaluate_get_refresh_interval_response(response, rid=28) == 3000
+
     @pytest.mark.asyncio
     async def test_get_calibration_name(self, ble_client):
         cmd = cb.CmdBuilder.get_calibration_name(rid=2)
@@ -109,6 +206,50 @@ class TestCmdBuilder:
         response = await ble_client.send_command(cmd, timeout=3.0)
         assert cb.CmdBuilder.evaluate_save_calibration_response(response, rid=4) == True
 
+    @pytest.mark.asyncio
+    async def test_save_profile(self, ble_client):
+        cmd = cb.CmdBuilder.save_profile(rid=14, name="night")
+        assert cmd == bytearray(b'{"rid":14,"cmd":"save_profile","name":"night"}\0')
+
+        # Send command and evaluate response
+        response = await ble_client.send_command(cmd, timeout=3.0)
+        assert cb.CmdBuilder.evaluate_save_profile_response(response, rid=14) == True
+
+    @pytest.mark.asyncio
+    async def test_list_profiles(self, ble_client):
+        cmd = cb.CmdBuilder.list_profiles(rid=15)
+        assert cmd == bytearray(b'{"rid":15,"cmd":"list_profiles"}\0')
+
+        # Send command and evaluate response
+        response = await ble_client.send_command(cmd, timeout=2.0)
+        active, profiles = cb.CmdBuilder.evaluate_list_profiles_response(response, rid=15)
+        assert isinstance(active, str) and "night" in profiles
+
+    @pytest.mark.asyncio
+    async def test_select_profile(self, ble_client):
+        cmd = cb.CmdBuilder.select_profile(rid=16, name="night", fade_ms=1000)
+        assert cmd == bytearray(b'{"rid":16,"cmd":"select_profile","name":"night","fade_ms":1000}\0')
+
+        # Send command and evaluate response
+        response = await ble_client.send_command(cmd, timeout=3.0)
+        assert cb.CmdBuilder.evaluate_select_profile_response(response, rid=16) == True
+
+        # The blend weight of a longer crossfade would overflow
+        with pytest.raises(ValueError):
+            cb.CmdBuilder.select_profile(rid=62, name="night", fade_ms=dc.FADE_MAX_MS + 1)
+        cmd = bytearray(b'{"rid":62,"cmd":"select_profile","name":"night","fade_ms":600001}\0')
+        response = await ble_client.send_command(cmd, timeout=3.0)
+        assert cb.CmdBuilder._evaluate_response(response, rid=62, status=-1)[0] == True
+
+    @pytest.mark.asyncio
+    async def test_delete_profile(self, ble_client):
+        cmd = cb.CmdBuilder.delete_profile(rid=17, name="unknown")
+        assert cmd == bytearray(b'{"rid":17,"cmd":"delete_profile","name":"unknown"}\0')
+
+        # Send command and evaluate response
+        response = await ble_client.send_command(cmd, timeout=3.0)
+        assert cb.CmdBuilder.evaluate_delete_profile_response(response, rid=17) == False
+
     @pytest.mark.asyncio
     async def test_set_brightness(self, ble_client):
         leds = [dc.Led(pcb_index=1, led_index=2, brightness=42), dc.Led(pcb_index=2, led_index=3, brightness=69)]
@@ -119,6 +260,53 @@ class TestCmdBuilder:
         response = await ble_client.send_command(cmd, timeout=3.0)
         assert cb.CmdBuilder.evaluate_set_brightness_response(response, rid=5) == True
 
+    @pytest.mark.asyncio
+    async def test_set_master(self, ble_client):
+        cmd = cb.CmdBuilder.set_master(rid=21, level=100)
+        assert cmd == bytearray(b'{"rid":21,"cmd":"set_master","level":100}\0')
+
+        # Send command and evaluate response
+        response = await ble_client.send_command(cmd, timeout=2.0)
+        assert cb.CmdBuilder.evaluate_set_master_response(response, rid=21) == True
+
+    @pytest.mark.asyncio
+    async def test_set_twinkle(self, ble_client):
+        cmd = cb.CmdBuilder.set_twinkle(rid=29, depth=0)
+        assert cmd == bytearray(b'{"rid":29,"cmd":"set_twinkle","depth":0,"period_ms":3000,"density":30}\0')
+
+        # Send command and evaluate response
+        response = await ble_client.send_command(cmd, timeout=2.0)
+        assert cb.CmdBuilder.evaluate_set_twinkle_response(response, rid=29) == True
+
+    @pytest.mark.asyncio
+    async def test_scheduled_stop_show(self, ble_client):
+        response = await ble_client.send_command(cb.CmdBuilder.sync_time(rid=22), timeout=2.0)
+        _, tx_us = cb.CmdBuilder.evaluate_sync_time_response(response, rid=22)
+
+        cmd = cb.CmdBuilder.stop_show(rid=23, at=tx_us + 500_000)
+        assert cmd == bytearray(b'{"rid":23,"cmd":"stop_show","at":%d}\0' % (tx_us + 500_000))
+
+        # Scheduled commands are acknowledged when queued
+        response = await ble_client.send_command(cmd, timeout=2.0)
+        assert cb.CmdBuilder.evaluate_stop_show_response(response, rid=23) == True
+
+    @pytest.mark.asyncio
+    async def test_keyframe(self, ble_client):
+        response = await ble_client.send_command(cb.CmdBuilder.stop_show(rid=35), timeout=2.0)
+        assert cb.CmdBuilder.evaluate_stop_show_response(response, rid=35) == True
+        response = await ble_client.send_command(cb.CmdBuilder.sync_time(rid=36), timeout=2.0)
+        _, tx_us = cb.CmdBuilder.evaluate_sync_time_response(response, rid=36)
+
+        leds = [dc.Led(pcb_index=1, led_index=1, brightness=80), dc.Led(pcb_index=1, led_index=2, brightness=20)]
+        cmd = cb.CmdBuilder.keyframe(rid=37, time=tx_us + 500_000, leds=leds, curve="ease")
+        assert cmd == bytearray(
+            b'{"rid":37,"cmd":"keyframe","time":%d,"curve":"ease","leds":[[1,1,80],[1,2,20]]}\0' % (tx_us + 500_000)
+        )
+
+        # Send command and evaluate response, the keyframe occupies one buffer slot until it is reached
+        response = await ble_client.send_command(cmd, timeout=2.0)
+        assert cb.CmdBuilder.evaluate_keyframe_response(response, rid=37) == dc.KEYFRAME_BUFFER_SIZE - 1
+
     @pytest.mark.asyncio
     async def test_get_brightness(self, ble_client):
         leds = [dc.Led(pcb_index=1, led_index=2, brightness=0), dc.Led(pcb_index=2, led_index=3, brightness=0)]
@@ -131,6 +319,88 @@ class TestCmdBuilder:
         assert isinstance(downloaded_leds, list) and len(downloaded_leds) == 2
         assert all(isinstance(led, dc.Led) for led in downloaded_leds)
 
+    @pytest.mark.asyncio
+    async def test_write_calibration(self, ble_client):
+        cmd = cb.CmdBuilder.write_calibration(rid=8, offset=0, data=bytes([10, 20, 30]))
+        assert cmd == bytearray(b'{"rid":8,"cmd":"write_calibration","offset":0,"data":"ChQe","crc":645379826}\0')
+
+        # Send command and evaluate response
+        response = await ble_client.send_command(cmd, timeout=3.0)
+        assert cb.CmdBuilder.evaluate_write_calibration_response(response, rid=8) == True
+
+    @pytest.mark.asyncio
+    async def test_commit_calibration(self, ble_client):
+        # The idle map of the device is written back, the calibration of the installation is kept
+        idle_map = bytearray()
+        for i, offset in enumerate(range(0, dc.LED_TOTAL, CALIBRATION_CHUNK_SIZE)):
+            length = min(CALIBRATION_CHUNK_SIZE, dc.LED_TOTAL - offset)
+            cmd = cb.CmdBuilder.read_calibration(rid=100 + i, offset=offset, length=length)
+            response = await ble_client.send_command(cmd, timeout=3.0)
+            idle_map += cb.CmdBuilder.evaluate_read_calibration_response(response, rid=100 + i)
+        for i, offset in enumerate(range(0, dc.LED_TOTAL, CALIBRATION_CHUNK_SIZE)):
+            chunk = bytes(idle_map[offset : offset + CALIBRATION_CHUNK_SIZE])
+            cmd = cb.CmdBuilder.write_calibration(rid=200 + i, offset=offset, data=chunk)
+            response = await ble_client.send_command(cmd, timeout=3.0)
+            assert cb.CmdBuilder.evaluate_write_calibration_response(response, rid=200 + i) == True
+
+        crc = zlib.crc32(idle_map)
+        cmd = cb.CmdBuilder.commit_calibration(rid=10, crc=crc)
+        assert cmd == bytearray(b'{"rid":10,"cmd":"commit_calibration","crc":%d}\0' % crc)
+
+        # Send command and evaluate response
+        response = await ble_client.send_command(cmd, timeout=3.0)
+        assert cb.CmdBuilder.evaluate_commit_calibration_response(response, rid=10) == True
+
+    @pytest.mark.asyncio
+    async def test_read_calibration(self, ble_client):
+        # First chunk of the idle map, sized from the topology of the device
+        length = min(CALIBRATION_CHUNK_SIZE, dc.LED_TOTAL)
+        cmd = cb.CmdBuilder.read_calibration(rid=13, offset=0, length=length)
+        assert cmd == bytearray(b'{"rid":13,"cmd":"read_calibration","offset":0,"length":%d}\0' % length)
+
+        # Send command and evaluate response
+        response = await ble_client.send_command(cmd, timeout=3.0)
+        idle_map = cb.CmdBuilder.evaluate_read_calibration_response(response, rid=13)
+        assert isinstance(idle_map, bytes) and len(idle_map) == length
+
+    @pytest.mark.asyncio
+    async def test_write_layout(self, ble_client):
+        cmd = cb.CmdBuilder.write_layout(rid=30, offset=0, data=bytes([10, 20, 30, 40]))
+        assert cmd == bytearray(b'{"rid":30,"cmd":"write_layout","offset":0,"data":"ChQeKA==","crc":3022169073}\0')
+
+        # Send command and evaluate response
+        response = await ble_client.send_command(cmd, timeout=3.0)
+        assert cb.CmdBuilder.evaluate_write_layout_response(response, rid=30) == True
+
+    @pytest.mark.asyncio
+    async def test_commit_layout(self, ble_client):
+        # Diagonal layout, every LED on its own position
+        layout = bytes(i * 255 // (dc.LED_TOTAL - 1) for i in range(dc.LED_TOTAL) for _ in range(2))
+        for i, offset in enumerate(range(0, len(layout), LAYOUT_CHUNK_SIZE)):
+            chunk = layout[offset : offset + LAYOUT_CHUNK_SIZE]
+            cmd = cb.CmdBuilder.write_layout(rid=300 + i, offset=offset, data=chunk)
+            response = await ble_client.send_command(cmd, timeout=3.0)
+            assert cb.CmdBuilder.evaluate_write_layout_response(response, rid=300 + i) == True
+
+        cmd = cb.CmdBuilder.commit_layout(rid=32, crc=zlib.crc32(layout))
+        assert cmd == bytearray(b'{"rid":32,"cmd":"commit_layout","crc":%d}\0' % zlib.crc32(layout))
+
+        # Send command and evaluate response
+        response = await ble_client.send_command(cmd, timeout=3.0)
+        assert cb.CmdBuilder.evaluate_commit_layout_response(response, rid=32) == True
+
+    @pytest.mark.asyncio
+    async def test_set_pattern(self, ble_client):
+        cmd = cb.CmdBuilder.set_pattern(rid=33, pattern="off")
+        assert cmd == bytearray(
+            b'{"rid":33,"cmd":"set_pattern","pattern":"off","x":128,"y":128,"angle":0,"period_ms":3000,'
+            b'"width":64,"level":100,"duration_ms":0}\0'
+        )
+
+        # Send command and evaluate response
+        response = await ble_client.send_command(cmd, timeout=2.0)
+        assert cb.CmdBuilder.evaluate_set_pattern_response(response, rid=33) == True
+
     @pytest.mark.asyncio
     async def test_play_show(self, ble_client):
         groups = [
@@ -157,3 +427,186 @@ class TestCmdBuilder:
         # Send command and evaluate response
         response = await ble_client.send_command(cmd, timeout=5.0)
         assert cb.CmdBuilder.evaluate_play_show_response(response, rid=7) == True
+
+    @pytest.mark.asyncio
+    async def test_play_staggered_show(self, ble_client):
+        show = dc.Show(name="test_chase")
+        show.add_group([dc.Led(pcb_index=1, led_index=i, brightness=0) for i in range(1, 7)])
+        show.add_step(
+            0, dc.Step(down_ms=200, pause_ms=0, up_ms=200, pulse_ms=0, reps=2, idle_return=True, stagger_ms=50)
+        )
+
+        cmd = cb.CmdBuilder.play_show(rid=34, show=show, force=True)
+        expected_cmd = (
+            b'{"rid":34,"cmd":"play_show","force":1,"groups":[[[1,1],[1,2],[1,3],[1,4],[1,5],[1,6]]],'
+            b'"sequence":[[0,200,0,200,0,2,1,50]]}\0'
+        )
+        assert cmd == bytearray(expected_cmd)
+
+        # Send command and evaluate response
+        response = await ble_client.send_command(cmd, timeout=5.0)
+        assert cb.CmdBuilder.evaluate_play_show_response(response, rid=34) == True
+
+    @pytest.mark.asyncio
+    async def test_queue_show(self, ble_client):
+        show = dc.Show(name="test_next")
+        show.add_group([dc.Led(pcb_index=1, led_index=1, brightness=0), dc.Led(pcb_index=1, led_index=2, brightness=0)])
+        show.add_step(0, dc.Step(down_ms=500, pause_ms=0, up_ms=500, pulse_ms=0, reps=2, idle_return=True))
+
+        cmd = cb.CmdBuilder.queue_show(rid=38, show=show, fade_ms=1000)
+        expected_cmd = (
+            b'{"rid":38,"cmd":"queue_show","groups":[[[1,1],[1,2]]],'
+            b'"sequence":[[0,500,0,500,0,2,1]],"fade_ms":1000}\0'
+        )
+        assert cmd == bytearray(expected_cmd)
+
+        # Send command and evaluate response
+        response = await ble_client.send_command(cmd, timeout=5.0)
+        assert cb.CmdBuilder.evaluate_queue_show_response(response, rid=38) == True
+
+        with pytest.raises(ValueError):
+            cb.CmdBuilder.queue_show(rid=63, show=show, fade_ms=dc.FADE_MAX_MS + 1)
+        cmd = bytearray(cmd.replace(b'"rid":38', b'"rid":63').replace(b'"fade_ms":1000', b'"fade_ms":600001'))
+        response = await ble_client.send_command(cmd, timeout=5.0)
+        assert cb.CmdBuilder._evaluate_response(response, rid=63, status=-1)[0] == True
+
+    @pytest.mark.asyncio
+    async def test_show_transport(self, ble_client):
+        show = dc.Show(name="test_rehearsal")
+        show.add_group([dc.Led(pcb_index=1, led_index=1, brightness=0), dc.Led(pcb_index=1, led_index=2, brightness=0)])
+        show.add_step(0, dc.Step(down_ms=1000, pause_ms=1000, up_ms=1000, pulse_ms=1000, reps=10, idle_return=True))
+        response = await ble_client.send_command(cb.CmdBuilder.play_show(rid=39, show=show, force=True), timeout=5.0)
+        assert cb.CmdBuilder.evaluate_play_show_response(response, rid=39) == True
+
+        cmd = cb.CmdBuilder.pause_show(rid=40)
+        assert cmd == bytearray(b'{"rid":40,"cmd":"pause_show"}\0')
+        response = await ble_client.send_command(cmd, timeout=2.0)
+        assert cb.CmdBuilder.evaluate_pause_show_response(response, rid=40) == True
+
+        cmd = cb.CmdBuilder.set_tempo(rid=41, tempo=200)
+        assert cmd == bytearray(b'{"rid":41,"cmd":"set_tempo","tempo":200}\0')
+        response = await ble_client.send_command(cmd, timeout=2.0)
+        assert cb.CmdBuilder.evaluate_set_tempo_response(response, rid=41) == True
+
+        cmd = cb.CmdBuilder.seek_show(rid=42, position_ms=30_500)
+        assert cmd == bytearray(b'{"rid":42,"cmd":"seek_show","position_ms":30500}\0')
+        response = await ble_client.send_command(cmd, timeout=2.0)
+        assert cb.CmdBuilder.evaluate_seek_show_response(response, rid=42) == True
+
+        cmd = cb.CmdBuilder.resume_show(rid=43)
+        assert cmd == bytearray(b'{"rid":43,"cmd":"resume_show"}\0')
+        response = await ble_client.send_command(cmd, timeout=2.0)
+        assert cb.CmdBuilder.evaluate_resume_show_response(response, rid=43) == True
+
+        # Back to the programmed speed for the following tests
+        response = await ble_client.send_command(cb.CmdBuilder.set_tempo(rid=44, tempo=100), timeout=2.0)
+        assert cb.CmdBuilder.evaluate_set_tempo_response(response, rid=44) == True
+
+    @pytest.mark.asyncio
+    async def test_live_tweaks(self, ble_client):
+        show = dc.Show(name="test_tuning")
+        show.add_group([dc.Led(pcb_index=1, led_index=1, brightness=0), dc.Led(pcb_index=1, led_index=2, brightness=0)])
+        show.add_group([dc.Led(pcb_index=2, led_index=1, brightness=0), dc.Led(pcb_index=2, led_index=2, brightness=0)])
+        show.add_step(0, dc.Step(down_ms=500, pause_ms=500, up_ms=500, pulse_ms=500, reps=10, idle_return=False))
+        show.add_step(1, dc.Step(down_ms=500, pause_ms=500, up_ms=500, pulse_ms=500, reps=10, idle_return=True))
+        response = await ble_client.send_command(cb.CmdBuilder.play_show(rid=45, show=show, force=True), timeout=5.0)
+        assert cb.CmdBuilder.evaluate_play_show_response(response, rid=45) == True
+
+        cmd = cb.CmdBuilder.set_gain(rid=46, group=0, gain=40)
+        assert cmd == bytearray(b'{"rid":46,"cmd":"set_gain","group":0,"gain":40}\0')
+        response = await ble_client.send_command(cmd, timeout=2.0)
+        assert cb.CmdBuilder.evaluate_set_gain_response(response, rid=46) == True
+
+        cmd = cb.CmdBuilder.set_step(rid=47, step=1, down_ms=200, pause_ms=300, up_ms=200, pulse_ms=1000)
+        assert cmd == bytearray(b'{"rid":47,"cmd":"set_step","step":1,"durations":[200,300,200,1000]}\0')
+        response = await ble_client.send_command(cmd, timeout=2.0)
+        assert cb.CmdBuilder.evaluate_set_step_response(response, rid=47) == True
+
+    @pytest.mark.asyncio
+    async def test_batch(self, ble_client):
+        commands = [
+            cb.CmdBuilder.set_brightness(rid=0, leds=[dc.Led(pcb_index=1, led_index=1, brightness=30)]),
+            cb.CmdBuilder.set_master(rid=0, level=80),
+            cb.CmdBuilder.stop_show(rid=0),
+        ]
+        cmd = cb.CmdBuilder.batch(rid=48, commands=commands)
+        assert cmd == bytearray(
+            b'{"rid":48,"cmd":"batch","cmds":[{"cmd":"set_brightness","leds":[[1,1,30]]},'
+            b'{"cmd":"set_master","level":80},{"cmd":"stop_show"}]}\0'
+        )
+
+        # Send command and evaluate response, one status per sub-command
+        response = await ble_client.send_command(cmd, timeout=5.0)
+        assert cb.CmdBuilder.evaluate_batch_response(response, rid=48) == [0, 0, 0]
+
+    @pytest.mark.asyncio
+    async def test_batch_atomic(self, ble_client):
+        led = [dc.Led(pcb_index=1, led_index=1, brightness=0)]
+        response = await ble_client.send_command(cb.CmdBuilder.get_brightness(rid=51, leds=led), timeout=3.0)
+        before = cb.CmdBuilder.evaluate_get_brightness_response(response, rid=51)[0].brightness
+
+        # Nothing is playing after stop_show, so seek_show fails and none of the sub-commands is applied
+        commands = [
+            cb.CmdBuilder.set_brightness(rid=0, leds=[dc.Led(pcb_index=1, led_index=1, brightness=(before + 1) % 100)]),
+            cb.CmdBuilder.stop_show(rid=0),
+            cb.CmdBuilder.seek_show(rid=0, position_ms=0),
+        ]
+        response = await ble_client.send_command(cb.CmdBuilder.batch(rid=52, commands=commands), timeout=5.0)
+        doc = json.loads(response.decode("utf-8").rstrip("\0"))
+        assert doc["rid"] == 52 and doc["status"] == -1 and doc["results"] == [0, 0, -1]
+
+        response = await ble_client.send_command(cb.CmdBuilder.get_brightness(rid=53, leds=led), timeout=3.0)
+        assert cb.CmdBuilder.evaluate_get_brightness_response(response, rid=53)[0].brightness == before
+
+    @pytest.mark.asyncio
+    async def test_replayed_request(self, ble_client):
+        async def duplicates(rid: int) -> int:
+            response = await ble_client.send_command(cb.CmdBuilder.get_stats(rid=rid), timeout=2.0)
+            return cb.CmdBuilder.evaluate_get_stats_response(response, rid=rid)["counters"]["rx_duplicates"]
+
+        cmd = cb.CmdBuilder.set_master(rid=49, level=100)
+        first = bytes(await ble_client.send_command(cmd, timeout=5.0))
+        before = await duplicates(rid=54)
+
+        # A retry with the same rid gets the response of the first request, it is not executed again
+        second = bytes(await ble_client.send_command(cmd, timeout=5.0))
+        assert first == second
+        assert cb.CmdBuilder.evaluate_set_master_response(bytearray(second), rid=49) == True
+        assert await duplicates(rid=55) == before + 1
+
+        # A failed request is not cached, its retry is executed again
+        cmd = bytearray(b'{"rid":59,"cmd":"set_master","level":101}\0')
+        response = await ble_client.send_command(cmd, timeout=5.0)
+        assert cb.CmdBuilder._evaluate_response(response, rid=59, status=-1)[0] == True
+        before = await duplicates(rid=60)
+        response = await ble_client.send_command(cmd, timeout=5.0)
+        assert cb.CmdBuilder._evaluate_response(response, rid=59, status=-1)[0] == True
+        assert await duplicates(rid=61) == before
+
+    @pytest.mark.asyncio
+    async def test_packed_request(self, ble_client):
+        leds = [dc.Led(pcb_index=pcb, led_index=led, brightness=20) for pcb in range(1, 3) for led in range(1, 13)]
+        cmd = cb.CmdBuilder.set_brightness(rid=50, leds=leds)
+        packed = Lzss.pack(cmd)
+        assert packed[0] == Lzss.PACKED_MAGIC and len(packed) < len(cmd)
+
+        # The device decodes the envelope while receiving it and executes the request as if sent plain
+        response = await ble_client.send_command(packed, timeout=2.0)
+        assert cb.CmdBuilder.evaluate_set_brightness_response(response, rid=50) == True
+
+    @pytest.mark.asyncio
+    async def test_packed_large_show(self, ble_client):
+        response = await ble_client.send_command(cb.CmdBuilder.get_stats(rid=57), timeout=3.0)
+        stats = cb.CmdBuilder.evaluate_get_stats_response(response, rid=57)
+
+        # Every LED of the device in one show, more than a show holds without PSRAM
+        show = dc.Show(name="test_all_leds")
+        pcbs = range(1, dc.PCB_COUNT + 1)
+        show.add_group([dc.Led(pcb_index=pcb, led_index=led, brightness=0) for pcb in pcbs for led in range(1, 13)])
+        show.add_step(0, dc.Step(down_ms=200, pause_ms=0, up_ms=200, pulse_ms=0, reps=1, idle_return=True))
+        cmd = cb.CmdBuilder.play_show(rid=58, show=show, force=True)
+        if dc.LED_TOTAL > stats["show_led_limit"] or len(cmd) > stats["rx_limit"]:
+            pytest.skip(f"Show of {dc.LED_TOTAL} LEDs needs PSRAM on the device")
+
+        response = await ble_client.send_command(Lzss.pack(cmd), timeout=5.0)
+        assert cb.CmdBuilder.evaluate_play_show_response(response, rid=58) == True
@@ -0,0 +1,68 @@
+import json
+import os
+import random
+import pytest
+import Lzss
+
+
+SHOW_EXAMPLE = os.path.join(os.path.dirname(__file__), "..", "config", "show_example.json")
+
+
+def show_request(led_count: int) -> bytes:
+    """play_show request like show_example.json, scaled up to led_count LEDs."""
+    leds = [[pcb, led] for pcb in range(1, 33) for led in range(1, 13)][:led_count]
+    doc = {"rid": 1, "cmd": "play_show", "force": 1, "groups": [leds], "sequence": [[0, 500, 50, 500, 50, 16, 0]]}
+    return bytes(json.dumps(doc, separators=(",", ":")) + "\0", "utf-8")
+
+
+class TestLzss:
+    @pytest.mark.parametrize(
+        "data",
+        [
+            b"",
+            b"a",
+            b"abc",
+            b"\0" * 1000,  # Overlapping matches
+            b"abcabcabcabcabcabcabcabcabc",
+            bytes(range(256)) * 20,  # Matches at the window limit
+        ],
+    )
+    def test_roundtrip(self, data):
+        assert Lzss.decompress(Lzss.compress(data)) == data
+
+    def test_roundtrip_random(self):
+        random.seed(7)
+        for _ in range(20):
+            alphabet = random.randint(1, 256)
+            data = bytes(random.randrange(alphabet) for _ in range(random.randint(0, 6000)))
+            assert Lzss.decompress(Lzss.compress(data)) == data
+
+    def test_match_encoding(self):
+        # Literals 'a', 'b', then a match of 4 at distance 2 (overlapping its own output)
+        packed = Lzss.compress(b"ababab")
+        assert packed == bytearray([0b011, ord("a"), ord("b"), 0x01, 0x01])
+
+    def test_show_ratio(self):
+        with open(SHOW_EXAMPLE, "r") as f:
+            example = bytes(json.dumps(json.load(f), separators=(",", ":")) + "\0", "utf-8")
+        assert Lzss.decompress(Lzss.compress(example)) == example
+
+        request = show_request(384)
+        packed = Lzss.compress(request)
+        assert Lzss.decompress(packed) == request
+        assert len(packed) * 2 < len(request)
+
+    def test_envelope(self):
+        request = show_request(100)
+        envelope = Lzss.pack(request)
+        assert envelope[0] == Lzss.PACKED_MAGIC
+        assert int.from_bytes(envelope[1:3], "little") == len(envelope) - 5
+        assert int.from_bytes(envelope[3:5], "little") == len(request)
+        assert Lzss.unpack(envelope) == request
+
+    def test_envelope_corrupt(self):
+        envelope = Lzss.pack(show_request(100))
+        with pytest.raises(ValueError):
+            Lzss.unpack(envelope[:-1])
+        with pytest.raises(ValueError):
+            Lzss.unpack(b"{" + envelope[1:])
@@ -0,0 +1,56 @@
+import struct
+import pytest
+import TraceConverter as tc
+
+
+def pack(*records: tuple[int, str, int, int]) -> bytes:
+    return b"".join(
+        struct.pack(tc.RECORD_FORMAT, time_us, tc.TRACE_EVENTS.index(event), core, arg)
+        for time_us, event, core, arg in records
+    )
+
+
+class TestTraceConverter:
+    def test_record_size(self):
+        # Must match sizeof(Trace::Record) on the device
+        assert tc.RECORD_SIZE == 12
+
+    def test_begin_end_pairs(self):
+        data = pack((1000, "FLUSH_BEGIN", 1, 3), (1010, "FLUSH_END", 1, 3), (5000, "FRAME_COMMIT", 1, 0))
+        events = tc.to_chrome_trace(data)["traceEvents"]
+
+        assert [(event["name"], event["ph"]) for event in events] == [
+            ("FLUSH", "B"),
+            ("FLUSH", "E"),
+            ("FRAME_COMMIT", "i"),
+        ]
+        assert events[0]["ts"] == 0
+        assert events[1]["ts"] == pytest.approx(10.0)
+        assert events[0]["args"]["arg"] == 3
+
+    def test_timer_wraparound(self):
+        data = pack((0xFFFFFF00, "SPI_BEGIN", 1, 0), (0x00000100, "SPI_END", 1, 0))
+        events = tc.to_chrome_trace(data)["traceEvents"]
+        assert events[1]["ts"] == 0x200
+
+    def test_idle_gap(self):
+        # Light sleep between BLE events, far beyond 2^31 CPU cycles
+        data = pack((1000, "BLE_RX_CHUNK", 0, 20), (1000 + 60_000_000, "BLE_RX_CHUNK", 0, 20))
+        events = tc.to_chrome_trace(data)["traceEvents"]
+        assert events[1]["ts"] == 60_000_000
+
+    def test_cross_core_skew(self):
+        # Records of the two cores may appear slightly out of order
+        data = pack(
+            (0xFFFFFFF0, "BLE_RX_CHUNK", 0, 20),
+            (0xFFFFFFE0, "CMD_BEGIN", 1, 20),
+            (0x20, "BLE_TX_CHUNK", 0, 8),
+            (0x30, "CMD_END", 1, 5),
+        )
+        events = tc.to_chrome_trace(data)["traceEvents"]
+        assert [event["tid"] for event in events] == [0, 1, 0, 1]
+        assert [event["ts"] for event in events] == [0, -0x10, 0x30, 0x40]
+
+    def test_invalid_length(self):
+        with pytest.raises(ValueError):
+            tc.to_chrome_trace(b"\0" * 13)